@@ -5,18 +5,45 @@
 
 // ==================== NODE CONFIGURATION ====================
 
-// HQ Node ID (always "000h" for headquarters)
-#define NODE_ID      "000h"
+// HQ Node ID (always "0000" for headquarters)
+// Lamp addresses are 4 hex chars [district(1)][street(1)][lamp(2)]
+#define NODE_ID      "0000"
 
 // Reserved ID for broadcast messages (all nodes receive)
 #define BROADCAST_ID "FFFF"
 
 // Headquarters/Base Station ID (same as NODE_ID for HQ)
-#define HQ_ID        "000h"
+#define HQ_ID        "0000"
+
+// Mobile HQ (vehicle): NODE_ID in the reserved range 0001-000F and
+// HQ_MOBILE 1. Lamps take its broadcasts like HQ's and sync with it in
+// passing (see contact.h)
+#define HQ_MOBILE    0
+
+// Prefix wildcard: TARGET|10**|... reaches every lamp on street 0 of district 1
+#define ADDR_WILDCARD '*'
 
 // HQ is always at hop 0 (closest to itself!)
+// Hop fields are 2 hex chars (lamps count up to 0xFE)
 #define HQ_HOP       0
 
+// ==================== MESSAGE AUTHENTICATION ====================
+
+// Keyed tag (truncated SipHash) instead of simpleHash on Types 1, 2 and A
+// Must match MESH_AUTH / MESH_KEY on the lamps and in the dashboard
+#define MESH_AUTH 1
+
+const uint8_t MESH_KEY[16] = {
+  0x4C, 0x69, 0x46, 0x69, 0x4D, 0x65, 0x73, 0x68,
+  0x2D, 0x64, 0x65, 0x76, 0x2D, 0x6B, 0x65, 0x79
+};
+
+struct SipState {
+  uint64_t v0, v1, v2, v3;
+  uint64_t m;
+  uint32_t length;
+};
+
 // ==================== PIN ASSIGNMENTS ====================
 
 // Directional IR TX pins (4 directions for street lamp mesh)
@@ -49,12 +76,22 @@
 #define DEBUG_TIMING      1
 #define DEBUG_LED         1
 #define DEBUG_COMMAND     1  // Serial command processing
+#define DEBUG_DELIVERY    1  // Targeted delivery tracking
+#define DEBUG_COVERAGE    1  // Broadcast coverage reports
 
 // ==================== TIMING CONSTANTS ====================
 
 const unsigned long IR_DIRECTION_GAP = 100;
 const unsigned long IR_MESSAGE_TIMEOUT = 3000;
 
+// Low-power listening (must match the lamps' config.h)
+// HQ never sleeps, but precedes every packet with a wake preamble
+#define LPL_ENABLED 1
+#define LPL_WAKE_ADDRESS 0x01
+const unsigned long LPL_SLEEP_INTERVAL = 3600;
+const unsigned long LPL_LISTEN_WINDOW = 400;
+const unsigned long LPL_PREAMBLE_SKIP = 15000;  // Lamps still awake from our last TX
+
 // ==================== MESSAGE TYPE DEFINITIONS ====================
 
 #define MSG_TYPE_INIT      '0'  // HQ → All lamps (gradient setup)
@@ -62,12 +99,303 @@ const unsigned long IR_MESSAGE_TIMEOUT = 3000;
 #define MSG_TYPE_TARGETED  '2'  // HQ → Specific lamp
 #define MSG_TYPE_SOS       '3'  // Lamp → HQ (emergency)
 #define MSG_TYPE_MESSAGE   '4'  // Node → HQ
+#define MSG_TYPE_DIGEST    '5'  // Lamp → Neighbors (anti-entropy, ignored by HQ)
+#define MSG_TYPE_PULL      '6'  // Lamp → Neighbor (anti-entropy, ignored by HQ)
+#define MSG_TYPE_ACK       '7'  // Lamp → HQ (targeted delivery confirmation)
+#define MSG_TYPE_REPORT    '8'  // Lamp → HQ (aggregated broadcast coverage)
+#define MSG_TYPE_CONGESTION '9' // HQ → All lamps (throttle non-critical traffic)
+#define MSG_TYPE_CONFIG    'A'  // HQ → All lamps (runtime parameter block)
+#define MSG_TYPE_OTA_ADV   'B'  // Node → Neighbors (firmware image summary)
+#define MSG_TYPE_OTA_REQ   'C'  // Lamp → Neighbor (request firmware page)
+#define MSG_TYPE_OTA_DATA  'D'  // Node → Neighbors (coded firmware packet)
+#define MSG_TYPE_TIMESYNC  'E'  // HQ → All lamps (mesh time reference)
+#define MSG_TYPE_CTX_MISS  'F'  // Node → Neighbors (unknown compression context)
+#define MSG_TYPE_CODED     'G'  // Lamp → Neighbors (network-coded repair, ignored by HQ)
+#define MSG_TYPE_CONTACT   'H'  // Mobile HQ ↔ Lamps in range (bulk sync)
+#define MSG_TYPE_CAPS      'I'  // Node → Neighbors (supported framing)
 
 // Header lengths
 #define HEADER_LENGTH_INIT     9
+#define HEADER_LENGTH_INIT_ENERGY 10  // Relayed by a lamp, plus its energy class
 #define HEADER_LENGTH_STANDARD 13
+#define HEADER_LENGTH_TARGETED 16  // Type 2 with command ID and attempt
 #define HEADER_LENGTH_SOS      11
 #define HEADER_LENGTH_MESSAGE  15
+#define HEADER_LENGTH_SYNC     9   // Types 5, 6 base, plus 4 chars per hash
+#define HEADER_LENGTH_ACK      14  // Type 7 with command ID, attempt and hop
+#define HEADER_LENGTH_REPORT   15  // Type 8 with broadcast hash and hop
+#define COVERAGE_HEX_LENGTH    16  // Type 8 message: 64-bit bitmap in hex
+#define HEADER_LENGTH_CONGESTION 14  // Type 9 with id, level and duration
+#define HEADER_LENGTH_CONFIG   16  // [src][dst][A][hash(4)][delay s(3)]
+#define CONFIG_MESSAGE_LENGTH  18  // [ver(5)][gap ms(4)][interval s(3)][count(1)][K(1)][lifi s(4)]
+#define HEADER_LENGTH_OTA_ADV  35  // [src][dst][B][ver(2)][size(5)][have(3)][crc32(8)][tag(8)]
+#define HEADER_LENGTH_OTA_REQ  14  // [src][dst][C][ver(2)][page(3)]
+#define HEADER_LENGTH_OTA_DATA 16  // [src][dst][D][ver(2)][page(3)][mask(2)] + 32 hex
+#define HEADER_LENGTH_TIMESYNC 21  // [src][dst][E][seq(2)][hop(2)][millis(8 hex)]
+#define HEADER_LENGTH_CTX_MISS 11  // [src][dst][F][ctx(2)]
+#define HEADER_LENGTH_CODED    21  // [src][dst][G][hashA(4)][hashB(4)][lenA(2)][lenB(2)] + coded message
+#define HEADER_LENGTH_CONTACT  10  // [src][dst][H][n(1)] + 4 chars per hash or key
+#define HEADER_LENGTH_CAPS     11  // [src][dst][I][caps(2)]
+#define HEADER_LENGTH_SOS_V25  9   // v2.5 SOS, no hop (only noted, lamps bridge it)
+
+// SOS beacon: one raw NEC frame [0xA0 | seq][origin hi][origin lo][hop]
+// (must match the lamps' config.h); HQ turns it into a Type 3 header
+#define SOS_BEACON_ENABLED 1
+#define SOS_BEACON_MARKER  0xA0
+
+// Framing HQ understands, announced to its neighbors after every INIT
+// (bits as in the lamps' config.h)
+#define CAP_HC    0x01  // Compressed headers
+#define CAP_BURST 0x02  // Burst frames, 3 chars per frame
+#define HQ_CAPS ((HC_ENABLED ? CAP_HC : 0) | CAP_BURST)
+
+// Every downlink leaves through HQ's neighbors, so HQ compresses only
+// while each one heard lately announced CAP_HC (as lamps do, see caps.h);
+// one heard but never announced, or a v2.5 lamp, gets full headers
+#define CAPS_PEER_SIZE 6
+const unsigned long CAPS_PEER_HOLD = 660000;  // Lamps' 2 x (anti-entropy interval + jitter)
+
+struct CapsPeer {
+  String id;                // Neighbor node ID
+  uint8_t caps;             // Announced bits (0 = never announced)
+  unsigned long heardAt;    // Last heard, any one-hop packet
+  bool active;
+};
+
+extern CapsPeer capsPeers[CAPS_PEER_SIZE];
+extern unsigned long capsLegacyHeardAt;  // Last v2.5 packet (0 = never)
+
+// Airtime of one IR char per direction (NEC frame + gap, ~170ms); a
+// CONFIG's delay is restamped per direction for the header still to go
+const unsigned long IR_CHAR_AIRTIME = 170;
+
+// CONFIG limits the lamps accept (must match their GRADIENT_K_MAX; a
+// retransmit count of 0 would drop airtime-deferred Type 4 relays)
+#define CONFIG_K_MAX     3
+#define CONFIG_COUNT_MIN 1
+
+// Congestion control limits (level 0 clears, lamps cap at their own maximum)
+#define CONGESTION_MAX_LEVEL   3
+#define CONGESTION_MAX_MINUTES 99
+
+// ==================== TARGETED DELIVERY ====================
+
+/*
+ * Targeted messages (Type 2) carry a command ID and attempt number.
+ * The target lamp answers with a Type 7 ACK routed up the gradient.
+ * HQ retries only when no ACK arrives within TARGET_ACK_TIMEOUT.
+ *
+ * Delivery events are reported to the dashboard as:
+ *   CMD|<cmdID>|<event>|<nodeID>[|<detail>]
+ *   event = QUEUED, SENT, ACKED, TIMEOUT, RETRY, FAILED, REJECTED
+ */
+
+// Maximum number of targeted commands awaiting ACK
+#define PENDING_TARGET_SIZE 4
+
+// Time to wait for an ACK before retrying (3 minutes)
+// One hop of a 30-char message takes ~20-30s over 4 directions
+const unsigned long TARGET_ACK_TIMEOUT = 180000;
+
+// Total transmissions per command (first send + retries)
+#define TARGET_MAX_ATTEMPTS 3
+
+struct PendingTarget {
+  String nodeID;            // Target lamp
+  String message;           // Message content
+  uint8_t cmdID;            // Command ID (matched against ACK)
+  uint8_t attempt;          // Current attempt (1-based)
+  unsigned long sentTime;   // When the current attempt was sent
+  bool active;              // Is this slot in use?
+};
+
+extern PendingTarget pendingTargets[PENDING_TARGET_SIZE];
+extern uint8_t nextCmdID;
+
+// ==================== BROADCAST COVERAGE ====================
+
+/*
+ * Lamps merge coverage bitmaps (bit = lamp NODE_INDEX) for each broadcast
+ * on the way up the gradient. HQ merges the hop-1 reports and forwards the
+ * running total to the dashboard as:
+ *   COV|<hash>|<bitmap(16 hex)>
+ */
+
+// Number of recent broadcasts tracked for coverage
+#define COVERAGE_TRACK_SIZE 4
+
+struct BroadcastCoverage {
+  uint16_t msgHash;         // Broadcast hash
+  uint64_t coverage;        // Lamps confirmed to hold it
+  bool active;              // Is this slot in use?
+};
+
+extern BroadcastCoverage coverageTable[COVERAGE_TRACK_SIZE];
+extern int coverageIndex;
+
+// ==================== HEALTH TRAILER ====================
+
+/*
+ * Lamps piggyback health on upstream Type 4/8 packets:
+ *   <message>~<entry>...   entry = [nodeID(4)][battery 0-9][solar 0/1][errors hex][sync hex]
+ *                                  [K hex][parallel relays hex][progress 0-A]
+ *   sync = mesh time error within 2^(n+4) ms, F = unsynced
+ *   K, relays, progress = the lamp's adaptive gradient tolerance and what it sees
+ * HQ strips the trailer before hash checks and reports each entry as:
+ *   HEALTH|<nodeID>|<battery>|<solar>|<errors>|<sync>|<K>|<relays>|<progress>
+ */
+#define HEALTH_TRAILER_MARK   '~'
+#define HEALTH_ENTRY_LENGTH   11
+#define HEALTH_TRAILER_MAX    2
+
+// ==================== FIRMWARE DISSEMINATION ====================
+
+/*
+ * HQ seeds mesh firmware updates (see lamp ota.h). The image stays on the
+ * dashboard, which also tags it with MESH_KEY (lamps refuse an image whose
+ * tag does not verify); HQ asks for one page at a time when a lamp requests it:
+ *   Python -> HQ: OTA|<ver>|<size>|<crc32 hex>|<tag hex>   (OTA|0 stops)
+ *   HQ -> Python: OTAREQ|<page>
+ *   Python -> HQ: OTAPAGE|<page>|<256 hex>
+ */
+#define OTA_PACKET_BYTES   16
+#define OTA_PAGE_PACKETS   8
+#define OTA_PAGE_BYTES     (OTA_PACKET_BYTES * OTA_PAGE_PACKETS)
+#define OTA_REPAIR_PACKETS 3
+const unsigned long OTA_ADV_INTERVAL = 60000;
+
+struct OtaSeed {
+  uint8_t version;          // 0 = not seeding
+  uint32_t size;
+  uint32_t crc;
+  uint32_t tag;             // Dashboard's keyed tag over the image (lamps check it)
+  uint16_t pages;
+  uint8_t page[OTA_PAGE_BYTES];
+  int16_t loadedPage;       // Page held in buffer (-1 = none)
+  int16_t servePage;        // Page being served (-1 = none)
+  uint8_t serveSent;
+  unsigned long nextAdvTime;
+};
+
+extern OtaSeed otaSeed;
+
+// ==================== MESH TIME SYNC ====================
+
+// HQ's millis() is mesh time. Beacons go out after every INIT and
+// periodically; lamps fit offset and drift from them (see lamp timesync.h)
+const unsigned long TIMESYNC_INTERVAL = 600000;  // 10 minutes
+
+extern uint8_t timeSyncSeq;
+
+extern unsigned long configApplyAt;  // Epoch of the last CONFIG sent (millis)
+
+// ==================== HEADER COMPRESSION ====================
+
+// Neighbors send '#' + context ID + base check in place of a [src][dst][type]
+// they already sent in full (must match the lamps' config.h, see compress.h)
+#define HC_ENABLED 1
+#define HC_MARK    '#'   // Starts a compressed header (only looked for where a header is due)
+#define HC_CONTEXT_SIZE 6
+const unsigned long HC_REFRESH_INTERVAL = 120000;
+const unsigned long HC_CONTEXT_HOLD = 2 * HC_REFRESH_INTERVAL;
+const unsigned long HC_MISS_HOLDOFF = 5000;
+
+struct HcContext {
+  String base;              // [src][dst][type]
+  uint8_t id;               // Derived from base
+  unsigned long heardAt;
+  unsigned long sentFullAt; // 0 = not since a miss
+  bool ambiguous;
+  bool active;
+};
+
+struct HcStats {
+  unsigned long packets;
+  unsigned long chars;
+  unsigned long saved;
+  unsigned long misses;
+};
+
+extern HcContext hcContexts[HC_CONTEXT_SIZE];
+extern HcStats hcStats;
+extern int16_t hcMissPending;  // Context to report missing (-1 = none)
+extern unsigned long hcLastMiss;
+
+// ==================== MOBILE HQ CONTACT ====================
+
+/*
+ * A mobile HQ beacons the downlink it carries and the upstream packets it
+ * already has; lamps in range answer and stream their stored SOS / Type 4
+ * packets, then the vehicle serves the broadcasts they pulled. Contact
+ * packets go in burst frames, 3 chars per raw NEC frame:
+ *   [marker | check(4 bits)][c1][c2][c3]
+ * (must match the lamps' config.h, see lamp contact.h)
+ */
+#define CONTACT_BURST_MARKER 0xC0
+#define CONTACT_DOWN_MAX  3        // Downlink hashes in a beacon
+#define CONTACT_KEYS      2        // Upstream keys a beacon acknowledges
+
+// Directions facing the lamps from the road (bit 0 FRONT, 1 RIGHT, 2 BACK, 3 LEFT)
+#define CONTACT_DIR_MASK 0x0A
+
+const unsigned long CONTACT_BEACON_INTERVAL = 5000;
+const unsigned long CONTACT_UPLINK_WAIT = 4000;  // After a reply, for its packets to come in
+
+struct DownlinkEntry {
+  String header;
+  String message;
+  uint16_t msgHash;
+  bool active;
+};
+
+struct ContactState {
+  uint8_t pullMask;         // Downlink slots some lamp is missing
+  uint8_t expected;         // Announced upstream packets still to come
+  unsigned long serveAfter; // 0 = nothing to serve
+  unsigned long nextBeacon;
+  uint16_t keys[CONTACT_KEYS];  // Last upstream packets received
+  uint8_t keyIndex;
+};
+
+struct ContactStats {
+  unsigned long beacons;
+  unsigned long replies;
+  unsigned long packetsIn;
+  unsigned long served;
+  unsigned long chars;
+  unsigned long burstMs;
+};
+
+extern DownlinkEntry downlinkStore[CONTACT_DOWN_MAX];
+extern int downlinkIndex;
+extern ContactState contact;
+extern ContactStats contactStats;
+
+// ==================== SCHEDULER ====================
+
+// Timer/event task run from loop() (see sched.h)
+struct Task {
+  const char* name;
+  void (*fn)();
+  unsigned long period;             // ms (0 = event-only)
+  unsigned long nextRun;
+  volatile bool eventPending;
+  unsigned long runCount;
+  uint64_t totalMicros;
+  unsigned long maxMicros;
+};
+
+#define SCHED_MAX_TASKS      7
+#define SCHED_NO_TASK        255
+#define SCHED_MAX_SLEEP      1000
+#define SCHED_EVENT_PRIORITY 0x3FFFFFFFL
+
+extern Task tasks[SCHED_MAX_TASKS];
+extern uint8_t taskCount;
+extern volatile bool schedEventPosted;
+extern uint8_t txCompleteTask;
+
+extern unsigned long lplLastTxTime;  // End of our last transmission
 
 // ==================== CACHE ====================
 
@@ -0,0 +1,181 @@
+#ifndef CONTACT_H
+#define CONTACT_H
+
+#include <Arduino.h>
+#include <IRremote.h>
+#include "config.h"
+#include "lifi.h"
+
+// ==================== MOBILE HQ CONTACT ====================
+
+/*
+ * Bulk Sync with Lamps in Passing (Type H, HQ_MOBILE only)
+ * Summary first, one turn each way:
+ *   Beacon:  [NODE_ID][FFFF][H][n][n downlink hashes][upstream keys]
+ *   Reply:   [lamp][NODE_ID][H][count][hashes it is missing]
+ *            then `count` SOS / Type 4 packets back to back
+ * Once the announced packets are in (or CONTACT_UPLINK_WAIT runs out),
+ * every broadcast some lamp pulled is served once, for all of them.
+ * Lamps re-flood what they get to the part of the mesh behind them.
+ */
+
+/*
+ * Key of an Upstream Packet (same on the lamps)
+ * SOS by origin, Type 4 by origin and message hash
+ */
+inline uint16_t contactKey(String header){
+  String id = header.substring(0, 4) + header[8];
+  if(header[8] == MSG_TYPE_MESSAGE) id += header.substring(9, 13);
+  return simpleHash(id);
+}
+
+/*
+ * Carry a Broadcast for the Lamps Ahead
+ * Oldest entry is overwritten
+ */
+inline void downlinkStoreAdd(String header, String message, uint16_t hash){
+  if(!HQ_MOBILE) return;
+  DownlinkEntry &e = downlinkStore[downlinkIndex];
+  e.header = header;
+  e.message = message;
+  e.msgHash = hash;
+  e.active = true;
+  downlinkIndex = (downlinkIndex + 1) % CONTACT_DOWN_MAX;
+}
+
+/*
+ * Note an Upstream Packet Received (SOS / Type 4)
+ * Its key goes into the next beacon, so lamps stop offering it
+ */
+inline void contactNoteUplink(String header){
+  if(!HQ_MOBILE) return;
+  uint16_t key = contactKey(header);
+  for(int i = 0; i < CONTACT_KEYS; i++){
+    if(contact.keys[i] == key) return;
+  }
+  contact.keys[contact.keyIndex] = key;
+  contact.keyIndex = (contact.keyIndex + 1) % CONTACT_KEYS;
+
+  contactStats.packetsIn++;
+  if(contact.expected > 0 && --contact.expected == 0 && contact.serveAfter != 0){
+    contact.serveAfter = millis();  // All announced packets are in
+  }
+}
+
+/*
+ * Send a Contact Packet in Burst Frames toward the Lamps
+ * No wake preamble: lamps in range heard the beacon already
+ */
+inline void contactSend(String header, String message){
+  const int txPins[] = {IR_TX_FRONT, IR_TX_RIGHT, IR_TX_BACK, IR_TX_LEFT};
+  unsigned long start = millis();
+  IrReceiver.stop();
+
+  for(int i = 0; i < 4; i++){
+    if(!(CONTACT_DIR_MASK & (1 << i))) continue;
+
+    String headerWithDelim = header + " ";
+    irSendBurst(headerWithDelim.c_str(), txPins[i]);
+    contactStats.chars += headerWithDelim.length();
+
+    if(message.length() > 0){
+      delay(50);
+      String messageWithDelim = message + " ";
+      irSendBurst(messageWithDelim.c_str(), txPins[i]);
+      contactStats.chars += messageWithDelim.length();
+    }
+  }
+
+  contactStats.burstMs += millis() - start;
+  IrReceiver.start();
+  lplLastTxTime = millis();
+  schedNotifyTxComplete();
+}
+
+/*
+ * Handle a Lamp's Reply (Type H addressed to us)
+ */
+inline void processContactReply(String header){
+  String lamp = header.substring(0, 4);
+  uint8_t count = (uint8_t) strtol(header.substring(9, 10).c_str(), NULL, 16);
+  contactStats.replies++;
+
+  int pulled = 0;
+  for(unsigned int pos = HEADER_LENGTH_CONTACT; pos + 4 <= header.length(); pos += 4){
+    uint16_t hash = (uint16_t) strtol(header.substring(pos, pos + 4).c_str(), NULL, 16);
+    for(int i = 0; i < CONTACT_DOWN_MAX; i++){
+      if(downlinkStore[i].active && downlinkStore[i].msgHash == hash){
+        contact.pullMask |= (1 << i);
+        pulled++;
+      }
+    }
+  }
+
+  // Serve after this lamp's packets, and any other lamp's still coming
+  contact.expected += count;
+  unsigned long serveAt = millis() + (count > 0 ? CONTACT_UPLINK_WAIT : 0);
+  if(contact.serveAfter == 0 || (long)(serveAt - contact.serveAfter) > 0) contact.serveAfter = serveAt;
+
+  Serial.print(">>> CONTACT: ");
+  Serial.print(lamp);
+  Serial.print(" sends ");
+  Serial.print(count);
+  Serial.print(" upstream packet(s), pulls ");
+  Serial.print(pulled);
+  Serial.println(" broadcast(s)");
+}
+
+/*
+ * Beacon and Serve Pulled Broadcasts (scheduler task)
+ */
+inline void processContact(){
+  if(!HQ_MOBILE) return;
+
+  if(contact.serveAfter != 0){
+    if((long)(millis() - contact.serveAfter) < 0) return;  // Lamps still sending
+    contact.serveAfter = 0;
+    contact.expected = 0;
+
+    for(int i = 0; i < CONTACT_DOWN_MAX; i++){
+      if(!(contact.pullMask & (1 << i)) || !downlinkStore[i].active) continue;
+      contactSend(downlinkStore[i].header, downlinkStore[i].message);
+      contactStats.served++;
+    }
+    contact.pullMask = 0;
+    contact.nextBeacon = millis();
+    return;
+  }
+
+  if((long)(millis() - contact.nextBeacon) < 0) return;
+  contact.nextBeacon = millis() + CONTACT_BEACON_INTERVAL;
+
+  String down = "";
+  for(int j = 0; j < CONTACT_DOWN_MAX; j++){
+    DownlinkEntry &e = downlinkStore[(downlinkIndex + j) % CONTACT_DOWN_MAX];
+    if(!e.active) continue;
+    char hashStr[5];
+    sprintf(hashStr, "%04X", e.msgHash);
+    down += hashStr;
+  }
+
+  String keys = "";
+  for(int i = 0; i < CONTACT_KEYS; i++){
+    if(contact.keys[i] == 0) continue;
+    char keyStr[5];
+    sprintf(keyStr, "%04X", contact.keys[i]);
+    keys += keyStr;
+  }
+
+  char count[2];
+  sprintf(count, "%X", (int)(down.length() / 4));
+  contactSend(String(NODE_ID) + BROADCAST_ID + MSG_TYPE_CONTACT + count + down + keys, "");
+  contactStats.beacons++;
+
+  #if DEBUG_IR_TX
+    Serial.print(">>> CONTACT: Beacon, ");
+    Serial.print(contactStats.chars * 1000.0 / contactStats.burstMs, 1);
+    Serial.println(" chars/s in bursts");
+  #endif
+}
+
+#endif // CONTACT_H
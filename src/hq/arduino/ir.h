@@ -49,6 +49,52 @@ inline void irSendString(const char* str, int txPin) {
   }
 }
 
+// Wake preamble for duty-cycled lamps (one sleep interval + check window,
+// round-robin over all 4 directions)
+inline void irSendWakePreamble() {
+  #if LPL_ENABLED
+    const int txPins[] = {IR_TX_FRONT, IR_TX_RIGHT, IR_TX_BACK, IR_TX_LEFT};
+    if (lplLastTxTime != 0 && millis() - lplLastTxTime < LPL_PREAMBLE_SKIP) return;
+    unsigned long start = millis();
+    int frames = 0;
+    while (millis() - start < LPL_SLEEP_INTERVAL + LPL_LISTEN_WINDOW) {
+      IrSender.begin(txPins[frames % 4], ENABLE_LED_FEEDBACK);
+      IrSender.sendNEC(LPL_WAKE_ADDRESS, 0, 0);
+      frames++;
+      delay(10);
+    }
+  #endif
+}
+
+// Burst frames (mobile HQ contact): 3 chars per raw NEC frame, with a
+// 4-bit check in place of NEC's inverted bytes; unused chars are 0
+inline uint8_t irBurstCheck(uint8_t c1, uint8_t c2, uint8_t c3) {
+  uint8_t x = c1 ^ c2 ^ c3;
+  return (x ^ (x >> 4)) & 0x0F;
+}
+
+inline void irSendBurst(const char* str, int txPin) {
+  #if DEBUG_IR_TX
+    Serial.print(">>> IR TX: Burst on pin D");
+    Serial.print(txPin);
+    Serial.print(" - '");
+    Serial.print(str);
+    Serial.println("'");
+  #endif
+  
+  IrSender.begin(txPin, ENABLE_LED_FEEDBACK);
+  
+  while (*str) {
+    uint8_t c[3] = {0, 0, 0};
+    for (int i = 0; i < 3 && *str; i++) c[i] = *str++;
+    
+    uint32_t raw = (CONTACT_BURST_MARKER | irBurstCheck(c[0], c[1], c[2])) |
+                   ((uint32_t)c[0] << 8) | ((uint32_t)c[1] << 16) | ((uint32_t)c[2] << 24);
+    IrSender.sendNECRaw(raw, 0);
+    delay(100);
+  }
+}
+
 inline bool irReceiveString(String &receivedLine) {
   static String buffer = "";
   static unsigned long lastCharTime = 0;
@@ -62,7 +108,57 @@ inline bool irReceiveString(String &receivedLine) {
   }
   
   if (IrReceiver.decode()) {
-    if (IrReceiver.decodedIRData.protocol == NEC) {
+    // SOS beacon: a whole SOS in one frame, handed up as a Type 3 header
+    #if SOS_BEACON_ENABLED
+      uint32_t raw = IrReceiver.decodedIRData.decodedRawData;
+      if ((IrReceiver.decodedIRData.protocol == NEC || IrReceiver.decodedIRData.protocol == ONKYO) &&
+          (raw & 0xF0) == SOS_BEACON_MARKER) {
+        char sos[HEADER_LENGTH_SOS + 1];
+        sprintf(sos, "%02X%02X%s%c%02X", (uint8_t)(raw >> 8), (uint8_t)(raw >> 16),
+                HQ_ID, MSG_TYPE_SOS, (uint8_t)(raw >> 24));
+        receivedLine = String(sos);
+        
+        #if DEBUG_IR_RX
+          Serial.print(">>> IR RX: SOS beacon - '");
+          Serial.print(receivedLine);
+          Serial.println("'");
+        #endif
+        
+        IrReceiver.resume();
+        return true;
+      }
+    #endif
+    
+    // Burst frame: three chars at once; a garbled frame loses the segment
+    uint32_t burst = IrReceiver.decodedIRData.decodedRawData;
+    if ((IrReceiver.decodedIRData.protocol == NEC || IrReceiver.decodedIRData.protocol == ONKYO) &&
+        (burst & 0xF0) == CONTACT_BURST_MARKER) {
+      uint8_t c[3] = {(uint8_t)(burst >> 8), (uint8_t)(burst >> 16), (uint8_t)(burst >> 24)};
+      IrReceiver.resume();
+      
+      if ((burst & 0x0F) != irBurstCheck(c[0], c[1], c[2])) {
+        #if DEBUG_IR_RX
+          Serial.println(">>> IR RX: Burst frame check failed - segment dropped");
+        #endif
+        buffer = "";
+        return false;
+      }
+      
+      for (int i = 0; i < 3 && c[i] != 0; i++) {
+        if (c[i] == ' ') {
+          receivedLine = buffer;
+          buffer = "";
+          return true;
+        }
+        buffer += (char)c[i];
+      }
+      lastCharTime = millis();
+      return false;
+    }
+    
+    // Wake preamble frames from lamps carry no data
+    if (IrReceiver.decodedIRData.protocol == NEC &&
+        IrReceiver.decodedIRData.address != LPL_WAKE_ADDRESS) {
       char c = (char)IrReceiver.decodedIRData.command;
       
       #if DEBUG_IR_RX
@@ -4,6 +4,9 @@
 #include <Arduino.h>
 #include "config.h"
 #include "ir.h"
+#include "sched.h"
+#include "auth.h"
+#include "compress.h"
 
 // ==================== UTILITY FUNCTIONS ====================
 
@@ -15,6 +18,46 @@ inline uint16_t simpleHash(String s){
   return h;
 }
 
+/*
+ * Parse Hierarchical Address (see lamp lifi.h)
+ * Trailing ADDR_WILDCARD chars clear the matching nibbles of mask
+ */
+inline bool addrParse(String id, uint16_t &addr, uint16_t &mask){
+  if(id.length() != 4) return false;
+  addr = 0;
+  mask = 0;
+  bool wildcard = false;
+  for(int i = 0; i < 4; i++){
+    char c = id[i];
+    uint8_t nibble = 0;
+    if(c == ADDR_WILDCARD) wildcard = true;
+    else if(wildcard) return false;
+    else if(c >= '0' && c <= '9') nibble = c - '0';
+    else if(c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+    else if(c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+    else return false;
+    addr = (addr << 4) | nibble;
+    mask = (mask << 4) | (wildcard ? 0x0 : 0xF);
+  }
+  return true;
+}
+
+inline bool addrIsGroup(String id){
+  return id.indexOf(ADDR_WILDCARD) >= 0;
+}
+
+/*
+ * Hash Field for an HQ-Originated Packet
+ * Keyed tag with MESH_AUTH, so lamps can reject forged HQ traffic
+ */
+inline uint16_t hqPacketTag(String dst, char type, String message){
+  #if MESH_AUTH
+    return authTag(String(NODE_ID) + dst + type, message);
+  #else
+    return simpleHash(message);
+  #endif
+}
+
 inline bool isNew(String src, uint16_t hash){
   #if DEBUG_CACHE
     Serial.print(">>> CACHE: Checking (src='");
@@ -44,29 +87,191 @@ inline bool isNew(String src, uint16_t hash){
   return true;
 }
 
+/*
+ * Format/Parse 64-bit Coverage Bitmap as 16 Hex Chars
+ */
+inline String coverageToHex(uint64_t coverage){
+  char hexStr[COVERAGE_HEX_LENGTH + 1];
+  sprintf(hexStr, "%08lX%08lX", (unsigned long)(coverage >> 32), (unsigned long)(coverage & 0xFFFFFFFF));
+  return String(hexStr);
+}
+
+inline bool coverageFromHex(String hexStr, uint64_t &coverage){
+  if(hexStr.length() != COVERAGE_HEX_LENGTH) return false;
+  
+  coverage = 0;
+  for(int i = 0; i < COVERAGE_HEX_LENGTH; i++){
+    char c = hexStr[i];
+    uint8_t nibble;
+    if(c >= '0' && c <= '9') nibble = c - '0';
+    else if(c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+    else if(c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+    else return false;
+    coverage = (coverage << 4) | nibble;
+  }
+  return true;
+}
+
+/*
+ * Strip Health Trailer and Report Entries to Python
+ * Leaves message untouched if it carries no well-formed trailer
+ */
+inline void extractHealthTrailer(String &message){
+  int mark = message.lastIndexOf(HEALTH_TRAILER_MARK);
+  if(mark < 0) return;
+  
+  String trailer = message.substring(mark + 1);
+  if(trailer.length() == 0 || trailer.length() % HEALTH_ENTRY_LENGTH != 0 ||
+     trailer.length() > HEALTH_ENTRY_LENGTH * HEALTH_TRAILER_MAX){
+    return;
+  }
+  
+  message = message.substring(0, mark);
+  
+  for(unsigned int pos = 0; pos < trailer.length(); pos += HEALTH_ENTRY_LENGTH){
+    Serial.print("HEALTH|");
+    Serial.print(trailer.substring(pos, pos + 4));
+    Serial.print("|");
+    Serial.print(trailer[pos + 4]);
+    Serial.print("|");
+    Serial.print(trailer[pos + 5]);
+    Serial.print("|");
+    Serial.print(trailer[pos + 6]);
+    Serial.print("|");
+    Serial.print(trailer[pos + 7]);
+    Serial.print("|");
+    Serial.print(trailer[pos + 8]);
+    Serial.print("|");
+    Serial.print(trailer[pos + 9]);
+    Serial.print("|");
+    Serial.println(trailer[pos + 10]);
+  }
+}
+
 // ==================== IR COMMUNICATION ====================
 
-inline void irSendRaw(String header, String message = ""){
+inline void irSendRaw(String header, String message = "");
+
+// Mobile HQ contact (defined in contact.h)
+inline void downlinkStoreAdd(String header, String message, uint16_t hash);
+inline void contactNoteUplink(String header);
+inline void processContactReply(String header);
+
+/*
+ * Send a Pending CTX_MISS (scheduler task)
+ */
+inline void processHcMiss(){
+  if(hcMissPending < 0) return;
+  if(millis() - hcLastMiss < HC_MISS_HOLDOFF) return;
+
+  char ctx[3];
+  sprintf(ctx, "%02X", (uint8_t)hcMissPending);
+  hcMissPending = -1;
+  hcLastMiss = millis();
+
+  irSendRaw(String(NODE_ID) + BROADCAST_ID + MSG_TYPE_CTX_MISS + ctx);
+}
+
+// ==================== CAPABILITY NEGOTIATION ====================
+
+/*
+ * Note a Neighbor Heard (one-hop packets only, as in lamp caps.h)
+ * A CAPS announcement also records what it supports
+ */
+inline void capsNotePeer(String header){
+  if(header.length() < 9) return;
+  char type = header[8];
+  if(type != MSG_TYPE_CAPS && type != MSG_TYPE_DIGEST && type != MSG_TYPE_PULL &&
+     type != MSG_TYPE_OTA_ADV && type != MSG_TYPE_OTA_REQ && type != MSG_TYPE_OTA_DATA &&
+     type != MSG_TYPE_CTX_MISS && type != MSG_TYPE_CODED) return;
+
+  String id = header.substring(0, 4);
+  int slot = -1;
+  for(int i = 0; i < CAPS_PEER_SIZE && slot < 0; i++){
+    if(capsPeers[i].active && capsPeers[i].id == id) slot = i;
+  }
+  if(slot < 0){
+    slot = 0;
+    for(int i = 0; i < CAPS_PEER_SIZE; i++){
+      if(!capsPeers[i].active){
+        slot = i;
+        break;
+      }
+      if((long)(capsPeers[i].heardAt - capsPeers[slot].heardAt) < 0) slot = i;
+    }
+    capsPeers[slot].id = id;
+    capsPeers[slot].caps = 0;
+    capsPeers[slot].active = true;
+  }
+  capsPeers[slot].heardAt = millis();
+
+  if(type == MSG_TYPE_CAPS && header.length() == HEADER_LENGTH_CAPS){
+    capsPeers[slot].caps = (uint8_t) strtol(header.substring(9, 11).c_str(), NULL, 16);
+  }
+}
+
+/*
+ * Does Every Neighbor Heard Lately Support a Feature
+ * False if HQ lacks it, with no neighbors known, and while a v2.5 lamp
+ * is within earshot
+ */
+inline bool capsLinkAllows(uint8_t cap){
+  if(!(HQ_CAPS & cap)) return false;
+  if(capsLegacyHeardAt != 0 && millis() - capsLegacyHeardAt < CAPS_PEER_HOLD) return false;
+
+  bool any = false;
+  for(int i = 0; i < CAPS_PEER_SIZE; i++){
+    CapsPeer &p = capsPeers[i];
+    if(!p.active || millis() - p.heardAt >= CAPS_PEER_HOLD) continue;
+    if(!(p.caps & cap)) return false;
+    any = true;
+  }
+  return any;
+}
+
+inline void irSendRaw(String header, String message){
   const int txPins[] = {IR_TX_FRONT, IR_TX_RIGHT, IR_TX_BACK, IR_TX_LEFT};
   const char* dirNames[] = {"FRONT", "RIGHT", "BACK", "LEFT"};
   
   Serial.println("╔════════════════════════════════════╗");
   Serial.println("║   IR TX (4 DIRECTIONS)             ║");
   Serial.println("╚════════════════════════════════════╝");
+  String onAirHeader = capsLinkAllows(CAP_HC) ? hcCompress(header) : header;
   Serial.print("Header: ");
-  Serial.println(header);
+  Serial.print(header);
+  if(onAirHeader != header){
+    Serial.print(" (sent as ");
+    Serial.print(onAirHeader);
+    Serial.print(")");
+  }
+  Serial.println();
   if(message.length() > 0){
     Serial.print("Message: ");
     Serial.println(message);
   }
   
   IrReceiver.stop();
+  irSendWakePreamble();
   
   for(int i = 0; i < 4; i++){
     Serial.print("Direction: ");
     Serial.println(dirNames[i]);
     
-    String headerWithDelim = header + " ";
+    // Time beacons carry HQ's clock at the start of each direction
+    String headerWithDelim = onAirHeader + " ";
+    if(header[8] == MSG_TYPE_TIMESYNC){
+      char timeStr[9];
+      sprintf(timeStr, "%08lX", millis());
+      headerWithDelim = header.substring(0, HEADER_LENGTH_TIMESYNC - 8) + String(timeStr) + " ";
+    }
+    
+    // CONFIG carries the delay left once this direction's header is out
+    if(header[8] == MSG_TYPE_CONFIG){
+      long left = (long)(configApplyAt - millis() - headerWithDelim.length() * IR_CHAR_AIRTIME);
+      char delayStr[4];
+      sprintf(delayStr, "%03ld", min(left > 0 ? (left + 500) / 1000 : 0L, 999L));
+      headerWithDelim = onAirHeader.substring(0, onAirHeader.length() - 3) + String(delayStr) + " ";
+    }
     irSendString(headerWithDelim.c_str(), txPins[i]);
     
     if(message.length() > 0){
@@ -79,7 +284,9 @@ inline void irSendRaw(String header, String message = ""){
   }
   
   IrReceiver.start();
+  lplLastTxTime = millis();
   Serial.println("════════════════════════════════════\n");
+  schedNotifyTxComplete();
 }
 
 inline bool irReceive(String &header, String &message){
@@ -91,15 +298,40 @@ inline bool irReceive(String &header, String &message){
   if(irReceiveString(line)){
     line.trim();
     
-    // INIT (9 chars)
-    if(line.length() == HEADER_LENGTH_INIT && line[8] == MSG_TYPE_INIT){
+    // Compressed header: expand from the neighbor-shared context, only where
+    // a header is expected (a message segment may well start with '#')
+    if(!waitingForMessage && hcIsCompressed(line) && !hcExpand(line)){
+      hcReportMiss(line);
+      
+      // Swallow the message segment that belongs to the dropped header
+      unsigned int fullLength = line.length() - 4 + 9;
+      if(fullLength == HEADER_LENGTH_STANDARD || fullLength == HEADER_LENGTH_MESSAGE ||
+         fullLength == HEADER_LENGTH_TARGETED || fullLength == HEADER_LENGTH_CODED){
+        receivedHeader = "";
+        waitingForMessage = true;
+        headerReceivedTime = millis();
+      }
+      return false;
+    }
+    
+    // Message segment of a pending header, whatever it looks like
+    // (header-only shapes are only matched between packets)
+    if(waitingForMessage){
+      header = receivedHeader;
+      message = line;
+      waitingForMessage = false;
+      receivedHeader = "";
+      if(header.length() == 0) return false;  // Its header was a context miss
+      Serial.println("RX: Message received");
+      return true;
+    }
+    
+    // INIT (9 chars, 10 when relayed by a lamp)
+    if((line.length() == HEADER_LENGTH_INIT || line.length() == HEADER_LENGTH_INIT_ENERGY) &&
+       line[8] == MSG_TYPE_INIT){
       header = line;
       message = "";
       Serial.println("RX: INIT packet");
-      if(waitingForMessage){
-        waitingForMessage = false;
-        receivedHeader = "";
-      }
       return true;
     }
     
@@ -108,30 +340,76 @@ inline bool irReceive(String &header, String &message){
       header = line;
       message = "";
       Serial.println("RX: SOS packet");
-      if(waitingForMessage){
-        waitingForMessage = false;
-        receivedHeader = "";
-      }
       return true;
     }
     
-    // Two-segment messages
-    if(!waitingForMessage){
-      if(line.length() == HEADER_LENGTH_STANDARD || line.length() == HEADER_LENGTH_MESSAGE){
-        receivedHeader = line;
-        waitingForMessage = true;
-        headerReceivedTime = millis();
-        Serial.println("RX: Header received");
-      }
+    // ACK (14 chars)
+    if(line.length() == HEADER_LENGTH_ACK && line[8] == MSG_TYPE_ACK){
+      header = line;
+      message = "";
+      Serial.println("RX: ACK packet");
+      return true;
+    }
+    
+    // OTA_REQ (14 chars) - may be addressed to HQ
+    if(line.length() == HEADER_LENGTH_OTA_REQ && line[8] == MSG_TYPE_OTA_REQ){
+      header = line;
+      message = "";
+      return true;
+    }
+    
+    // OTA_ADV (35 chars) - lamp-to-lamp, header-only
+    if(line.length() == HEADER_LENGTH_OTA_ADV && line[8] == MSG_TYPE_OTA_ADV){
+      capsNotePeer(line);
       return false;
-    } else {
-      header = receivedHeader;
-      message = line;
-      waitingForMessage = false;
-      receivedHeader = "";
-      Serial.println("RX: Message received");
+    }
+    
+    // CAPS (11 chars) - framing announcement, header-only
+    if(line.length() == HEADER_LENGTH_CAPS && line[8] == MSG_TYPE_CAPS){
+      capsNotePeer(line);
+      return false;
+    }
+    
+    // CTX_MISS (11 chars) - a neighbor lost one of our contexts
+    if(line.length() == HEADER_LENGTH_CTX_MISS && line[8] == MSG_TYPE_CTX_MISS){
+      header = line;
+      message = "";
+      return true;
+    }
+    
+    // CONTACT (10 + 4n chars) - beacons from another vehicle, replies to us
+    if(line.length() >= HEADER_LENGTH_CONTACT && (line.length() - HEADER_LENGTH_CONTACT) % 4 == 0 &&
+       line[8] == MSG_TYPE_CONTACT){
+      header = line;
+      message = "";
       return true;
     }
+    
+    // DIGEST/PULL (9 + 4n chars) - lamp-to-lamp sync, header-only
+    if(line.length() >= HEADER_LENGTH_SYNC && (line.length() - HEADER_LENGTH_SYNC) % 4 == 0 &&
+       (line[8] == MSG_TYPE_DIGEST || line[8] == MSG_TYPE_PULL)){
+      capsNotePeer(line);
+      return false;  // Not for HQ, but must not be taken for a header
+    }
+    
+    // v2.5 SOS (9 chars) - a legacy lamp is next to HQ (its v3 neighbors bridge it)
+    if(line.length() == HEADER_LENGTH_SOS_V25 && line[8] == MSG_TYPE_SOS){
+      capsLegacyHeardAt = millis();
+      return false;
+    }
+    
+    // Two-segment messages: header
+    // v2.5 Type 4 (13 chars, no hop) - a legacy lamp is next to HQ
+    if(line.length() == HEADER_LENGTH_STANDARD && line[8] == MSG_TYPE_MESSAGE) capsLegacyHeardAt = millis();
+    if(line.length() == HEADER_LENGTH_STANDARD || line.length() == HEADER_LENGTH_MESSAGE ||
+       line.length() == HEADER_LENGTH_TARGETED ||
+       (line.length() == HEADER_LENGTH_CODED && line[8] == MSG_TYPE_CODED)){  // Read past its message
+      receivedHeader = line;
+      waitingForMessage = true;
+      headerReceivedTime = millis();
+      Serial.println("RX: Header received");
+    }
+    return false;
   }
   
   // Timeout check
@@ -152,7 +430,7 @@ inline bool irReceive(String &header, String &message){
  */
 inline void sendInit(String initID){
   char hopStr[3];
-  sprintf(hopStr, "%02d", HQ_HOP);  // HQ is always hop 0
+  sprintf(hopStr, "%02X", HQ_HOP);  // HQ is always hop 0
   
   String header = String(NODE_ID) + initID + String(hopStr) + MSG_TYPE_INIT;
   
@@ -170,13 +448,18 @@ inline void sendInit(String initID){
   LED_OFF();
   
   Serial.println("✓ INIT transmitted\n");
+  
+  // Neighbors pick their framing toward us from this
+  char capsStr[3];
+  sprintf(capsStr, "%02X", HQ_CAPS);
+  irSendRaw(String(NODE_ID) + BROADCAST_ID + MSG_TYPE_CAPS + capsStr);
 }
 
 /*
  * Send Broadcast Message (Type 1)
  */
 inline void sendBroadcast(String message){
-  uint16_t hash = simpleHash(message);
+  uint16_t hash = hqPacketTag(BROADCAST_ID, MSG_TYPE_BROADCAST, message);
   char hashStr[5];
   sprintf(hashStr, "%04X", hash);
   
@@ -189,40 +472,298 @@ inline void sendBroadcast(String message){
   Serial.print("Header: "); Serial.println(header);
   
   isNew(NODE_ID, hash);
+  downlinkStoreAdd(header, message, hash);  // Mobile HQ carries it to lamps it passes
+  
+  // Start coverage tracking (oldest slot is reused)
+  coverageTable[coverageIndex].msgHash = hash;
+  coverageTable[coverageIndex].coverage = 0;
+  coverageTable[coverageIndex].active = true;
+  coverageIndex = (coverageIndex + 1) % COVERAGE_TRACK_SIZE;
   
   LED_ON();
   irSendRaw(header, message);
   LED_OFF();
   
   Serial.println("✓ Broadcast transmitted\n");
+  
+  Serial.print("COV|");
+  Serial.print(hashStr);
+  Serial.print("|");
+  Serial.println(coverageToHex(0));
 }
 
 /*
- * Send Targeted Message (Type 2)
+ * Send Targeted Attempt (Type 2)
+ * Header: [src(4)][dst(4)][type(1)][hash(4)][cmd(2)][try(1)]
+ * Command ID + attempt keep retries distinct in relay caches
  */
-inline void sendTargeted(String nodeID, String message){
-  uint16_t hash = simpleHash(message);
+inline void transmitTargeted(PendingTarget &entry){
+  uint16_t hash = hqPacketTag(entry.nodeID, MSG_TYPE_TARGETED, entry.message);
   char hashStr[5];
   sprintf(hashStr, "%04X", hash);
+  char cmdStr[4];
+  sprintf(cmdStr, "%02X%d", entry.cmdID, entry.attempt);
   
-  String header = String(NODE_ID) + nodeID + MSG_TYPE_TARGETED + String(hashStr);
+  String header = String(NODE_ID) + entry.nodeID + MSG_TYPE_TARGETED + String(hashStr) + String(cmdStr);
   
   Serial.println("\n╔════════════════════════════════════╗");
   Serial.println("║   SENDING TARGETED MESSAGE         ║");
   Serial.println("╚════════════════════════════════════╝");
-  Serial.print("To: "); Serial.println(nodeID);
-  Serial.print("Message: "); Serial.println(message);
+  Serial.print("To: "); Serial.println(entry.nodeID);
+  Serial.print("Message: "); Serial.println(entry.message);
   Serial.print("Header: "); Serial.println(header);
+  Serial.print("Attempt: "); Serial.print(entry.attempt);
+  Serial.print("/"); Serial.println(TARGET_MAX_ATTEMPTS);
   
-  isNew(NODE_ID, hash);
+  isNew(String(NODE_ID) + cmdStr, hash);
   
   LED_ON();
-  irSendRaw(header, message);
+  irSendRaw(header, entry.message);
   LED_OFF();
   
+  entry.sentTime = millis();
+  
   Serial.println("✓ Targeted message transmitted\n");
 }
 
+/*
+ * Report Delivery Event to Python
+ * Format: CMD|<cmdID>|<event>|<nodeID>[|<detail>]
+ */
+inline void reportDelivery(uint8_t cmdID, const char* event, String nodeID, String detail = ""){
+  char cmdStr[3];
+  sprintf(cmdStr, "%02X", cmdID);
+  
+  Serial.print("CMD|");
+  Serial.print(cmdStr);
+  Serial.print("|");
+  Serial.print(event);
+  Serial.print("|");
+  Serial.print(nodeID);
+  if(detail.length() > 0){
+    Serial.print("|");
+    Serial.print(detail);
+  }
+  Serial.println();
+}
+
+/*
+ * Send Targeted Message (Type 2)
+ * Registers the command for ACK tracking, then sends the first attempt
+ * nodeID may be a lamp address or a district / street prefix ("10**")
+ */
+inline void sendTargeted(String nodeID, String message){
+  for(int i = 0; i < PENDING_TARGET_SIZE; i++){
+    if(!pendingTargets[i].active){
+      PendingTarget &entry = pendingTargets[i];
+      entry.nodeID = nodeID;
+      entry.message = message;
+      entry.cmdID = nextCmdID++;
+      entry.attempt = 1;
+      entry.active = true;
+      
+      reportDelivery(entry.cmdID, "QUEUED", nodeID);
+      transmitTargeted(entry);
+      reportDelivery(entry.cmdID, "SENT", nodeID, String(entry.attempt));
+      
+      // District / street targets are best-effort (lamps don't ACK them)
+      if(addrIsGroup(nodeID)) entry.active = false;
+      return;
+    }
+  }
+  
+  Serial.println("ERROR: Delivery queue full");
+  Serial.print("CMD|--|REJECTED|");
+  Serial.println(nodeID);
+}
+
+/*
+ * Process Pending Targeted Commands
+ * Called every loop iteration; retries commands whose ACK timed out
+ */
+inline void processPendingTargets(){
+  unsigned long now = millis();
+  
+  for(int i = 0; i < PENDING_TARGET_SIZE; i++){
+    PendingTarget &entry = pendingTargets[i];
+    if(!entry.active || now - entry.sentTime < TARGET_ACK_TIMEOUT) continue;
+    
+    reportDelivery(entry.cmdID, "TIMEOUT", entry.nodeID, String(entry.attempt));
+    
+    if(entry.attempt >= TARGET_MAX_ATTEMPTS){
+      reportDelivery(entry.cmdID, "FAILED", entry.nodeID);
+      entry.active = false;
+      continue;
+    }
+    
+    entry.attempt++;
+    
+    #if DEBUG_DELIVERY
+      Serial.print(">>> DELIVERY: No ACK, retrying command ");
+      Serial.println(entry.cmdID, HEX);
+    #endif
+    
+    transmitTargeted(entry);
+    reportDelivery(entry.cmdID, "RETRY", entry.nodeID, String(entry.attempt));
+  }
+}
+
+/*
+ * Send Congestion Control (Type 9)
+ * Floods backpressure: lamps throttle non-critical traffic for <minutes>
+ * Header: [src(4)][dst(4)][type(1)][id(2)][level(1)][minutes(2)]
+ */
+inline void sendCongestion(uint8_t level, uint8_t minutes){
+  static uint8_t congestionID = 0;
+  
+  char fieldStr[6];
+  sprintf(fieldStr, "%02X%d%02d", congestionID++, level, minutes);
+  
+  String header = String(NODE_ID) + BROADCAST_ID + MSG_TYPE_CONGESTION + String(fieldStr);
+  
+  Serial.println("\n╔════════════════════════════════════╗");
+  Serial.println("║   SENDING CONGESTION CONTROL       ║");
+  Serial.println("╚════════════════════════════════════╝");
+  Serial.print("Level: "); Serial.println(level);
+  Serial.print("Duration: "); Serial.print(minutes); Serial.println(" min");
+  Serial.print("Header: "); Serial.println(header);
+  
+  LED_ON();
+  irSendRaw(header);
+  LED_OFF();
+  
+  Serial.println("✓ Congestion control transmitted\n");
+}
+
+/*
+ * Send CONFIG (Type A)
+ * Floods a runtime parameter block; lamps apply it <delaySec> from now
+ * Message: [ver(5)][gap ms(4)][interval s(3)][count(1)][K(1)][lifi s(4)]
+ */
+inline void sendConfig(uint16_t delaySec, String block){
+  uint16_t hash = hqPacketTag(BROADCAST_ID, MSG_TYPE_CONFIG, block);
+  char fieldStr[8];
+  sprintf(fieldStr, "%04X%03d", hash, delaySec);
+  
+  String header = String(NODE_ID) + BROADCAST_ID + MSG_TYPE_CONFIG + String(fieldStr);
+  configApplyAt = millis() + delaySec * 1000UL;  // Delay is restamped per direction
+  
+  Serial.println("\n╔════════════════════════════════════╗");
+  Serial.println("║   SENDING CONFIG                   ║");
+  Serial.println("╚════════════════════════════════════╝");
+  Serial.print("Block: "); Serial.println(block);
+  Serial.print("Apply in: "); Serial.print(delaySec); Serial.println("s");
+  Serial.print("Header: "); Serial.println(header);
+  
+  LED_ON();
+  irSendRaw(header, block);
+  LED_OFF();
+  
+  Serial.println("✓ Config transmitted\n");
+}
+
+/*
+ * Send Time Sync Beacon (Type E)
+ * Stamp is filled in by irSendRaw per direction
+ */
+inline void sendTimeSync(){
+  char fieldStr[5];
+  sprintf(fieldStr, "%02X%02X", timeSyncSeq, HQ_HOP);
+  String header = String(NODE_ID) + BROADCAST_ID + MSG_TYPE_TIMESYNC + String(fieldStr) + "00000000";
+  timeSyncSeq++;
+  
+  irSendRaw(header);
+}
+
+/*
+ * Start / Stop Seeding a Firmware Image
+ */
+inline void startOtaSeed(uint8_t version, uint32_t size, uint32_t crc, uint32_t tag){
+  otaSeed.version = version;
+  otaSeed.size = size;
+  otaSeed.crc = crc;
+  otaSeed.tag = tag;
+  otaSeed.pages = (size + OTA_PAGE_BYTES - 1) / OTA_PAGE_BYTES;
+  otaSeed.loadedPage = -1;
+  otaSeed.servePage = -1;
+  otaSeed.nextAdvTime = millis();
+  
+  Serial.print(">>> OTA: Seeding v"); Serial.print(version);
+  Serial.print(", "); Serial.print(otaSeed.pages); Serial.println(" pages");
+}
+
+/*
+ * Page Data from Python
+ * Serves it right away if a lamp is waiting for it
+ */
+inline bool loadOtaPage(uint16_t page, String hexStr){
+  if(otaSeed.version == 0 || page >= otaSeed.pages || hexStr.length() != OTA_PAGE_BYTES * 2) return false;
+  
+  for(int i = 0; i < OTA_PAGE_BYTES; i++){
+    char byteStr[3] = {hexStr[i * 2], hexStr[i * 2 + 1], 0};
+    otaSeed.page[i] = (uint8_t) strtol(byteStr, NULL, 16);
+  }
+  otaSeed.loadedPage = page;
+  otaSeed.servePage = page;
+  otaSeed.serveSent = 0;
+  return true;
+}
+
+/*
+ * Page Request from a Lamp (Type C)
+ */
+inline void processOtaReq(String header){
+  uint8_t version = strtol(header.substring(9, 11).c_str(), NULL, 16);
+  uint16_t page = strtol(header.substring(11, 14).c_str(), NULL, 16);
+  
+  if(version != otaSeed.version || page >= otaSeed.pages) return;
+  if(otaSeed.servePage >= 0) return;  // Busy; the lamp asks again later
+  
+  if(otaSeed.loadedPage == page){
+    otaSeed.servePage = page;
+    otaSeed.serveSent = 0;
+  } else {
+    Serial.print("OTAREQ|");
+    Serial.println(page);
+  }
+}
+
+/*
+ * Firmware Seeding Task
+ * One coded packet per run (systematic first, then random repair combos)
+ */
+inline void processOtaSeed(){
+  if(otaSeed.version == 0) return;
+  
+  if(otaSeed.servePage >= 0){
+    uint8_t mask = (otaSeed.serveSent < OTA_PAGE_PACKETS) ? (1 << otaSeed.serveSent) : (uint8_t) random(1, 256);
+    
+    char data[OTA_PACKET_BYTES * 2 + 1];
+    for(int b = 0; b < OTA_PACKET_BYTES; b++){
+      uint8_t coded = 0;
+      for(int i = 0; i < OTA_PAGE_PACKETS; i++){
+        if(mask & (1 << i)) coded ^= otaSeed.page[i * OTA_PACKET_BYTES + b];
+      }
+      sprintf(data + b * 2, "%02X", coded);
+    }
+    
+    char fieldStr[8];
+    sprintf(fieldStr, "%02X%03X%02X", otaSeed.version, otaSeed.servePage, mask);
+    irSendRaw(String(NODE_ID) + BROADCAST_ID + MSG_TYPE_OTA_DATA + String(fieldStr), String(data));
+    
+    if(++otaSeed.serveSent >= OTA_PAGE_PACKETS + OTA_REPAIR_PACKETS) otaSeed.servePage = -1;
+    return;
+  }
+  
+  if((long)(millis() - otaSeed.nextAdvTime) >= 0){
+    char fieldStr[27];
+    sprintf(fieldStr, "%02X%05lX%03X%08lX%08lX", otaSeed.version, (unsigned long)otaSeed.size,
+            otaSeed.pages, (unsigned long)otaSeed.crc, (unsigned long)otaSeed.tag);
+    irSendRaw(String(NODE_ID) + BROADCAST_ID + MSG_TYPE_OTA_ADV + String(fieldStr));
+    otaSeed.nextAdvTime = millis() + OTA_ADV_INTERVAL;
+  }
+}
+
 /*
  * Send Message (Type 4)
  */
@@ -232,7 +773,7 @@ inline void sendMessage(String nodeID, String message){
   sprintf(hashStr, "%04X", hash);
   
   char hopStr[3];
-  sprintf(hopStr, "%02d", HQ_HOP);
+  sprintf(hopStr, "%02X", HQ_HOP);
   
   String header = String(NODE_ID) + nodeID + MSG_TYPE_MESSAGE + String(hashStr) + String(hopStr);
   
@@ -262,10 +803,21 @@ inline void processPacket(String header, String message){
   String dst = header.substring(4, 8);
   char type = header[8];
   
+  // Every header heard feeds the compression contexts
+  hcLearn(header);
+  capsNotePeer(header);
+  
+  // === Type F: CTX_MISS ===
+  if(type == MSG_TYPE_CTX_MISS && header.length() == HEADER_LENGTH_CTX_MISS){
+    hcProcessMiss(header);
+    return;
+  }
+  
   // === Type 3: SOS ===
   if(type == MSG_TYPE_SOS && header.length() == HEADER_LENGTH_SOS){
     String hopStr = header.substring(9, 11);
-    uint8_t msgHop = hopStr.toInt();
+    uint8_t msgHop = (uint8_t) strtol(hopStr.c_str(), NULL, 16);
+    contactNoteUplink(header);
     
     if(isNew(src, 0)){  // Deduplicate SOS
       Serial.println("\n╔════════════════════════════════════╗");
@@ -290,13 +842,16 @@ inline void processPacket(String header, String message){
     String hashStr = header.substring(9, 13);
     String hopStr = header.substring(13, 15);
     uint16_t receivedHash = (uint16_t) strtol(hashStr.c_str(), NULL, 16);
-    uint8_t msgHop = hopStr.toInt();
+    uint8_t msgHop = (uint8_t) strtol(hopStr.c_str(), NULL, 16);
+    
+    extractHealthTrailer(message);  // Trailer is outside the hash
     
     uint16_t computedHash = simpleHash(message);
     if(computedHash != receivedHash){
       Serial.println(">>> ERROR: Hash mismatch");
       return;
     }
+    contactNoteUplink(header);
     
     if(isNew(src, receivedHash)){
       Serial.println("\n╔════════════════════════════════════╗");
@@ -317,7 +872,87 @@ inline void processPacket(String header, String message){
     return;
   }
   
-  // HQ doesn't process Type 0, 1, 2 (those are HQ → Lamps)
+  // === Type 7: ACK ===
+  if(type == MSG_TYPE_ACK && header.length() == HEADER_LENGTH_ACK){
+    String cmdTry = header.substring(9, 12);
+    uint8_t cmdID = (uint8_t) strtol(cmdTry.substring(0, 2).c_str(), NULL, 16);
+    uint16_t ackKey = 0xA000 | (uint16_t) strtol(cmdTry.c_str(), NULL, 16);
+    
+    if(!isNew(src, ackKey)) return;  // Same ACK via another path
+    
+    for(int i = 0; i < PENDING_TARGET_SIZE; i++){
+      if(pendingTargets[i].active && pendingTargets[i].cmdID == cmdID &&
+         pendingTargets[i].nodeID == src){
+        #if DEBUG_DELIVERY
+          Serial.print(">>> DELIVERY: ACK from ");
+          Serial.print(src);
+          Serial.print(" for command ");
+          Serial.println(cmdID, HEX);
+        #endif
+        
+        reportDelivery(cmdID, "ACKED", src, cmdTry.substring(2));
+        pendingTargets[i].active = false;
+        return;
+      }
+    }
+    
+    #if DEBUG_DELIVERY
+      Serial.println(">>> DELIVERY: ACK for unknown or finished command");
+    #endif
+    return;
+  }
+  
+  // === Type 8: REPORT ===
+  if(type == MSG_TYPE_REPORT && header.length() == HEADER_LENGTH_REPORT){
+    String hashStr = header.substring(9, 13);
+    uint16_t hash = (uint16_t) strtol(hashStr.c_str(), NULL, 16);
+    uint64_t coverage;
+    
+    extractHealthTrailer(message);
+    
+    if(!coverageFromHex(message, coverage)){
+      Serial.println(">>> ERROR: Malformed coverage report");
+      return;
+    }
+    
+    for(int i = 0; i < COVERAGE_TRACK_SIZE; i++){
+      if(coverageTable[i].active && coverageTable[i].msgHash == hash){
+        uint64_t added = coverage & ~coverageTable[i].coverage;
+        if(added == 0) return;  // Nothing new
+        
+        coverageTable[i].coverage |= added;
+        
+        #if DEBUG_COVERAGE
+          Serial.print(">>> COVERAGE: Report from ");
+          Serial.print(src);
+          Serial.print(" merged for broadcast ");
+          Serial.println(hashStr);
+        #endif
+        
+        // Send to Python
+        Serial.print("COV|");
+        Serial.print(hashStr);
+        Serial.print("|");
+        Serial.println(coverageToHex(coverageTable[i].coverage));
+        return;
+      }
+    }
+    return;
+  }
+  
+  // === Type H: CONTACT - a lamp answering our beacon ===
+  if(type == MSG_TYPE_CONTACT && header.length() >= HEADER_LENGTH_CONTACT){
+    if(HQ_MOBILE && dst == NODE_ID) processContactReply(header);
+    return;
+  }
+  
+  // === Type C: OTA page request ===
+  if(type == MSG_TYPE_OTA_REQ && header.length() == HEADER_LENGTH_OTA_REQ){
+    if(dst == NODE_ID) processOtaReq(header);
+    return;
+  }
+  
+  // HQ doesn't process Type 0, 1, 2 (those are HQ → Lamps) or G (lamp-to-lamp repair)
 }
 
 #endif // LIFI_H
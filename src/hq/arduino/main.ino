@@ -1,56 +1,57 @@
 #include <Arduino.h>
 #include "config.h"
 #include "lifi.h"
+#include "contact.h"
+#include "sched.h"
 
 // ==================== GLOBAL VARIABLES ====================
 
 MsgCache cache[CACHE_SIZE];
 int cacheIndex = 0;
 
-// ==================== SETUP ====================
+PendingTarget pendingTargets[PENDING_TARGET_SIZE];
+uint8_t nextCmdID = 0;
 
-void setup(){
-  Serial.begin(115200);
-  delay(100);
-  
-  pinMode(LED_STATUS, OUTPUT);
-  pinMode(IR_RX_PIN, INPUT);
-  
-  irInit();
-  
-  // Initialize cache
-  for(int i = 0; i < CACHE_SIZE; i++){
-    cache[i].src = "";
-    cache[i].msgHash = 0;
-  }
+BroadcastCoverage coverageTable[COVERAGE_TRACK_SIZE];
+int coverageIndex = 0;
 
-  Serial.println("\n╔════════════════════════════════════╗");
-  Serial.println("║   LiFi Mesh HQ Node V3             ║");
-  Serial.println("║   (Gradient System Controller)     ║");
-  Serial.println("╚════════════════════════════════════╝");
-  Serial.print("Node ID: "); Serial.println(NODE_ID);
-  Serial.print("HQ Hop: "); Serial.println(HQ_HOP);
-  Serial.println("4-Direction TX enabled");
-  Serial.println("════════════════════════════════════\n");
-  
-  Serial.println("Commands:");
-  Serial.println("  INIT|<id>              - Send INIT (e.g., INIT|01)");
-  Serial.println("  BROADCAST|<message>    - Type 1: Broadcast to all");
-  Serial.println("  TARGET|<nodeID>|<msg>  - Type 2: Target lamp");
-  Serial.println("  MESSAGE|<nodeID>|<msg> - Type 4: Send message");
-  Serial.println();
-  
-  LED_ON();
-  delay(100);
-  LED_OFF();
-  
-  Serial.println("READY");
-}
+Task tasks[SCHED_MAX_TASKS];
+uint8_t taskCount = 0;
+volatile bool schedEventPosted = false;
+uint8_t txCompleteTask = SCHED_NO_TASK;
 
-// ==================== MAIN LOOP ====================
+uint8_t irRxTask = SCHED_NO_TASK;
 
-void loop(){
-  // ===== TASK 1: Process serial commands from Python =====
+unsigned long lplLastTxTime = 0;
+
+OtaSeed otaSeed;
+
+uint8_t timeSyncSeq = 0;
+
+unsigned long configApplyAt = 0;
+
+HcContext hcContexts[HC_CONTEXT_SIZE];
+HcStats hcStats = {0, 0, 0, 0};
+int16_t hcMissPending = -1;
+unsigned long hcLastMiss = 0;
+
+CapsPeer capsPeers[CAPS_PEER_SIZE];
+unsigned long capsLegacyHeardAt = 0;
+
+DownlinkEntry downlinkStore[CONTACT_DOWN_MAX];
+int downlinkIndex = 0;
+ContactState contact;
+ContactStats contactStats = {0, 0, 0, 0, 0, 0};
+
+// ==================== TASKS ====================
+
+// IRremote has a decoded frame ready
+void IRAM_ATTR onIrFrameReady(){
+  schedPostEvent(irRxTask);
+}
+
+// Serial commands from Python
+void taskSerialCommands(){
   if(Serial.available()){
     String cmd = Serial.readStringUntil('\n');
     cmd.trim();
@@ -66,6 +67,7 @@ void loop(){
       String initID = cmd.substring(5);
       if(initID.length() == 2){
         sendInit(initID);
+        sendTimeSync();  // Fresh lamps get a clock with their gradient
       } else {
         Serial.println("ERROR: INIT ID must be 2 chars");
       }
@@ -83,7 +85,8 @@ void loop(){
       if(pipePos > 0){
         String nodeID = cmd.substring(7, pipePos);
         String message = cmd.substring(pipePos + 1);
-        if(nodeID.length() == 4 && message.length() > 0){
+        uint16_t addr, mask;
+        if(addrParse(nodeID, addr, mask) && message.length() > 0){
           sendTargeted(nodeID, message);
         } else {
           Serial.println("ERROR: Invalid format");
@@ -106,16 +109,181 @@ void loop(){
         Serial.println("ERROR: Missing separator");
       }
     }
+    else if(cmd.startsWith("CONGESTION|")){
+      int pipePos = cmd.indexOf('|', 11);
+      if(pipePos > 0){
+        int level = cmd.substring(11, pipePos).toInt();
+        int minutes = cmd.substring(pipePos + 1).toInt();
+        if(level >= 0 && level <= CONGESTION_MAX_LEVEL && minutes >= 0 && minutes <= CONGESTION_MAX_MINUTES){
+          sendCongestion(level, minutes);
+        } else {
+          Serial.println("ERROR: Invalid level or duration");
+        }
+      } else {
+        Serial.println("ERROR: Missing separator");
+      }
+    }
+    else if(cmd.startsWith("CONFIG|")){
+      // CONFIG|<ver>|<delay s>|<gap ms>|<interval s>|<count>|<K>|<lifi s>
+      long f[7];
+      int start = 7;
+      int n = 0;
+      while(n < 7){
+        int pipePos = cmd.indexOf('|', start);
+        String field = (pipePos < 0) ? cmd.substring(start) : cmd.substring(start, pipePos);
+        if(field.length() == 0) break;
+        f[n++] = field.toInt();
+        if(pipePos < 0) break;
+        start = pipePos + 1;
+      }
+      
+      if(n == 7 && f[0] >= 1 && f[0] <= 65535 && f[1] >= 0 && f[1] <= 999 &&
+         f[2] >= 0 && f[2] <= 2000 && f[3] >= 1 && f[3] <= 999 &&
+         f[4] >= CONFIG_COUNT_MIN && f[4] <= 9 && f[5] >= 0 && f[5] <= CONFIG_K_MAX && f[6] >= 1 && f[6] <= 9999){
+        char block[CONFIG_MESSAGE_LENGTH + 1];
+        sprintf(block, "%05ld%04ld%03ld%ld%ld%04ld", f[0], f[2], f[3], f[4], f[5], f[6]);
+        sendConfig(f[1], String(block));
+      } else {
+        Serial.println("ERROR: Invalid CONFIG fields");
+      }
+    }
+    else if(cmd.startsWith("OTAPAGE|")){
+      int pipePos = cmd.indexOf('|', 8);
+      if(pipePos < 0 || !loadOtaPage(cmd.substring(8, pipePos).toInt(), cmd.substring(pipePos + 1))){
+        Serial.println("ERROR: Invalid OTA page");
+      }
+    }
+    else if(cmd.startsWith("OTA|")){
+      int p1 = cmd.indexOf('|', 4);
+      int p2 = (p1 > 0) ? cmd.indexOf('|', p1 + 1) : -1;
+      int p3 = (p2 > 0) ? cmd.indexOf('|', p2 + 1) : -1;
+      int version = cmd.substring(4, p1 > 0 ? p1 : cmd.length()).toInt();
+      if(version == 0){
+        otaSeed.version = 0;
+        Serial.println(">>> OTA: Seeding stopped");
+      } else if(p3 > 0 && version <= 255){
+        long size = cmd.substring(p1 + 1, p2).toInt();
+        uint32_t crc = strtoul(cmd.substring(p2 + 1, p3).c_str(), NULL, 16);
+        uint32_t tag = strtoul(cmd.substring(p3 + 1).c_str(), NULL, 16);
+        if(size > 0 && size <= (long)OTA_PAGE_BYTES * 0xFFF){
+          startOtaSeed(version, size, crc, tag);
+        } else {
+          Serial.println("ERROR: Invalid image size");
+        }
+      } else {
+        Serial.println("ERROR: Invalid OTA command");
+      }
+    }
     else {
       Serial.println("ERROR: Unknown command");
     }
   }
-  
-  // ===== TASK 2: Check for incoming messages =====
+}
+
+// Incoming messages (event: IR frame ready / TX complete)
+void taskIrReceive(){
   String header, message;
   if(irReceive(header, message)){
     processPacket(header, message);
   }
+}
+
+// ==================== SETUP ====================
+
+void setup(){
+  Serial.begin(115200);
+  delay(100);
+  
+  pinMode(LED_STATUS, OUTPUT);
+  pinMode(IR_RX_PIN, INPUT);
+  
+  irInit();
+  
+  // Initialize cache
+  for(int i = 0; i < CACHE_SIZE; i++){
+    cache[i].src = "";
+    cache[i].msgHash = 0;
+  }
+  
+  // Initialize delivery tracking
+  for(int i = 0; i < PENDING_TARGET_SIZE; i++){
+    pendingTargets[i].active = false;
+  }
+  
+  otaSeed.version = 0;
+  
+  // Fresh beacon sequence so lamps' dedup caches don't swallow them after a reboot
+  randomSeed(analogRead(A0));
+  timeSyncSeq = random(256);
+  
+  // Initialize coverage tracking
+  for(int i = 0; i < COVERAGE_TRACK_SIZE; i++){
+    coverageTable[i].active = false;
+  }
+
+  for(int i = 0; i < HC_CONTEXT_SIZE; i++){
+    hcContexts[i].active = false;
+  }
+
+  for(int i = 0; i < CAPS_PEER_SIZE; i++){
+    capsPeers[i].active = false;
+  }
+
+  for(int i = 0; i < CONTACT_DOWN_MAX; i++){
+    downlinkStore[i].active = false;
+  }
+  contact.pullMask = 0;
+  contact.expected = 0;
+  contact.serveAfter = 0;
+  contact.nextBeacon = 0;
+  contact.keyIndex = 0;
+  for(int i = 0; i < CONTACT_KEYS; i++){
+    contact.keys[i] = 0;
+  }
+
+  Serial.println("\n╔════════════════════════════════════╗");
+  Serial.println("║   LiFi Mesh HQ Node V3             ║");
+  Serial.println("║   (Gradient System Controller)     ║");
+  Serial.println("╚════════════════════════════════════╝");
+  Serial.print("Node ID: "); Serial.println(NODE_ID);
+  Serial.print("HQ Hop: "); Serial.println(HQ_HOP);
+  if(HQ_MOBILE) Serial.println("Mobile HQ: contact beacons enabled");
+  Serial.println("4-Direction TX enabled");
+  Serial.println("════════════════════════════════════\n");
+  
+  Serial.println("Commands:");
+  Serial.println("  INIT|<id>              - Send INIT (e.g., INIT|01)");
+  Serial.println("  BROADCAST|<message>    - Type 1: Broadcast to all");
+  Serial.println("  TARGET|<nodeID>|<msg>  - Type 2: Target lamp (ACKed)");
+  Serial.println("                           or street/district prefix, e.g. 10** (not ACKed)");
+  Serial.println("  MESSAGE|<nodeID>|<msg> - Type 4: Send message");
+  Serial.println("  CONGESTION|<lvl>|<min> - Type 9: Throttle lamps (lvl 0 clears)");
+  Serial.println("  CONFIG|<ver>|<delay s>|<gap ms>|<rtx s>|<rtx n>|<K>|<lifi s>");
+  Serial.println("                         - Type A: Retune lamps at an epoch");
+  Serial.println("  OTA|<ver>|<size>|<crc>|<tag> - Seed firmware image (OTA|0 stops)");
+  Serial.println("  OTAPAGE|<page>|<hex>   - Image page requested via OTAREQ");
+  Serial.println();
+  
+  // Register scheduler tasks
+  schedAddTask("serial", taskSerialCommands, 20);
+  irRxTask = schedAddTask("irRx", taskIrReceive, 20);
+  schedAddTask("targets", processPendingTargets, 1000);
+  schedAddTask("ota", processOtaSeed, 1000);
+  schedAddTask("timesync", sendTimeSync, TIMESYNC_INTERVAL);
+  schedAddTask("hcMiss", processHcMiss, 500);
+  if(HQ_MOBILE) schedAddTask("contact", processContact, 100);
+  txCompleteTask = irRxTask;
+  IrReceiver.registerReceiveCompleteCallback(onIrFrameReady);
+  
+  LED_ON();
+  delay(100);
+  LED_OFF();
+  
+  Serial.println("READY");
+}
+
+// ==================== MAIN LOOP ====================
 
-  delay(10);
+void loop(){
+  schedRun();
 }
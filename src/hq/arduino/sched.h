@@ -0,0 +1,147 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ==================== COOPERATIVE TASK SCHEDULER ====================
+
+/*
+ * Deadline-Ordered Cooperative Scheduler
+ * Replaces the fixed polling sequence + delay(10) in loop()
+ *
+ * - Timer tasks run every <period> ms (period 0 = event-only)
+ * - Events posted from interrupts (button edge, IR frame ready) or code
+ *   (TX complete) make a task due immediately
+ * - Due tasks run earliest-deadline first; when nothing is due the CPU
+ *   idles in 1ms delay() slices until the next deadline or a posted event
+ * - Every task keeps run count, total and worst-case runtime
+ */
+
+typedef void (*TaskFn)();
+
+/*
+ * Register a Task
+ * Returns task ID for schedPostEvent(), or SCHED_NO_TASK if table is full
+ */
+inline uint8_t schedAddTask(const char* name, TaskFn fn, unsigned long period){
+  if(taskCount >= SCHED_MAX_TASKS){
+    Serial.println(">>> SCHED: Warning - Task table full!");
+    return SCHED_NO_TASK;
+  }
+
+  Task &task = tasks[taskCount];
+  task.name = name;
+  task.fn = fn;
+  task.period = period;
+  task.nextRun = millis() + period;
+  task.eventPending = false;
+  task.runCount = 0;
+  task.totalMicros = 0;
+  task.maxMicros = 0;
+
+  return taskCount++;
+}
+
+/*
+ * Post Event to Task (ISR-safe)
+ * Only sets flags; the task runs from schedRun() on the main loop
+ */
+inline void IRAM_ATTR schedPostEvent(uint8_t id){
+  if(id >= taskCount) return;
+  tasks[id].eventPending = true;
+  schedEventPosted = true;
+}
+
+/*
+ * Post TX Complete Event
+ * Called by the IR layer once a transmission sequence finishes
+ */
+inline void schedNotifyTxComplete(){
+  if(txCompleteTask != SCHED_NO_TASK) schedPostEvent(txCompleteTask);
+}
+
+/*
+ * Run One Task and Account its Runtime
+ */
+inline void schedRunTask(Task &task){
+  unsigned long start = micros();
+  task.fn();
+  unsigned long elapsed = micros() - start;
+
+  task.runCount++;
+  task.totalMicros += elapsed;
+  if(elapsed > task.maxMicros) task.maxMicros = elapsed;
+}
+
+/*
+ * Scheduler Step (call from loop())
+ * Runs all due tasks in deadline order, then idles until the next deadline
+ */
+inline void schedRun(){
+  while(true){
+    unsigned long now = millis();
+    int next = -1;
+    long nextLateness = 0;
+
+    // Pick the due task with the earliest deadline (events are due now)
+    schedEventPosted = false;
+    for(uint8_t i = 0; i < taskCount; i++){
+      Task &task = tasks[i];
+      bool timerDue = task.period > 0 && (long)(now - task.nextRun) >= 0;
+      if(!task.eventPending && !timerDue) continue;
+
+      // Posted events go ahead of any timer deadline
+      long lateness = task.eventPending ? SCHED_EVENT_PRIORITY : (long)(now - task.nextRun);
+      if(next < 0 || lateness > nextLateness){
+        next = i;
+        nextLateness = lateness;
+      }
+    }
+
+    if(next < 0) break;  // Nothing due
+
+    Task &task = tasks[next];
+    task.eventPending = false;
+    if(task.period > 0) task.nextRun = now + task.period;
+    schedRunTask(task);
+  }
+
+  // Idle until the earliest deadline, waking early on posted events
+  unsigned long now = millis();
+  unsigned long sleepFor = SCHED_MAX_SLEEP;
+  for(uint8_t i = 0; i < taskCount; i++){
+    if(tasks[i].period == 0) continue;
+    long untilDue = (long)(tasks[i].nextRun - now);
+    if(untilDue <= 0){
+      sleepFor = 0;
+      break;
+    }
+    if((unsigned long)untilDue < sleepFor) sleepFor = untilDue;
+  }
+
+  unsigned long sleepStart = millis();
+  while(!schedEventPosted && millis() - sleepStart < sleepFor){
+    delay(1);  // Yields to the core; CPU idles between slices
+  }
+}
+
+/*
+ * Print Per-Task Runtime Accounting
+ */
+inline void schedPrintStats(){
+  Serial.println("Task runtime (runs / avg us / max us):");
+  for(uint8_t i = 0; i < taskCount; i++){
+    Task &task = tasks[i];
+    Serial.print("  ");
+    Serial.print(task.name);
+    Serial.print(": ");
+    Serial.print(task.runCount);
+    Serial.print(" / ");
+    Serial.print(task.runCount > 0 ? (unsigned long)(task.totalMicros / task.runCount) : 0UL);
+    Serial.print(" / ");
+    Serial.println(task.maxMicros);
+  }
+}
+
+#endif // SCHED_H
@@ -1,7 +1,9 @@
+import time
+import zlib
 from flask import Flask, render_template, request, jsonify, send_file
 from flask_socketio import SocketIO, emit
 import db
-from serial import ArduinoSerial
+from serial import ArduinoSerial, packet_hash, ota_image_tag
 
 app = Flask(__name__)
 app.config['SECRET_KEY'] = 'lifi-mesh-hq-2025'
@@ -10,6 +12,11 @@ socketio = SocketIO(app, cors_allowed_origins="*")
 # Arduino serial handler
 arduino = None
 
+# Firmware image being seeded into the mesh (kept in memory, served page by page)
+OTA_PAGE_BYTES = 128  # Must match OTA_PAGE_BYTES in firmware
+OTA_MAX_SIZE = OTA_PAGE_BYTES * 0xFFF
+ota = {'version': 0, 'image': b'', 'crc': 0, 'started': None, 'updated': {}}
+
 
 # ==================== SERIAL MESSAGE CALLBACK ====================
 
@@ -19,6 +26,13 @@ def handle_arduino_message(data):
     msg_type = data['type']
     content = data['content']
     
+    # Lamp finished installing the seeded image: "OTA <ver> OK"
+    if msg_type == '4' and content == f"OTA {ota['version']} OK" and ota['started']:
+        if sender_id not in ota['updated']:
+            ota['updated'][sender_id] = round(time.time() - ota['started'])
+            socketio.emit('ota_progress', ota_status())
+            print(f"⬆️  {sender_id} updated to v{ota['version']} after {ota['updated'][sender_id]}s")
+    
     # Save to database
     msg_id = db.add_message(sender_id, msg_type, content)
     
@@ -41,6 +55,78 @@ def handle_arduino_message(data):
             print(f"🚨 SOS from {sender_id}: {content}")
 
 
+# Firmware delivery event -> dashboard command state
+DELIVERY_STATES = {
+    'SENT': 'sent',
+    'ACKED': 'acked',
+    'TIMEOUT': 'timed_out',
+    'RETRY': 'retried',
+    'FAILED': 'failed',
+    'REJECTED': 'failed'
+}
+
+
+def handle_delivery_event(data):
+    """Called when HQ reports progress of a targeted command"""
+    event = data['event']
+    node_id = data['node_id']
+    cmd_id = data['cmd_id']
+    
+    if event == 'QUEUED':
+        command_id = db.bind_command(node_id, cmd_id)
+    elif event in DELIVERY_STATES:
+        attempts = None
+        if event in ('SENT', 'RETRY') and data['detail'].isdigit():
+            attempts = int(data['detail'])
+        command_id = db.update_command(node_id, cmd_id, DELIVERY_STATES[event], attempts)
+    else:
+        return
+    
+    if command_id:
+        socketio.emit('delivery_status', db.get_command(command_id))
+    
+    if event == 'FAILED':
+        print(f"❌ Targeted command {cmd_id} to {node_id} not acknowledged")
+
+
+def handle_coverage_update(data):
+    """Called when HQ merges a coverage report for a broadcast"""
+    db.update_coverage(data['hash'], data['coverage'])
+    broadcast = db.get_broadcast(data['hash'])
+    if broadcast:
+        socketio.emit('coverage_update', broadcast)
+
+
+def handle_health_update(data):
+    """Called when HQ extracts a piggybacked health entry"""
+    db.update_health(data['node_id'], data['battery'], data['solar'], data['error_flags'],
+                     data['sync_class'], data['gradient_k'], data['relays'], data['progress'])
+    node = db.get_node(data['node_id'])
+    if node:
+        socketio.emit('node_update', node)
+
+
+def handle_ota_request(page):
+    """Called when HQ needs a firmware page a lamp asked for"""
+    start = page * OTA_PAGE_BYTES
+    if not ota['version'] or start >= len(ota['image']):
+        return
+    
+    data = ota['image'][start:start + OTA_PAGE_BYTES].ljust(OTA_PAGE_BYTES, b'\xff')
+    arduino.send_ota_page(page, data)
+
+
+def ota_status():
+    """Current firmware rollout: image info and per-lamp time-to-update (s)"""
+    return {
+        'version': ota['version'],
+        'size': len(ota['image']),
+        'crc': f"{ota['crc']:08X}",
+        'elapsed': round(time.time() - ota['started']) if ota['started'] else 0,
+        'updated': ota['updated']
+    }
+
+
 # ==================== WEB ROUTES ====================
 
 @app.route('/')
@@ -82,6 +168,60 @@ def get_messages():
     return jsonify(messages)
 
 
+@app.route('/api/commands', methods=['GET'])
+def get_commands():
+    """Get recent targeted commands with delivery state"""
+    limit = request.args.get('limit', 20, type=int)
+    commands = db.get_commands(limit)
+    return jsonify(commands)
+
+
+@app.route('/api/broadcasts', methods=['GET'])
+def get_broadcasts():
+    """Get recent broadcasts with coverage and missing lamps"""
+    limit = request.args.get('limit', 10, type=int)
+    broadcasts = db.get_broadcasts(limit)
+    return jsonify(broadcasts)
+
+
+@app.route('/api/params', methods=['GET'])
+def get_params():
+    """Get recently sent runtime parameter sets"""
+    limit = request.args.get('limit', 5, type=int)
+    return jsonify(db.get_param_sets(limit))
+
+
+@app.route('/api/ota', methods=['GET'])
+def get_ota():
+    """Get firmware rollout progress"""
+    return jsonify(ota_status())
+
+
+@app.route('/api/firmware', methods=['POST'])
+def upload_firmware():
+    """Start seeding a firmware image (.bin) into the mesh"""
+    if not arduino or not arduino.connected:
+        return jsonify({'success': False, 'error': 'Arduino not connected'}), 400
+    
+    image = request.files['firmware'].read() if 'firmware' in request.files else b''
+    version = request.form.get('version', 0, type=int)
+    
+    if not 1 <= version <= 255:
+        return jsonify({'success': False, 'error': 'version must be 1-255'}), 400
+    if not 0 < len(image) <= OTA_MAX_SIZE:
+        return jsonify({'success': False, 'error': f'image must be 1-{OTA_MAX_SIZE} bytes'}), 400
+    
+    # Lamps verify the staged image against both before installing
+    crc = zlib.crc32(image)
+    tag = ota_image_tag(version, image)
+    
+    ota.update({'version': version, 'image': image, 'crc': crc,
+                'started': time.time(), 'updated': {}})
+    success = arduino.send_ota_start(version, len(image), crc, tag)
+    socketio.emit('ota_progress', ota_status())
+    return jsonify({'success': success})
+
+
 @app.route('/api/stats', methods=['GET'])
 def get_stats():
     """Get system statistics"""
@@ -114,7 +254,11 @@ def handle_connect_arduino(data):
         return
     
     port = data.get('port', None)
-    arduino = ArduinoSerial(on_message=handle_arduino_message)
+    arduino = ArduinoSerial(on_message=handle_arduino_message,
+                            on_delivery=handle_delivery_event,
+                            on_coverage=handle_coverage_update,
+                            on_health=handle_health_update,
+                            on_ota_request=handle_ota_request)
     
     if arduino.connect(port):
         emit('arduino_status', {'status': 'connected'})
@@ -147,7 +291,86 @@ def handle_send_message(data):
     msg_type = data.get('type')
     content = data.get('content')
     
-    success = arduino.send(destination, msg_type, content)
+    # Legacy free-form IDs are mapped to hierarchical addresses
+    if msg_type in ('2', '4') and destination:
+        destination = db.to_address(destination)
+        if msg_type == '4' and db.is_prefix(destination):
+            emit('send_result', {'success': False, 'error': 'Street/district prefixes are for targeted messages'})
+            return
+    
+    if msg_type == '2':
+        # Track delivery until the target lamp ACKs
+        command_id = db.add_command(destination, content)
+        socketio.emit('delivery_status', db.get_command(command_id))
+        success = arduino.send_targeted(destination, content)
+        if not success:
+            db.update_command(destination, None, 'failed')
+            socketio.emit('delivery_status', db.get_command(command_id))
+    elif msg_type == '1':
+        db.add_broadcast(packet_hash(db.HQ_ID, db.BROADCAST_ID, '1', content), content)
+        success = arduino.send_broadcast(content)
+    else:
+        success = arduino.send_message(destination, content)
+    emit('send_result', {'success': success})
+
+
+@socketio.on('set_congestion')
+def handle_set_congestion(data):
+    """Flood congestion control so lamps throttle non-critical traffic"""
+    if not arduino or not arduino.connected:
+        emit('send_result', {'success': False, 'error': 'Arduino not connected'})
+        return
+    
+    level = int(data.get('level', 0))
+    minutes = int(data.get('minutes', 10))
+    
+    success = arduino.send_congestion(level, minutes)
+    emit('send_result', {'success': success})
+
+
+# Lamps compare versions without wrap (0 is their factory block)
+CONFIG_MAX_VERSION = 65535
+
+# Bounds enforced by the HQ firmware's CONFIG command and the lamps
+PARAM_LIMITS = {
+    'direction_gap': (0, 2000),        # ms
+    'retransmit_interval': (1, 999),   # s
+    'retransmit_count': (1, 9),        # 0 would drop airtime-deferred relays
+    'gradient_tolerance': (0, 3),      # K, up to the lamps' GRADIENT_K_MAX
+    'lifi_interval': (1, 9999),        # s
+    'apply_delay': (0, 999),           # s
+}
+
+
+@socketio.on('set_params')
+def handle_set_params(data):
+    """Flood a runtime parameter block that all lamps apply at the same epoch"""
+    if not arduino or not arduino.connected:
+        emit('send_result', {'success': False, 'error': 'Arduino not connected'})
+        return
+    
+    try:
+        values = {key: int(data.get(key)) for key in PARAM_LIMITS}
+    except (TypeError, ValueError):
+        emit('send_result', {'success': False, 'error': 'All parameters are required'})
+        return
+    
+    for key, (low, high) in PARAM_LIMITS.items():
+        if not low <= values[key] <= high:
+            emit('send_result', {'success': False, 'error': f'{key} must be {low}-{high}'})
+            return
+    
+    version = db.add_param_set(values['direction_gap'], values['retransmit_interval'],
+                               values['retransmit_count'], values['gradient_tolerance'],
+                               values['lifi_interval'], values['apply_delay'])
+    
+    if version > CONFIG_MAX_VERSION:
+        emit('send_result', {'success': False, 'error': 'Parameter set versions exhausted'})
+        return
+    
+    success = arduino.send_config(version, values['apply_delay'], values['direction_gap'],
+                                  values['retransmit_interval'], values['retransmit_count'],
+                                  values['gradient_tolerance'], values['lifi_interval'])
     emit('send_result', {'success': success})
 
 
@@ -162,6 +385,13 @@ if __name__ == '__main__':
     print("💡 Connect Arduino via USB after page loads")
     print("=" * 60 + "\n")
     
+    # Lamps aliased on one coverage bit can't be told apart in reports
+    _, shared, unset = db.get_coverage_bits()
+    for bit, ids in sorted(shared.items()):
+        print(f"⚠️  Coverage bit {bit} shared by {', '.join(ids)}: set distinct mesh_index values")
+    if unset:
+        print(f"⚠️  No usable coverage bit for {', '.join(unset)}")
+    
     try:
         socketio.run(app, debug=True, host='0.0.0.0', port=5000)
     except KeyboardInterrupt:
@@ -4,6 +4,20 @@ import os
 
 DB_FILE = 'hq_data.db'
 
+# Node addresses are 4 hex chars: [district(1)][street(1)][lamp(2)]
+# Targeted messages may use a prefix with '*' wildcards ("10**" = one street)
+HQ_ID = '0000'
+BROADCAST_ID = 'FFFF'
+ADDR_WILDCARD = '*'
+
+# Free-form IDs from before hierarchical addressing
+LEGACY_HQ_ID = '000h'
+LEGACY_STREET = '0F'  # District 0, street F: pool for IDs that aren't hex
+
+# Coverage bitmaps hold 64 bits; unless NODE_INDEX is overridden, a lamp's
+# bit is the low 6 bits of its lamp number (see config.h)
+COVERAGE_BITS = 64
+
 def init_database():
     """Initialize database with tables"""
     conn = sqlite3.connect(DB_FILE)
@@ -17,10 +31,30 @@ def init_database():
             latitude REAL,
             longitude REAL,
             status TEXT DEFAULT 'unknown',
-            last_seen TIMESTAMP
+            last_seen TIMESTAMP,
+            mesh_index INTEGER,
+            battery INTEGER,
+            solar INTEGER,
+            error_flags INTEGER,
+            sync_class INTEGER,
+            gradient_k INTEGER,
+            relays INTEGER,
+            progress INTEGER,
+            health_seen TIMESTAMP
         )
     ''')
     
+    # Databases created by older dashboards lack the newer node columns
+    cursor.execute("PRAGMA table_info(nodes)")
+    existing = [row[1] for row in cursor.fetchall()]
+    for column, col_type in [('mesh_index', 'INTEGER'), ('battery', 'INTEGER'),
+                             ('solar', 'INTEGER'), ('error_flags', 'INTEGER'),
+                             ('sync_class', 'INTEGER'), ('gradient_k', 'INTEGER'),
+                             ('relays', 'INTEGER'), ('progress', 'INTEGER'),
+                             ('health_seen', 'TIMESTAMP')]:
+        if column not in existing:
+            cursor.execute(f"ALTER TABLE nodes ADD COLUMN {column} {col_type}")
+    
     # Create messages table
     cursor.execute('''
         CREATE TABLE IF NOT EXISTS messages (
@@ -34,19 +68,154 @@ def init_database():
         )
     ''')
     
+    # Create commands table (targeted delivery tracking)
+    # state: queued -> sent -> acked | timed_out -> retried -> ... -> failed
+    cursor.execute('''
+        CREATE TABLE IF NOT EXISTS commands (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            node_id TEXT NOT NULL,
+            content TEXT NOT NULL,
+            cmd_id TEXT,
+            state TEXT DEFAULT 'queued',
+            attempts INTEGER DEFAULT 0,
+            created TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+            updated TIMESTAMP
+        )
+    ''')
+    
+    # Create broadcasts table (aggregated coverage per Type 1 broadcast)
+    # coverage: 64-bit bitmap as 16 hex chars, bit = coverage_bit() of the lamp
+    cursor.execute('''
+        CREATE TABLE IF NOT EXISTS broadcasts (
+            hash TEXT PRIMARY KEY,
+            content TEXT,
+            coverage TEXT DEFAULT '0000000000000000',
+            sent TIMESTAMP,
+            updated TIMESTAMP
+        )
+    ''')
+    
+    # Create param_sets table (runtime protocol parameters flooded by CONFIG)
+    # id doubles as the on-air version (1-65535), so it only ever increases
+    cursor.execute('''
+        CREATE TABLE IF NOT EXISTS param_sets (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            direction_gap INTEGER NOT NULL,
+            retransmit_interval INTEGER NOT NULL,
+            retransmit_count INTEGER NOT NULL,
+            gradient_tolerance INTEGER NOT NULL,
+            lifi_interval INTEGER NOT NULL,
+            apply_delay INTEGER NOT NULL,
+            sent TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+        )
+    ''')
+    
+    # Create address_map table (legacy free-form ID -> hierarchical address)
+    cursor.execute('''
+        CREATE TABLE IF NOT EXISTS address_map (
+            legacy_id TEXT PRIMARY KEY,
+            address TEXT UNIQUE NOT NULL
+        )
+    ''')
+    
+    _migrate_legacy_ids(cursor)
+    
     # Add default HQ node if not exists
-    cursor.execute("SELECT * FROM nodes WHERE id = '000h'")
+    cursor.execute("SELECT * FROM nodes WHERE id = ?", (HQ_ID,))
     if not cursor.fetchone():
         cursor.execute('''
             INSERT INTO nodes (id, name, latitude, longitude, status, last_seen)
-            VALUES ('000h', 'Headquarters', 22.5726, 88.3639, 'active', ?)
-        ''', (datetime.now(),))
+            VALUES (?, 'Headquarters', 22.5726, 88.3639, 'active', ?)
+        ''', (HQ_ID, datetime.now()))
     
     conn.commit()
     conn.close()
     print("✓ Database initialized")
 
 
+def is_address(node_id):
+    """True for a hierarchical lamp address as firmware sends it (e.g. '102A')"""
+    return len(node_id) == 4 and all(c in '0123456789ABCDEF' for c in node_id)
+
+
+def is_prefix(node_id):
+    """True for a district / street prefix such as '1***' or '10**'"""
+    head = node_id.rstrip(ADDR_WILDCARD)
+    return len(node_id) == 4 and 0 < len(head) < 4 and all(c in '0123456789ABCDEF' for c in head)
+
+
+def parse_address(address):
+    """Split an address into (district, street, lamp) numbers"""
+    return int(address[0], 16), int(address[1], 16), int(address[2:4], 16)
+
+
+def address_prefix(district, street=None):
+    """Targeted-message prefix for a whole district or one street"""
+    if street is None:
+        return f"{district:X}***"
+    return f"{district:X}{street:X}**"
+
+
+def _map_legacy_id(cursor, legacy_id):
+    """Address for a pre-hierarchical ID, allocated once and kept in address_map"""
+    cursor.execute("SELECT address FROM address_map WHERE legacy_id = ?", (legacy_id,))
+    row = cursor.fetchone()
+    if row:
+        return row[0]
+    
+    upper = legacy_id.upper()
+    if legacy_id == LEGACY_HQ_ID:
+        address = HQ_ID
+    elif is_address(upper) and upper not in (HQ_ID, BROADCAST_ID):
+        address = upper  # Hex-looking IDs such as '102a' keep their value
+    else:
+        cursor.execute("SELECT address FROM address_map")
+        used = {r[0] for r in cursor.fetchall()}
+        cursor.execute("SELECT id FROM nodes")
+        used |= {r[0] for r in cursor.fetchall()}
+        free = [f"{LEGACY_STREET}{lamp:02X}" for lamp in range(256)
+                if f"{LEGACY_STREET}{lamp:02X}" not in used]
+        if not free:
+            raise ValueError(f"No free address left on legacy street {LEGACY_STREET}")
+        address = free[0]
+    
+    cursor.execute("INSERT INTO address_map (legacy_id, address) VALUES (?, ?)",
+                   (legacy_id, address))
+    return address
+
+
+def _migrate_legacy_ids(cursor):
+    """Move nodes stored under legacy IDs (and their history) to addresses"""
+    cursor.execute("SELECT id FROM nodes")
+    for (node_id,) in cursor.fetchall():
+        if is_address(node_id):
+            continue
+        
+        address = _map_legacy_id(cursor, node_id)
+        cursor.execute("SELECT 1 FROM nodes WHERE id = ?", (address,))
+        if cursor.fetchone():
+            cursor.execute("DELETE FROM nodes WHERE id = ?", (node_id,))
+        else:
+            cursor.execute("UPDATE nodes SET id = ? WHERE id = ?", (address, node_id))
+        cursor.execute("UPDATE messages SET sender_id = ? WHERE sender_id = ?", (address, node_id))
+        cursor.execute("UPDATE commands SET node_id = ? WHERE node_id = ?", (address, node_id))
+        print(f"✓ Node {node_id} is now {address}")
+
+
+def to_address(node_id):
+    """Normalize a user-entered node ID: address, prefix or legacy ID"""
+    upper = node_id.upper()
+    if is_address(upper) or is_prefix(upper):
+        return upper
+    
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+    address = _map_legacy_id(cursor, node_id)
+    conn.commit()
+    conn.close()
+    return address
+
+
 def add_node(node_id, name=None, lat=None, lon=None):
     """Add or update a node"""
     conn = sqlite3.connect(DB_FILE)
@@ -74,7 +243,7 @@ def update_node(node_id, **kwargs):
     values = []
     
     for key, value in kwargs.items():
-        if key in ['name', 'latitude', 'longitude', 'status']:
+        if key in ['name', 'latitude', 'longitude', 'status', 'mesh_index']:
             fields.append(f"{key} = ?")
             values.append(value)
     
@@ -90,6 +259,28 @@ def update_node(node_id, **kwargs):
     conn.close()
 
 
+def update_health(node_id, battery, solar, error_flags, sync_class, gradient_k, relays, progress):
+    """Store piggybacked lamp health (battery 0-9, solar 0/1, error bit flags,
+    mesh time error class: within 2^(n+4) ms, 15 = unsynced, adaptive gradient
+    tolerance K, parallel relays per upstream packet, progress in tenths)"""
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+    
+    cursor.execute("SELECT * FROM nodes WHERE id = ?", (node_id,))
+    if not cursor.fetchone():
+        add_node(node_id)
+    
+    cursor.execute('''
+        UPDATE nodes SET battery = ?, solar = ?, error_flags = ?, sync_class = ?,
+                         gradient_k = ?, relays = ?, progress = ?, health_seen = ?
+        WHERE id = ?
+    ''', (battery, solar, error_flags, sync_class, gradient_k, relays, progress,
+          datetime.now(), node_id))
+    
+    conn.commit()
+    conn.close()
+
+
 def add_message(sender_id, msg_type, content):
     """Add a new message to database"""
     conn = sqlite3.connect(DB_FILE)
@@ -210,6 +401,261 @@ def get_stats():
     }
 
 
+def add_command(node_id, content):
+    """Record a targeted command before it is handed to the HQ node"""
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+    
+    cursor.execute('''
+        INSERT INTO commands (node_id, content, state, created, updated)
+        VALUES (?, ?, 'queued', ?, ?)
+    ''', (node_id, content, datetime.now(), datetime.now()))
+    
+    command_id = cursor.lastrowid
+    
+    conn.commit()
+    conn.close()
+    
+    return command_id
+
+
+def bind_command(node_id, cmd_id):
+    """Attach the HQ-assigned command ID to the oldest unbound command for a node
+    
+    HQ handles serial commands in order, so QUEUED reports arrive in the
+    same order the dashboard sent them.
+    """
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+    
+    cursor.execute('''
+        SELECT id FROM commands
+        WHERE node_id = ? AND cmd_id IS NULL AND state = 'queued'
+        ORDER BY id ASC LIMIT 1
+    ''', (node_id,))
+    row = cursor.fetchone()
+    
+    if row:
+        cursor.execute("UPDATE commands SET cmd_id = ?, updated = ? WHERE id = ?",
+                       (cmd_id, datetime.now(), row[0]))
+    
+    conn.commit()
+    conn.close()
+    
+    return row[0] if row else None
+
+
+def update_command(node_id, cmd_id, state, attempts=None):
+    """Update delivery state of the latest command with this HQ command ID
+    
+    HQ command IDs wrap at 256, so only the newest match is updated.
+    Returns the updated command row id, or None if unknown.
+    """
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+    
+    if cmd_id is None:
+        # Rejected before HQ assigned an ID
+        cursor.execute('''
+            SELECT id FROM commands
+            WHERE node_id = ? AND cmd_id IS NULL AND state = 'queued'
+            ORDER BY id ASC LIMIT 1
+        ''', (node_id,))
+    else:
+        cursor.execute('''
+            SELECT id FROM commands
+            WHERE node_id = ? AND cmd_id = ?
+            ORDER BY id DESC LIMIT 1
+        ''', (node_id, cmd_id))
+    row = cursor.fetchone()
+    
+    if row:
+        if attempts is None:
+            cursor.execute("UPDATE commands SET state = ?, updated = ? WHERE id = ?",
+                           (state, datetime.now(), row[0]))
+        else:
+            cursor.execute("UPDATE commands SET state = ?, attempts = ?, updated = ? WHERE id = ?",
+                           (state, attempts, datetime.now(), row[0]))
+    
+    conn.commit()
+    conn.close()
+    
+    return row[0] if row else None
+
+
+def get_command(command_id):
+    """Get a specific command"""
+    conn = sqlite3.connect(DB_FILE)
+    conn.row_factory = sqlite3.Row
+    cursor = conn.cursor()
+    
+    cursor.execute("SELECT * FROM commands WHERE id = ?", (command_id,))
+    command = cursor.fetchone()
+    
+    conn.close()
+    return dict(command) if command else None
+
+
+def get_commands(limit=20):
+    """Get recent targeted commands with delivery state"""
+    conn = sqlite3.connect(DB_FILE)
+    conn.row_factory = sqlite3.Row
+    cursor = conn.cursor()
+    
+    cursor.execute("SELECT * FROM commands ORDER BY id DESC LIMIT ?", (limit,))
+    commands = [dict(row) for row in cursor.fetchall()]
+    
+    conn.close()
+    return commands
+
+
+def add_broadcast(msg_hash, content):
+    """Record a broadcast so coverage reports can be matched to it"""
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+    
+    cursor.execute('''
+        INSERT OR REPLACE INTO broadcasts (hash, content, coverage, sent, updated)
+        VALUES (?, ?, '0000000000000000', ?, ?)
+    ''', (msg_hash, content, datetime.now(), datetime.now()))
+    
+    conn.commit()
+    conn.close()
+
+
+def update_coverage(msg_hash, coverage):
+    """Store the latest merged coverage bitmap reported by HQ"""
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+    
+    cursor.execute("SELECT hash FROM broadcasts WHERE hash = ?", (msg_hash,))
+    if cursor.fetchone():
+        cursor.execute("UPDATE broadcasts SET coverage = ?, updated = ? WHERE hash = ?",
+                       (coverage, datetime.now(), msg_hash))
+    else:
+        # Broadcast sent outside the dashboard (e.g. serial monitor)
+        cursor.execute('''
+            INSERT INTO broadcasts (hash, content, coverage, sent, updated)
+            VALUES (?, NULL, ?, ?, ?)
+        ''', (msg_hash, coverage, datetime.now(), datetime.now()))
+    
+    conn.commit()
+    conn.close()
+
+
+def coverage_bit(node):
+    """Coverage bit of a lamp: its mesh_index if set, else derived from its address"""
+    if node['mesh_index'] is not None:
+        index = node['mesh_index']
+        return index if 0 <= index < COVERAGE_BITS else None
+    try:
+        return int(node['id'][2:4], 16) % COVERAGE_BITS
+    except ValueError:
+        return None
+
+
+def get_coverage_bits():
+    """Map each lamp to its coverage bit; flag lamps sharing a bit or without one
+
+    Returns (bits, shared, unset): bits maps lamp id to bit for lamps whose bit
+    is theirs alone, shared maps a bit to the lamps aliased on it, unset lists
+    lamps with no usable bit. Only lamps in bits can be told apart in a report.
+    """
+    conn = sqlite3.connect(DB_FILE)
+    conn.row_factory = sqlite3.Row
+    cursor = conn.cursor()
+    
+    # HQ boards (0000-000F) never set a coverage bit
+    cursor.execute("SELECT id, mesh_index FROM nodes WHERE id NOT LIKE '000%'")
+    lamps = [dict(row) for row in cursor.fetchall()]
+    conn.close()
+    
+    by_bit = {}
+    unset = []
+    for lamp in lamps:
+        bit = coverage_bit(lamp)
+        if bit is None:
+            unset.append(lamp['id'])
+        else:
+            by_bit.setdefault(bit, []).append(lamp['id'])
+    
+    bits = {ids[0]: bit for bit, ids in by_bit.items() if len(ids) == 1}
+    shared = {bit: sorted(ids) for bit, ids in by_bit.items() if len(ids) > 1}
+    return bits, shared, sorted(unset)
+
+
+def _coverage_summary(broadcast, bits, shared, unset):
+    """Add coverage percentage and missing lamps to a broadcast row"""
+    bitmap = int(broadcast['coverage'] or '0', 16)
+    reached = sorted(n for n, bit in bits.items() if bitmap >> bit & 1)
+    missing = sorted(n for n, bit in bits.items() if not bitmap >> bit & 1)
+    
+    broadcast['reached'] = reached
+    broadcast['missing'] = missing
+    broadcast['coverage_pct'] = round(100.0 * len(reached) / len(bits), 1) if bits else 0.0
+    # A set bit can't say which of its lamps was reached, so these are left out
+    broadcast['ambiguous'] = sorted(n for ids in shared.values() for n in ids)
+    broadcast['unindexed'] = unset
+    return broadcast
+
+
+def get_broadcasts(limit=10):
+    """Get recent broadcasts with coverage percentage and missing lamps"""
+    bits, shared, unset = get_coverage_bits()
+    
+    conn = sqlite3.connect(DB_FILE)
+    conn.row_factory = sqlite3.Row
+    cursor = conn.cursor()
+    
+    cursor.execute("SELECT * FROM broadcasts ORDER BY sent DESC LIMIT ?", (limit,))
+    broadcasts = [_coverage_summary(dict(row), bits, shared, unset) for row in cursor.fetchall()]
+    
+    conn.close()
+    return broadcasts
+
+
+def get_broadcast(msg_hash):
+    """Get coverage summary for one broadcast"""
+    for broadcast in get_broadcasts(limit=100):
+        if broadcast['hash'] == msg_hash:
+            return broadcast
+    return None
+
+
+def add_param_set(direction_gap, retransmit_interval, retransmit_count,
+                  gradient_tolerance, lifi_interval, apply_delay):
+    """Record a parameter set and return its on-air version (its id, 1-65535)"""
+    conn = sqlite3.connect(DB_FILE)
+    cursor = conn.cursor()
+    
+    cursor.execute('''
+        INSERT INTO param_sets (direction_gap, retransmit_interval, retransmit_count,
+                                gradient_tolerance, lifi_interval, apply_delay, sent)
+        VALUES (?, ?, ?, ?, ?, ?, ?)
+    ''', (direction_gap, retransmit_interval, retransmit_count,
+          gradient_tolerance, lifi_interval, apply_delay, datetime.now()))
+    
+    row_id = cursor.lastrowid
+    conn.commit()
+    conn.close()
+    return row_id
+
+
+def get_param_sets(limit=5):
+    """Get recently sent parameter sets (newest first)"""
+    conn = sqlite3.connect(DB_FILE)
+    conn.row_factory = sqlite3.Row
+    cursor = conn.cursor()
+    
+    cursor.execute("SELECT * FROM param_sets ORDER BY id DESC LIMIT ?", (limit,))
+    param_sets = [dict(row) for row in cursor.fetchall()]
+    for param_set in param_sets:
+        param_set['version'] = param_set['id']
+    
+    conn.close()
+    return param_sets
+
+
 def clear_database():
     """Clear all data (for testing)"""
     if os.path.exists(DB_FILE):
@@ -219,5 +665,5 @@ def clear_database():
 
 
 # Initialize database when module is imported
-if not os.path.exists(DB_FILE):
-    init_database()
+# (tables use IF NOT EXISTS, so this also migrates older databases)
+init_database()
@@ -1,21 +1,94 @@
+import os
 import serial
 import serial.tools.list_ports
 import threading
 import time
 
+
+def simple_hash(message):
+    """16-bit polynomial rolling hash, identical to simpleHash() in firmware"""
+    h = 0
+    for c in message:
+        h = (h * 31 + ord(c)) & 0xFFFF
+    return f"{h:04X}"
+
+
+# Keyed tag on HQ-originated Types 1, 2 and A (must match MESH_AUTH / MESH_KEY in firmware)
+MESH_AUTH = True
+MESH_KEY = bytes([0x4C, 0x69, 0x46, 0x69, 0x4D, 0x65, 0x73, 0x68,
+                  0x2D, 0x64, 0x65, 0x76, 0x2D, 0x6B, 0x65, 0x79])
+
+
+def siphash24(key, data):
+    """SipHash-2-4 (64-bit), identical to sipInit/sipUpdate/sipFinal16 in firmware"""
+    mask = 0xFFFFFFFFFFFFFFFF
+    rotl = lambda x, b: ((x << b) | (x >> (64 - b))) & mask
+    k0 = int.from_bytes(key[:8], 'little')
+    k1 = int.from_bytes(key[8:], 'little')
+    v = [k0 ^ 0x736f6d6570736575, k1 ^ 0x646f72616e646f6d,
+         k0 ^ 0x6c7967656e657261, k1 ^ 0x7465646279746573]
+    
+    def sip_round():
+        v[0] = (v[0] + v[1]) & mask; v[1] = rotl(v[1], 13) ^ v[0]; v[0] = rotl(v[0], 32)
+        v[2] = (v[2] + v[3]) & mask; v[3] = rotl(v[3], 16) ^ v[2]
+        v[0] = (v[0] + v[3]) & mask; v[3] = rotl(v[3], 21) ^ v[0]
+        v[2] = (v[2] + v[1]) & mask; v[1] = rotl(v[1], 17) ^ v[2]; v[2] = rotl(v[2], 32)
+    
+    tail = len(data) % 8
+    for i in range(0, len(data) - tail, 8):
+        m = int.from_bytes(data[i:i + 8], 'little')
+        v[3] ^= m
+        sip_round(); sip_round()
+        v[0] ^= m
+    
+    b = ((len(data) & 0xFF) << 56) | int.from_bytes(data[len(data) - tail:], 'little')
+    v[3] ^= b
+    sip_round(); sip_round()
+    v[0] ^= b
+    v[2] ^= 0xFF
+    for _ in range(4):
+        sip_round()
+    return v[0] ^ v[1] ^ v[2] ^ v[3]
+
+
+def packet_hash(src, dst, msg_type, message):
+    """Hash field HQ puts on a Type 1/2/A packet (keyed tag with MESH_AUTH)"""
+    if not MESH_AUTH:
+        return simple_hash(message)
+    data = (src + dst + msg_type + message).encode('latin-1')
+    return f"{siphash24(MESH_KEY, data) & 0xFFFF:04X}"
+
+
+def ota_image_tag(version, image):
+    """Keyed tag lamps check before installing an image (otaStagedTag in firmware)"""
+    data = f"0000FFFFB{version:02X}{len(image):05X}".encode('latin-1') + image
+    return siphash24(MESH_KEY, data) & 0xFFFFFFFF
+
+
 class ArduinoSerial:
     """Handles serial communication with Arduino HQ"""
     
-    def __init__(self, on_message=None):
+    def __init__(self, on_message=None, on_delivery=None, on_coverage=None, on_health=None,
+                 on_ota_request=None):
         self.port = None
         self.serial = None
         self.connected = False
         self.on_message = on_message  # Callback function
+        self.on_delivery = on_delivery  # Targeted delivery events
+        self.on_coverage = on_coverage  # Broadcast coverage updates
+        self.on_health = on_health  # Piggybacked lamp health
+        self.on_ota_request = on_ota_request  # Firmware page wanted by a lamp
         self.thread = None
         self.running = False
     
     def find_arduino(self):
         """Auto-detect Arduino/ESP port"""
+        # Set explicitly, e.g. the emulated HQ's pty (src/sim)
+        port = os.environ.get('HQ_SERIAL_PORT')
+        if port:
+            print(f"✓ Using HQ_SERIAL_PORT: {port}")
+            return port
+        
         ports = serial.tools.list_ports.comports()
         
         # Priority 1: Look for Arduino/ESP specific identifiers
@@ -114,6 +187,51 @@ class ArduinoSerial:
         if line.startswith('OK|') or line.startswith('ERR|'):
             return
         
+        # Targeted delivery events: CMD|<cmdID>|<event>|<nodeID>[|<detail>]
+        if line.startswith('CMD|'):
+            parts = line.split('|')
+            if len(parts) >= 4 and self.on_delivery:
+                self.on_delivery({
+                    'cmd_id': None if parts[1] == '--' else parts[1],
+                    'event': parts[2],
+                    'node_id': parts[3],
+                    'detail': parts[4] if len(parts) > 4 else ''
+                })
+            return
+        
+        # Broadcast coverage: COV|<hash>|<bitmap>
+        if line.startswith('COV|'):
+            parts = line.split('|')
+            if len(parts) == 3 and self.on_coverage:
+                self.on_coverage({'hash': parts[1], 'coverage': parts[2]})
+            return
+        
+        # Lamp health: HEALTH|<nodeID>|<battery>|<solar>|<errors>|<sync>|<K>|<relays>|<progress>
+        if line.startswith('HEALTH|'):
+            parts = line.split('|')
+            if len(parts) == 9 and self.on_health:
+                try:
+                    self.on_health({
+                        'node_id': parts[1],
+                        'battery': int(parts[2]),
+                        'solar': int(parts[3]),
+                        'error_flags': int(parts[4], 16),
+                        'sync_class': int(parts[5], 16),
+                        'gradient_k': int(parts[6], 16),
+                        'relays': int(parts[7], 16),
+                        'progress': int(parts[8], 16)
+                    })
+                except ValueError:
+                    pass
+            return
+        
+        # Firmware page request: OTAREQ|<page>
+        if line.startswith('OTAREQ|'):
+            page = line[7:]
+            if page.isdigit() and self.on_ota_request:
+                self.on_ota_request(int(page))
+            return
+        
         # Skip debug output from V2.5/V3 firmware
         if line.startswith('>>>') or line.startswith('═') or line.startswith('─'):
             return
@@ -123,8 +241,8 @@ class ArduinoSerial:
             return  # Skip IR debug lines
         
         # Parse message format: <sender_id> <type> <content>
-        # V2.5 header-only (Type 3 SOS): "102a000h3"
-        # V2.5 with message (Type 1/2/4): "000hFFFF1ABCD" + "Evacuate"
+        # V2.5 header-only (Type 3 SOS): "102A00003"
+        # V2.5 with message (Type 1/2/4): "0000FFFF1ABCD" + "Evacuate"
         
         parts = line.split(' ', 2)
         
@@ -193,6 +311,68 @@ class ArduinoSerial:
             print(f"❌ Send failed: {e}")
             return False
     
+    def send_congestion(self, level, minutes):
+        """Send Type 9: Congestion control (level 0 clears)"""
+        if not self.connected or not self.serial:
+            print("❌ Not connected")
+            return False
+        
+        try:
+            command = f"CONGESTION|{level}|{minutes}\n"
+            self.serial.write(command.encode('utf-8'))
+            print(f"→ {command.strip()}")
+            return True
+        except Exception as e:
+            print(f"❌ Send failed: {e}")
+            return False
+    
+    def send_config(self, version, apply_delay, direction_gap, retransmit_interval,
+                    retransmit_count, gradient_tolerance, lifi_interval):
+        """Send Type A: Runtime parameter block, applied by lamps after apply_delay s"""
+        if not self.connected or not self.serial:
+            print("❌ Not connected")
+            return False
+        
+        try:
+            command = (f"CONFIG|{version}|{apply_delay}|{direction_gap}|{retransmit_interval}|"
+                       f"{retransmit_count}|{gradient_tolerance}|{lifi_interval}\n")
+            self.serial.write(command.encode('utf-8'))
+            print(f"→ {command.strip()}")
+            return True
+        except Exception as e:
+            print(f"❌ Send failed: {e}")
+            return False
+    
+    def send_ota_start(self, version, size, crc, tag):
+        """Start seeding a firmware image (version 0 stops)"""
+        if not self.connected or not self.serial:
+            print("❌ Not connected")
+            return False
+        
+        try:
+            command = f"OTA|{version}|{size}|{crc:08X}|{tag:08X}\n" if version else "OTA|0\n"
+            self.serial.write(command.encode('utf-8'))
+            print(f"→ {command.strip()}")
+            return True
+        except Exception as e:
+            print(f"❌ Send failed: {e}")
+            return False
+    
+    def send_ota_page(self, page, data):
+        """Hand HQ one firmware page (bytes) it was asked for"""
+        if not self.connected or not self.serial:
+            print("❌ Not connected")
+            return False
+        
+        try:
+            command = f"OTAPAGE|{page}|{data.hex().upper()}\n"
+            self.serial.write(command.encode('utf-8'))
+            print(f"→ OTAPAGE|{page}")
+            return True
+        except Exception as e:
+            print(f"❌ Send failed: {e}")
+            return False
+    
     def send_broadcast(self, message):
         """Send Type 1: Broadcast to all lamps"""
         return self.send("FFFF", "1", message, cmd_type="BROADCAST")
@@ -0,0 +1,218 @@
+"""City lamp topology in a compact CSR file, for loading without per-node objects.
+
+    python topology.py lamps.csv city.lmt [--range 40]
+    python topology.py lamps.geojson city.lmt
+    python topology.py --from-db city.lmt
+
+Lamps come from a CSV (id, latitude, longitude; id optional), a GeoJSON
+FeatureCollection of Points (properties.id optional) or the dashboard's
+nodes table. A lamp without an id (or with a reserved one: HQ boards
+0000-000F, broadcast FFFF) gets an address no other lamp in the file uses,
+from 1000 on; two lamps with the same id are an error. Two lamps
+are neighbors when they are within IR range; each edge carries the
+direction it leaves the lamp by, quantized to the firmware's four TX
+directions with FRONT facing north:
+0 FRONT (N), 1 RIGHT (E), 2 BACK (S), 3 LEFT (W).
+
+File layout (little-endian, every section 4-byte aligned):
+    header   magic 'LMT1', version u16, range m u16, nodes u32, edges u32
+    ids      u16[nodes]      hierarchical address (0x102A = "102A")
+    lat/lon  f32[nodes] each
+    offsets  u32[nodes + 1]  edges of node i are offsets[i]..offsets[i+1]
+    targets  u32[edges]      neighbor node index
+    dirs     u8[edges]       TX direction toward that neighbor
+"""
+
+import csv
+import itertools
+import json
+import math
+import mmap
+import struct
+import sys
+
+MAGIC = b'LMT1'
+VERSION = 1
+HEADER = struct.Struct('<4sHHII')
+DEFAULT_RANGE = 40  # Meters, lamp-to-lamp IR reach
+HQ_RANGE = range(0x0000, 0x0010)  # HQ and mobile HQ boards (IS_FROM_HQ trusts them)
+BROADCAST = 0xFFFF
+
+DIR_NAMES = ['FRONT', 'RIGHT', 'BACK', 'LEFT']
+
+
+def _address(value):
+    """Address from a 4-hex-char id; None if missing, malformed or reserved"""
+    text = str(value or '').strip().upper()
+    if len(text) == 4 and all(c in '0123456789ABCDEF' for c in text):
+        address = int(text, 16)
+        if address not in HQ_RANGE and address != BROADCAST:
+            return address
+    return None
+
+
+def _assign_addresses(rows, path):
+    """Give lamps without a usable id the unused addresses, district 1 (0x1000) first"""
+    taken = set()
+    for address, _, _ in rows:
+        if address in taken:
+            raise ValueError(f"{path}: lamp id {address:04X} appears more than once")
+        if address is not None:
+            taken.add(address)
+    free = (a for a in itertools.chain(range(0x1000, BROADCAST), range(HQ_RANGE.stop, 0x1000))
+            if a not in taken)
+    lamps = []
+    for address, lat, lon in rows:
+        if address is None:
+            address = next(free, None)
+            if address is None:
+                raise ValueError(f"{path}: {len(rows)} lamps, but only "
+                                 f"{BROADCAST - len(HQ_RANGE)} addresses exist besides "
+                                 f"HQ boards (0000-000F) and broadcast (FFFF)")
+        lamps.append((address, lat, lon))
+    return lamps
+
+
+def read_lamps(path):
+    """(address, lat, lon) for every lamp in a CSV or GeoJSON file"""
+    rows = []
+    if path.lower().endswith(('.geojson', '.json')):
+        with open(path) as f:
+            features = json.load(f).get('features', [])
+        for feature in features:
+            geometry = feature.get('geometry') or {}
+            if geometry.get('type') != 'Point':
+                continue
+            lon, lat = geometry['coordinates'][:2]
+            lamp_id = (feature.get('properties') or {}).get('id')
+            rows.append((_address(lamp_id), float(lat), float(lon)))
+    else:
+        with open(path, newline='') as f:
+            for row in csv.DictReader(f):
+                row = {k.strip().lower(): v for k, v in row.items() if k}
+                lat = row.get('latitude', row.get('lat'))
+                lon = row.get('longitude', row.get('lon', row.get('lng')))
+                if not lat or not lon:
+                    continue
+                rows.append((_address(row.get('id')), float(lat), float(lon)))
+    return _assign_addresses(rows, path)
+
+
+def read_db_lamps():
+    """(address, lat, lon) for every placed node in the dashboard database"""
+    import db
+    return [(int(n['id'], 16), n['latitude'], n['longitude']) for n in db.get_nodes()
+            if n['latitude'] is not None and n['longitude'] is not None]
+
+
+def build_csr(lamps, range_m=DEFAULT_RANGE):
+    """Neighbors within range_m, found through a grid of range-sized cells"""
+    if not lamps:
+        return [0], [], []
+    lat0 = math.radians(sum(l[1] for l in lamps) / len(lamps))
+    xs = [l[2] * 111320.0 * math.cos(lat0) for l in lamps]
+    ys = [l[1] * 110540.0 for l in lamps]
+
+    cells = {}
+    for i in range(len(lamps)):
+        cells.setdefault((int(xs[i] // range_m), int(ys[i] // range_m)), []).append(i)
+
+    offsets, targets, dirs = [0], [], []
+    for i in range(len(lamps)):
+        cx, cy = int(xs[i] // range_m), int(ys[i] // range_m)
+        near = []
+        for gx in (cx - 1, cx, cx + 1):
+            for gy in (cy - 1, cy, cy + 1):
+                for j in cells.get((gx, gy), ()):
+                    dx, dy = xs[j] - xs[i], ys[j] - ys[i]
+                    if j != i and dx * dx + dy * dy <= range_m * range_m:
+                        bearing = math.degrees(math.atan2(dx, dy)) % 360
+                        near.append((j, int((bearing + 45) // 90) % 4))
+        near.sort()
+        targets.extend(j for j, _ in near)
+        dirs.extend(d for _, d in near)
+        offsets.append(len(targets))
+    return offsets, targets, dirs
+
+
+def _pad(n):
+    return (4 - n % 4) % 4
+
+
+def write_topology(path, lamps, range_m=DEFAULT_RANGE):
+    """Write the CSR file; returns (nodes, edges)"""
+    offsets, targets, dirs = build_csr(lamps, range_m)
+    n, m = len(lamps), len(targets)
+    with open(path, 'wb') as f:
+        f.write(HEADER.pack(MAGIC, VERSION, range_m, n, m))
+        f.write(struct.pack(f'<{n}H', *[l[0] for l in lamps]) + b'\0' * _pad(2 * n))
+        f.write(struct.pack(f'<{n}f', *[l[1] for l in lamps]))
+        f.write(struct.pack(f'<{n}f', *[l[2] for l in lamps]))
+        f.write(struct.pack(f'<{n + 1}I', *offsets))
+        f.write(struct.pack(f'<{m}I', *targets))
+        f.write(bytes(dirs) + b'\0' * _pad(m))
+    return n, m
+
+
+class Topology:
+    """Memory-mapped CSR topology; arrays are views into the file, nothing is copied"""
+
+    def __init__(self, path):
+        self._file = open(path, 'rb')
+        self._map = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version, self.range_m, n, m = HEADER.unpack_from(self._map, 0)
+        if magic != MAGIC or version != VERSION:
+            raise ValueError(f"{path}: not a version {VERSION} topology file")
+        self.nodes, self.edges = n, m
+
+        view = memoryview(self._map)
+        pos = HEADER.size
+        self.ids = view[pos:pos + 2 * n].cast('H')
+        pos += 2 * n + _pad(2 * n)
+        self.lat = view[pos:pos + 4 * n].cast('f')
+        pos += 4 * n
+        self.lon = view[pos:pos + 4 * n].cast('f')
+        pos += 4 * n
+        self.offsets = view[pos:pos + 4 * (n + 1)].cast('I')
+        pos += 4 * (n + 1)
+        self.targets = view[pos:pos + 4 * m].cast('I')
+        pos += 4 * m
+        self.dirs = view[pos:pos + m]
+
+    def neighbors(self, i):
+        """(neighbor index, TX direction) pairs of node i"""
+        for e in range(self.offsets[i], self.offsets[i + 1]):
+            yield self.targets[e], self.dirs[e]
+
+    def address(self, i):
+        return f"{self.ids[i]:04X}"
+
+    def close(self):
+        for name in ('ids', 'lat', 'lon', 'offsets', 'targets', 'dirs'):
+            getattr(self, name).release()
+        self._map.close()
+        self._file.close()
+
+
+if __name__ == '__main__':
+    args = sys.argv[1:]
+    range_m = DEFAULT_RANGE
+    if '--range' in args:
+        k = args.index('--range')
+        range_m = int(args[k + 1])
+        del args[k:k + 2]
+
+    if args[:1] == ['--from-db'] and len(args) == 2:
+        lamps, out = read_db_lamps(), args[1]
+    elif len(args) == 2:
+        try:
+            lamps, out = read_lamps(args[0]), args[1]
+        except ValueError as e:
+            print(e)
+            sys.exit(1)
+    else:
+        print(__doc__)
+        sys.exit(1)
+
+    n, m = write_topology(out, lamps, range_m)
+    print(f"{out}: {n} lamps, {m} directed links within {range_m}m")
@@ -0,0 +1,219 @@
+"""IR channel broker for the host emulation: one process per lamp or HQ talks to it.
+
+    python broker.py city.lmt --run DIR [--hq-near ID[:DIR],...] [--loss P]
+                     [--link A-B=P ...] [--seed N]
+
+Every node sends each NEC frame it transmits to <run>/broker.sock as it
+starts (layout in shim/sim.h). The broker forwards it to the neighbors the
+topology file (topology.py) lists for the sender's TX direction and hands
+it over at the moment the frame ends, as a receiver would decode it.
+
+    --hq-near 1000:BACK  place HQ (0000) in lamp 1000's BACK direction; it
+                         reaches 1000 on the opposite one (FRONT). Default
+                         direction BACK; several lamps comma-separated.
+    --loss 0.05          chance any frame is lost on a link
+    --link 1000-1001=0.3 loss on one link (both ways), overrides --loss
+
+Two frames that overlap at a receiver collide and neither arrives. The
+sender's own half-duplex receiver and IRremote's single frame buffer are
+the shim's business, not the broker's. Ctrl-C prints the counters.
+"""
+
+import heapq
+import os
+import random
+import select
+import signal
+import socket
+import struct
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'hq', 'dashboard'))
+from topology import Topology, DIR_NAMES  # noqa: E402
+
+FRAME = struct.Struct('<4sHBBQII')  # Must match SimFrame in shim/sim.h
+MAGIC = b'LMF1'
+HQ_ID = 0x0000
+STATS_EVERY = 60  # Seconds
+
+
+def now_us():
+    """Host CLOCK_MONOTONIC, the clock the nodes stamp frames with"""
+    return time.monotonic_ns() // 1000
+
+
+def _direction(text):
+    text = text.strip().upper()
+    if text in DIR_NAMES:
+        return DIR_NAMES.index(text)
+    if text in ('0', '1', '2', '3'):
+        return int(text)
+    raise ValueError(f"bad direction '{text}' (FRONT, RIGHT, BACK, LEFT or 0-3)")
+
+
+def _link_key(a, b):
+    return (a, b) if a < b else (b, a)
+
+
+class Channel:
+    """Who hears whom in which direction, and how lossy each link is"""
+
+    def __init__(self, topology, hq_near=(), loss=0.0, link_loss=None):
+        self.loss = loss
+        self.link_loss = link_loss or {}
+        self.reach = {}  # (src address, dir) -> [receiver address]
+        for i in range(topology.nodes):
+            src = topology.ids[i]
+            for j, d in topology.neighbors(i):
+                self.reach.setdefault((src, d), []).append(topology.ids[j])
+        self.addresses = set(topology.ids)
+
+        if hq_near and HQ_ID in self.addresses:
+            raise ValueError("HQ 0000 is in the topology already; drop --hq-near")
+        for lamp, d in hq_near:
+            if lamp not in self.addresses:
+                raise ValueError(f"--hq-near: lamp {lamp:04X} is not in the topology")
+            self.reach.setdefault((lamp, d), []).append(HQ_ID)
+            self.reach.setdefault((HQ_ID, (d + 2) % 4), []).append(lamp)
+        if hq_near:
+            self.addresses.add(HQ_ID)
+
+    def receivers(self, src, d):
+        return self.reach.get((src, d), ())
+
+    def lost(self, src, dst):
+        return random.random() < self.link_loss.get(_link_key(src, dst), self.loss)
+
+
+class Broker:
+    def __init__(self, channel, run_dir):
+        self.channel = channel
+        self.run_dir = run_dir
+        self.pending = []     # Heap of (end us, seq, receiver, frame bytes)
+        self.on_air = {}      # Receiver -> [[start, end, src, collided]] not yet handed over
+        self.seq = 0
+        self.stats = dict(frames=0, deliveries=0, lost=0, collided=0, offline=0, unknown=0)
+
+        self.path = os.path.join(run_dir, 'broker.sock')
+        if os.path.exists(self.path):
+            os.unlink(self.path)
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self.sock.bind(self.path)
+
+    def node_path(self, address):
+        return os.path.join(self.run_dir, f"{address:04X}.sock")
+
+    def receive(self, data):
+        """Schedule one transmitted frame at every receiver it reaches"""
+        if len(data) != FRAME.size:
+            return
+        magic, src, d, _, start, raw, duration = FRAME.unpack(data)
+        if magic != MAGIC:
+            return
+        self.stats['frames'] += 1
+        if src not in self.channel.addresses:
+            self.stats['unknown'] += 1
+            return
+
+        end = start + duration
+        for dst in self.channel.receivers(src, d & 3):
+            if self.channel.lost(src, dst):
+                self.stats['lost'] += 1
+                continue
+            entry = [start, end, src, False]
+            for other in self.on_air.get(dst, ()):
+                if other[2] != src and other[0] < end and start < other[1]:
+                    other[3] = entry[3] = True
+            self.on_air.setdefault(dst, []).append(entry)
+            heapq.heappush(self.pending, (end, self.seq, dst, data, entry))
+            self.seq += 1
+
+    def deliver_due(self):
+        """Hand over every frame that has ended; ms until the next one (None: nothing pending)"""
+        now = now_us()
+        while self.pending and self.pending[0][0] <= now:
+            _, _, dst, data, entry = heapq.heappop(self.pending)
+            self.on_air[dst].remove(entry)
+            if entry[3]:
+                self.stats['collided'] += 1
+                continue
+            try:
+                self.sock.sendto(data, self.node_path(dst))
+                self.stats['deliveries'] += 1
+            except (FileNotFoundError, ConnectionRefusedError, BlockingIOError):
+                self.stats['offline'] += 1  # Node not running (or not keeping up)
+        if not self.pending:
+            return None
+        return max(0, (self.pending[0][0] - now) / 1000)
+
+    def report(self):
+        s = self.stats
+        print(f"[broker] frames {s['frames']}  delivered {s['deliveries']}  lost {s['lost']}  "
+              f"collided {s['collided']}  offline {s['offline']}  unknown sender {s['unknown']}",
+              flush=True)
+
+    def run(self):
+        next_report = time.monotonic() + STATS_EVERY
+        while True:
+            wait = self.deliver_due()
+            timeout = min(wait / 1000, 1.0) if wait is not None else 1.0
+            readable, _, _ = select.select([self.sock], [], [], timeout)
+            if readable:
+                self.receive(self.sock.recv(64))
+            if time.monotonic() >= next_report:
+                self.report()
+                next_report += STATS_EVERY
+
+
+def _parse_args(args):
+    opts = dict(run=None, hq_near=[], loss=0.0, link_loss={}, seed=None)
+    positional = []
+    it = iter(args)
+    for arg in it:
+        if arg == '--run':
+            opts['run'] = next(it)
+        elif arg == '--hq-near':
+            for item in next(it).split(','):
+                lamp, _, d = item.partition(':')
+                opts['hq_near'].append((int(lamp, 16), _direction(d or 'BACK')))
+        elif arg == '--loss':
+            opts['loss'] = float(next(it))
+        elif arg == '--link':
+            pair, _, p = next(it).partition('=')
+            a, _, b = pair.partition('-')
+            opts['link_loss'][_link_key(int(a, 16), int(b, 16))] = float(p)
+        elif arg == '--seed':
+            opts['seed'] = int(next(it))
+        else:
+            positional.append(arg)
+    if len(positional) != 1 or not opts['run']:
+        raise ValueError("expected a topology file and --run DIR")
+    return positional[0], opts
+
+
+if __name__ == '__main__':
+    try:
+        path, opts = _parse_args(sys.argv[1:])
+        topology = Topology(path)
+        channel = Channel(topology, opts['hq_near'], opts['loss'], opts['link_loss'])
+    except (ValueError, StopIteration, OSError) as e:
+        print(e if str(e) else "missing option value")
+        print(__doc__)
+        sys.exit(1)
+
+    random.seed(opts['seed'])
+    os.makedirs(opts['run'], exist_ok=True)
+    broker = Broker(channel, opts['run'])
+    print(f"[broker] {topology.nodes} lamps, {topology.edges} links, "
+          f"{'HQ placed' if opts['hq_near'] else 'no HQ placed'}; listening on {broker.path}",
+          flush=True)
+
+    signal.signal(signal.SIGTERM, lambda *_: sys.exit(0))
+    try:
+        broker.run()
+    except (KeyboardInterrupt, SystemExit):
+        pass
+    finally:
+        broker.report()
+        os.unlink(broker.path)
@@ -0,0 +1,9 @@
+/*
+ * HQ Sketch for the Host (src/hq/arduino)
+ */
+
+#include "../hq/arduino/main.ino"
+#include "shim/sim.h"
+
+const int simTxPins[4] = {IR_TX_FRONT, IR_TX_RIGHT, IR_TX_BACK, IR_TX_LEFT};
+const int simButtonPin = -1;
@@ -0,0 +1,10 @@
+/*
+ * Lamp Sketch for the Host (structure/v3/upg)
+ * Built with -DNODE_ID=simNodeId, so one binary serves every lamp address
+ */
+
+#include "../../structure/v3/upg/main.ino"
+#include "shim/sim.h"
+
+const int simTxPins[4] = {IR_TX_FRONT, IR_TX_RIGHT, IR_TX_BACK, IR_TX_LEFT};
+const int simButtonPin = SOS_PIN;
@@ -0,0 +1,156 @@
+"""Emulate a city: the channel broker, the HQ and one process per lamp of a topology file.
+
+    python run.py city.lmt [--run DIR] [--hq-near ID[:DIR],...] [--loss P] [--link A-B=P]
+                           [--seed N] [--only ID,ID,...]
+
+Builds the host binaries (make), starts broker.py with the broker options,
+then build/hq --pty and one build/lamp per lamp (or just the --only ones).
+Each node's output goes to <run>/<id>.log; the HQ's serial port is the pty
+linked as <run>/0000.pty, so the dashboard attaches with
+
+    HQ_SERIAL_PORT=<run>/0000.pty python app.py
+
+Commands on stdin:
+    press ID          press the lamp's SOS button
+    battery ID RAW    set the battery divider reading (A0, 0-1023)
+    pin ID N 0|1      set any digital input
+    reboot ID         restart the node (EEPROM and OTA flash are kept)
+    kill ID / start ID
+    status
+    quit
+"""
+
+import os
+import shlex
+import subprocess
+import sys
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, '..', 'hq', 'dashboard'))
+from topology import Topology  # noqa: E402
+
+HQ = '0000'
+BROKER_OPTIONS = ('--hq-near', '--loss', '--link', '--seed')
+
+
+class City:
+    def __init__(self, topology_path, run_dir, broker_args, only=None):
+        self.run_dir = run_dir
+        self.processes = {}  # Id -> Popen
+        topology = Topology(topology_path)
+        self.lamps = [topology.address(i) for i in range(topology.nodes)]
+        topology.close()
+        if only:
+            self.lamps = [lamp for lamp in self.lamps if lamp in only]
+        self.broker = subprocess.Popen(
+            [sys.executable, os.path.join(HERE, 'broker.py'), topology_path, '--run', run_dir] + broker_args)
+
+    def start(self, node):
+        if node in self.processes and self.processes[node].poll() is None:
+            return
+        binary = os.path.join(HERE, 'build', 'hq' if node == HQ else 'lamp')
+        args = [binary, '--id', node, '--run', self.run_dir] + (['--pty'] if node == HQ else [])
+        log = open(os.path.join(self.run_dir, f"{node}.log"), 'a')
+        self.processes[node] = subprocess.Popen(args, stdin=subprocess.PIPE, stdout=log,
+                                                stderr=subprocess.STDOUT, text=True)
+        log.close()
+
+    def send(self, node, command):
+        process = self.processes.get(node)
+        if process is None or process.poll() is not None:
+            print(f"{node} is not running")
+            return
+        process.stdin.write(command + '\n')
+        process.stdin.flush()
+
+    def kill(self, node):
+        process = self.processes.get(node)
+        if process is not None and process.poll() is None:
+            process.terminate()
+            process.wait()
+
+    def status(self):
+        running = [n for n, p in self.processes.items() if p.poll() is None]
+        stopped = [n for n, p in self.processes.items() if p.poll() is not None]
+        print(f"running {len(running)}: {' '.join(sorted(running))}")
+        if stopped:
+            print(f"stopped {len(stopped)}: {' '.join(sorted(stopped))}")
+
+    def stop(self):
+        for node in list(self.processes):
+            self.kill(node)
+        self.broker.terminate()
+        self.broker.wait()
+
+
+def _parse_args(args):
+    run_dir, only, broker_args, positional = os.path.join(HERE, 'run'), None, [], []
+    it = iter(args)
+    for arg in it:
+        if arg == '--run':
+            run_dir = next(it)
+        elif arg == '--only':
+            only = {a.strip().upper() for a in next(it).split(',')}
+        elif arg in BROKER_OPTIONS:
+            broker_args += [arg, next(it)]
+        else:
+            positional.append(arg)
+    if len(positional) != 1:
+        raise ValueError("expected one topology file")
+    return positional[0], os.path.abspath(run_dir), broker_args, only
+
+
+def command_loop(city):
+    for line in sys.stdin:
+        words = shlex.split(line)
+        if not words:
+            continue
+        cmd, node = words[0], (words[1].upper() if len(words) > 1 else None)
+        if cmd == 'quit':
+            return
+        elif cmd == 'status':
+            city.status()
+        elif cmd == 'press' and node:
+            city.send(node, 'press')
+        elif cmd == 'battery' and len(words) == 3:
+            city.send(node, f"analog 17 {int(words[2])}")  # A0 in the shim
+        elif cmd == 'pin' and len(words) == 4:
+            city.send(node, f"pin {int(words[2])} {int(words[3])}")
+        elif cmd == 'reboot' and node:
+            city.send(node, 'reboot')
+        elif cmd == 'kill' and node:
+            city.kill(node)
+        elif cmd == 'start' and node:
+            city.start(node)
+        else:
+            print("press ID | battery ID RAW | pin ID N V | reboot ID | kill ID | start ID | status | quit")
+
+
+if __name__ == '__main__':
+    try:
+        path, run_dir, broker_args, only = _parse_args(sys.argv[1:])
+    except (ValueError, StopIteration) as e:
+        print(e if str(e) else "missing option value")
+        print(__doc__)
+        sys.exit(1)
+
+    if subprocess.call(['make', '-s', '-C', HERE]) != 0:
+        sys.exit(1)
+    os.makedirs(run_dir, exist_ok=True)
+
+    city = City(path, run_dir, broker_args, only)
+    time.sleep(0.5)  # Broker socket first, or the first frames go nowhere
+    if city.broker.poll() is not None:
+        sys.exit(1)
+    for node in [HQ] + city.lamps:
+        city.start(node)
+    print(f"{len(city.lamps)} lamps and HQ running; logs in {run_dir}")
+    print(f"HQ serial: {os.path.join(run_dir, HQ + '.pty')}")
+
+    try:
+        command_loop(city)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        city.stop()
@@ -0,0 +1,332 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+/*
+ * Host Shim: Arduino Core
+ * Just enough of the ESP8266 Arduino core to run the lamp and HQ sketches
+ * as Linux processes. Time is the host's monotonic clock since boot, pins
+ * are plain variables set from the control input (see sim.h), Serial is
+ * stdout plus an optional pty.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+#include <type_traits>
+
+// ==================== CONSTANTS ====================
+
+#define HIGH 1
+#define LOW  0
+
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+#define RISING  1
+#define FALLING 2
+#define CHANGE  3
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// NodeMCU pin names (GPIO numbers, as on the board)
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+#define A0 17
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Node address, set from --id before setup() (the lamp build passes -DNODE_ID=simNodeId)
+extern const char *simNodeId;
+
+// ==================== STRING ====================
+
+class String {
+public:
+  String() {}
+  String(const char *c) : s(c ? c : "") {}
+  String(const std::string &x) : s(x) {}
+  String(char c) : s(1, c) {}
+  String(unsigned char v, unsigned char base = 10) { fromUnsigned(v, base); }
+  String(int v, unsigned char base = 10) { fromSigned(v, base); }
+  String(unsigned int v, unsigned char base = 10) { fromUnsigned(v, base); }
+  String(long v, unsigned char base = 10) { fromSigned(v, base); }
+  String(unsigned long v, unsigned char base = 10) { fromUnsigned(v, base); }
+  String(long long v, unsigned char base = 10) { fromSigned(v, base); }
+  String(unsigned long long v, unsigned char base = 10) { fromUnsigned(v, base); }
+  String(float v, unsigned char digits = 2) { fromDouble(v, digits); }
+  String(double v, unsigned char digits = 2) { fromDouble(v, digits); }
+
+  unsigned int length() const { return s.size(); }
+  bool isEmpty() const { return s.empty(); }
+  const char *c_str() const { return s.c_str(); }
+  void reserve(unsigned int n) { s.reserve(n); }
+
+  char operator[](unsigned int i) const { return i < s.size() ? s[i] : 0; }
+  char &operator[](unsigned int i) { static char dummy; return i < s.size() ? s[i] : (dummy = 0); }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+  void setCharAt(unsigned int i, char c) { if (i < s.size()) s[i] = c; }
+
+  String substring(unsigned int from) const { return substring(from, s.size()); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) { unsigned int t = from; from = to; to = t; }
+    if (from >= s.size()) return String();
+    if (to > s.size()) to = s.size();
+    return String(s.substr(from, to - from));
+  }
+
+  int indexOf(char c, unsigned int from = 0) const { return pos(s.find(c, from)); }
+  int indexOf(const String &x, unsigned int from = 0) const { return pos(s.find(x.s, from)); }
+  int lastIndexOf(char c) const { return pos(s.rfind(c)); }
+  int lastIndexOf(char c, unsigned int from) const { return pos(s.rfind(c, from)); }
+  int lastIndexOf(const String &x) const { return pos(s.rfind(x.s)); }
+
+  bool startsWith(const String &p) const { return s.compare(0, p.s.size(), p.s) == 0; }
+  bool startsWith(const String &p, unsigned int offset) const {
+    return offset <= s.size() && s.compare(offset, p.s.size(), p.s) == 0;
+  }
+  bool endsWith(const String &p) const {
+    return s.size() >= p.s.size() && s.compare(s.size() - p.s.size(), p.s.size(), p.s) == 0;
+  }
+  bool equals(const String &o) const { return s == o.s; }
+  bool equalsIgnoreCase(const String &o) const { return strcasecmp(s.c_str(), o.s.c_str()) == 0; }
+  int compareTo(const String &o) const { return s.compare(o.s); }
+
+  long toInt() const { return atol(s.c_str()); }
+  float toFloat() const { return atof(s.c_str()); }
+  double toDouble() const { return atof(s.c_str()); }
+
+  void trim() {
+    size_t a = 0, b = s.size();
+    while (a < b && isspace((unsigned char)s[a])) a++;
+    while (b > a && isspace((unsigned char)s[b - 1])) b--;
+    s = s.substr(a, b - a);
+  }
+  void toUpperCase() { for (char &c : s) c = toupper((unsigned char)c); }
+  void toLowerCase() { for (char &c : s) c = tolower((unsigned char)c); }
+  void remove(unsigned int i) { if (i < s.size()) s.erase(i); }
+  void remove(unsigned int i, unsigned int n) { if (i < s.size()) s.erase(i, n); }
+  void replace(const String &from, const String &to) {
+    if (from.s.empty()) return;
+    for (size_t p = s.find(from.s); p != std::string::npos; p = s.find(from.s, p + to.s.size())) {
+      s.replace(p, from.s.size(), to.s);
+    }
+  }
+  void getBytes(unsigned char *buf, unsigned int size, unsigned int index = 0) const {
+    toCharArray((char *)buf, size, index);
+  }
+  void toCharArray(char *buf, unsigned int size, unsigned int index = 0) const {
+    if (size == 0) return;
+    size_t n = index < s.size() ? s.size() - index : 0;
+    if (n > size - 1) n = size - 1;
+    if (n) memcpy(buf, s.data() + index, n);
+    buf[n] = 0;
+  }
+
+  template <class T> bool concat(const T &v) { *this += v; return true; }
+
+  String &operator+=(const String &o) { s += o.s; return *this; }
+  String &operator+=(const char *o) { if (o) s += o; return *this; }
+  String &operator+=(char c) { s += c; return *this; }
+  String &operator+=(unsigned char v) { return *this += String(v); }
+  String &operator+=(int v) { return *this += String(v); }
+  String &operator+=(unsigned int v) { return *this += String(v); }
+  String &operator+=(long v) { return *this += String(v); }
+  String &operator+=(unsigned long v) { return *this += String(v); }
+  String &operator+=(float v) { return *this += String(v); }
+  String &operator+=(double v) { return *this += String(v); }
+
+  bool operator==(const String &o) const { return s == o.s; }
+  bool operator==(const char *o) const { return s == (o ? o : ""); }
+  bool operator!=(const String &o) const { return s != o.s; }
+  bool operator!=(const char *o) const { return !(*this == o); }
+  bool operator<(const String &o) const { return s < o.s; }
+  bool operator>(const String &o) const { return s > o.s; }
+  bool operator<=(const String &o) const { return s <= o.s; }
+  bool operator>=(const String &o) const { return s >= o.s; }
+
+  std::string s;
+
+private:
+  static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+  void fromUnsigned(unsigned long long v, unsigned char base) {
+    if (base < 2 || base > 36) base = 10;
+    char buf[66];
+    int i = 65;
+    buf[i] = 0;
+    do { int d = v % base; buf[--i] = d < 10 ? '0' + d : 'a' + d - 10; v /= base; } while (v);
+    s = buf + i;
+  }
+  void fromSigned(long long v, unsigned char base) {
+    if (v < 0 && base == 10) { fromUnsigned(-(unsigned long long)v, 10); s.insert(0, 1, '-'); }
+    else fromUnsigned(base == 10 ? (unsigned long long)v : (unsigned long long)(unsigned long)v, base);
+  }
+  void fromDouble(double v, unsigned char digits) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", digits, v);
+    s = buf;
+  }
+};
+
+inline String operator+(const String &a, const String &b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, const char *b) { String r(a); r += b; return r; }
+inline String operator+(const char *a, const String &b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, char b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, unsigned char b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, int b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, unsigned int b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, long b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, unsigned long b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, float b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, double b) { String r(a); r += b; return r; }
+inline bool operator==(const char *a, const String &b) { return b == a; }
+inline bool operator!=(const char *a, const String &b) { return b != a; }
+
+// ==================== SERIAL ====================
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t n) {
+    for (size_t i = 0; i < n; i++) write(buf[i]);
+    return n;
+  }
+  size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+
+  size_t print(const String &v) { return write((const uint8_t *)v.c_str(), v.length()); }
+  size_t print(const char *v) { return write(v); }
+  size_t print(char v) { return write((uint8_t)v); }
+  size_t print(unsigned char v, int base = DEC) { return print(String(v, base)); }
+  size_t print(int v, int base = DEC) { return print(number(v, base)); }
+  size_t print(unsigned int v, int base = DEC) { return print(number(v, base)); }
+  size_t print(long v, int base = DEC) { return print(number(v, base)); }
+  size_t print(unsigned long v, int base = DEC) { return print(number(v, base)); }
+  size_t print(long long v, int base = DEC) { return print(number(v, base)); }
+  size_t print(unsigned long long v, int base = DEC) { return print(number(v, base)); }
+  size_t print(double v, int digits = 2) { return print(String(v, digits)); }
+
+  size_t println() { return write("\r\n"); }
+  template <class T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+  template <class T> size_t println(const T &v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+private:
+  // Arduino prints hex digits in upper case; negative numbers only in decimal
+  template <class T> static String number(T v, int base) {
+    String r = (base == DEC) ? String(v) : String((unsigned long long)v & mask(sizeof(T)), base);
+    if (base != DEC) r.toUpperCase();
+    return r;
+  }
+  static unsigned long long mask(size_t bytes) {
+    return bytes >= 8 ? ~0ULL : (1ULL << (bytes * 8)) - 1;
+  }
+};
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long) {}
+  void end() {}
+  void flush() {}
+  int available();
+  int read();
+  int peek();
+  String readString();
+  String readStringUntil(char terminator);
+  void setTimeout(unsigned long ms) { timeout = ms; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  operator bool() const { return true; }
+
+private:
+  unsigned long timeout = 1000;
+};
+
+extern HardwareSerial Serial;
+
+// ==================== TIME, PINS, INTERRUPTS ====================
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// ==================== MATH AND RANDOM ====================
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+template <class A, class B> inline typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template <class A, class B> inline typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+template <class T, class L, class H> inline T constrain(T x, L lo, H hi) {
+  return x < lo ? (T)lo : (x > hi ? (T)hi : x);
+}
+
+inline bool isDigit(int c) { return isdigit(c) != 0; }
+inline bool isHexadecimalDigit(int c) { return isxdigit(c) != 0; }
+inline bool isAlpha(int c) { return isalpha(c) != 0; }
+inline bool isAlphaNumeric(int c) { return isalnum(c) != 0; }
+
+// ==================== ESP8266 SPECIFICS ====================
+
+// Flash sectors behind the OTA staging area, kept in <run>/<id>.flash
+#define FLASH_SECTOR_SIZE 4096
+extern "C" uint32_t _FS_start;
+extern "C" uint32_t _FS_end;
+
+class EspClass {
+public:
+  uint32_t getChipId();
+  uint32_t getFreeHeap() { return 40000; }
+  uint32_t getCycleCount() { return micros() * 80; }
+  uint32_t getFreeSketchSpace() { return 1 << 20; }
+  bool flashEraseSector(uint32_t sector);
+  bool flashWrite(uint32_t address, uint32_t *data, size_t size);
+  bool flashRead(uint32_t address, uint32_t *data, size_t size);
+  void restart();
+  void reset() { restart(); }
+  void deepSleep(uint64_t) { restart(); }
+};
+
+extern EspClass ESP;
+
+#endif // SIM_ARDUINO_H
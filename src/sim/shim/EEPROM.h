@@ -0,0 +1,36 @@
+#ifndef SIM_EEPROM_H
+#define SIM_EEPROM_H
+
+/*
+ * Host Shim: EEPROM
+ * The emulated sector lives in <run>/<id>.eeprom, so parameters and the
+ * OTA record survive a reboot (ESP.restart, or the node being restarted)
+ */
+
+#include <Arduino.h>
+
+class EEPROMClass {
+public:
+  void begin(size_t size);
+  bool commit();
+  void end() { commit(); }
+  uint8_t read(int address) const { return address >= 0 && (size_t)address < size ? data[address] : 0xFF; }
+  void write(int address, uint8_t value) { if (address >= 0 && (size_t)address < size) data[address] = value; }
+
+  template <typename T> T &get(int address, T &value) {
+    if (address >= 0 && address + sizeof(T) <= size) memcpy(&value, data + address, sizeof(T));
+    return value;
+  }
+  template <typename T> const T &put(int address, const T &value) {
+    if (address >= 0 && address + sizeof(T) <= size) memcpy(data + address, &value, sizeof(T));
+    return value;
+  }
+
+private:
+  uint8_t data[4096];
+  size_t size = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // SIM_EEPROM_H
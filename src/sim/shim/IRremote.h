@@ -0,0 +1,54 @@
+#ifndef SIM_IRREMOTE_H
+#define SIM_IRREMOTE_H
+
+/*
+ * Host Shim: IRremote
+ * Every NEC frame goes to the channel broker as one datagram, stamped with
+ * its start time and airtime on the host's monotonic clock; the broker
+ * hands it to the neighbors in the TX direction when the frame would end.
+ * Like the real receiver, one decoded frame is held until resume(), and
+ * frames are lost while it is held, stopped, or while we transmit.
+ */
+
+#include <Arduino.h>
+
+#define UNKNOWN 0
+#define NEC     8
+#define ONKYO   9
+
+#define ENABLE_LED_FEEDBACK  true
+#define DISABLE_LED_FEEDBACK false
+
+struct IRData {
+  uint8_t protocol;
+  uint16_t address;
+  uint16_t command;
+  uint32_t decodedRawData;
+  uint8_t flags;
+};
+
+class IRrecv {
+public:
+  IRData decodedIRData;
+
+  void begin(uint8_t pin, bool ledFeedback = false);
+  void start();
+  void stop();
+  void end() { stop(); }
+  bool isIdle();
+  bool decode();
+  void resume();
+  void registerReceiveCompleteCallback(void (*callback)());
+};
+
+class IRsend {
+public:
+  void begin(uint8_t pin, bool ledFeedback = false);
+  void sendNEC(uint16_t address, uint16_t command, int_fast8_t repeats);
+  void sendNECRaw(uint32_t raw, int_fast8_t repeats = 0);
+};
+
+extern IRrecv IrReceiver;
+extern IRsend IrSender;
+
+#endif // SIM_IRREMOTE_H
@@ -0,0 +1,25 @@
+#ifndef SIM_SOFTWARESERIAL_H
+#define SIM_SOFTWARESERIAL_H
+
+/*
+ * Host Shim: SoftwareSerial
+ * The visible-light channel is not emulated: what is sent goes nowhere
+ * and nothing is ever received, as with VLC_ENABLED 0
+ */
+
+#include <Arduino.h>
+
+enum SoftwareSerialConfig { SWSERIAL_8N1 = 3 };
+
+class SoftwareSerial : public Print {
+public:
+  void begin(uint32_t, SoftwareSerialConfig, int8_t, int8_t, bool = false, int = 64, int = 0) {}
+  int available() { return 0; }
+  int read() { return -1; }
+  void flush() {}
+  void enableRx(bool) {}
+  size_t write(uint8_t) override { return 1; }
+  using Print::write;
+};
+
+#endif // SIM_SOFTWARESERIAL_H
@@ -0,0 +1,26 @@
+#ifndef SIM_UPDATER_H
+#define SIM_UPDATER_H
+
+/*
+ * Host Shim: Updater
+ * An installed image is written to <run>/<id>.bin; the process keeps
+ * running the host build, so only the OTA bookkeeping is exercised
+ */
+
+#include <Arduino.h>
+
+class UpdaterClass {
+public:
+  bool begin(size_t size);
+  size_t write(uint8_t *data, size_t length);
+  bool end(bool evenIfRemaining = false);
+
+private:
+  FILE *file = nullptr;
+  size_t expected = 0;
+  size_t written = 0;
+};
+
+extern UpdaterClass Update;
+
+#endif // SIM_UPDATER_H
@@ -0,0 +1,132 @@
+/*
+ * Host Shim: ESP8266 Flash, EEPROM and Updater
+ * Each is backed by a file in the run directory, so a rebooted node finds
+ * what it had committed before
+ */
+
+#include "sim.h"
+#include <EEPROM.h>
+#include <Updater.h>
+
+EspClass ESP;
+EEPROMClass EEPROM;
+UpdaterClass Update;
+
+// ==================== FLASH ====================
+
+/*
+ * The OTA staging area between _FS_start and _FS_end
+ * The sketch turns &_FS_start into a flash offset the ESP8266 way
+ * (address - 0x40200000); the same is undone here to find the byte
+ */
+#define SIM_FS_SIZE 524288
+#define SIM_STR(x) #x
+#define SIM_XSTR(x) SIM_STR(x)
+
+extern "C" {
+  uint8_t simFsArea[SIM_FS_SIZE] __attribute__((aligned(FLASH_SECTOR_SIZE)));
+}
+__asm__(".globl _FS_start\n.set _FS_start, simFsArea\n"
+        ".globl _FS_end\n.set _FS_end, simFsArea + " SIM_XSTR(SIM_FS_SIZE) "\n");
+
+static FILE *flashFile = nullptr;
+
+static uint8_t *flashAt(uint32_t address, size_t size){
+  uint32_t base = (uint32_t)(uintptr_t)&_FS_start - 0x40200000;
+  uint32_t offset = address - base;
+  if (offset > SIM_FS_SIZE || size > SIM_FS_SIZE - offset) return nullptr;
+
+  if (!flashFile) {
+    memset(simFsArea, 0xFF, SIM_FS_SIZE);
+    String path = simRunPath(".flash");
+    flashFile = fopen(path.c_str(), "r+b");
+    if (flashFile) {
+      size_t n = fread(simFsArea, 1, SIM_FS_SIZE, flashFile);
+      (void)n;
+    } else {
+      flashFile = fopen(path.c_str(), "w+b");
+      if (!flashFile) return nullptr;
+      fwrite(simFsArea, 1, SIM_FS_SIZE, flashFile);
+    }
+  }
+  return simFsArea + offset;
+}
+
+// Write a changed range back to the file
+static bool flashSync(uint8_t *p, size_t size){
+  return fseek(flashFile, p - simFsArea, SEEK_SET) == 0 &&
+         fwrite(p, 1, size, flashFile) == size && fflush(flashFile) == 0;
+}
+
+bool EspClass::flashEraseSector(uint32_t sector){
+  uint8_t *p = flashAt(sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+  if (!p) return false;
+  memset(p, 0xFF, FLASH_SECTOR_SIZE);
+  return flashSync(p, FLASH_SECTOR_SIZE);
+}
+
+bool EspClass::flashWrite(uint32_t address, uint32_t *data, size_t size){
+  uint8_t *p = flashAt(address, size);
+  if (!p) return false;
+  for (size_t i = 0; i < size; i++) p[i] &= ((uint8_t *)data)[i];  // Flash only clears bits
+  return flashSync(p, size);
+}
+
+bool EspClass::flashRead(uint32_t address, uint32_t *data, size_t size){
+  uint8_t *p = flashAt(address, size);
+  if (!p) return false;
+  memcpy(data, p, size);
+  return true;
+}
+
+uint32_t EspClass::getChipId(){
+  return strtoul(simNodeId, nullptr, 16) * 2654435761u;
+}
+
+void EspClass::restart(){
+  simRestart();
+}
+
+// ==================== EEPROM ====================
+
+void EEPROMClass::begin(size_t length){
+  size = length < sizeof(data) ? length : sizeof(data);
+  memset(data, 0xFF, sizeof(data));  // Erased sector, as on a new board
+
+  FILE *f = fopen(simRunPath(".eeprom").c_str(), "rb");
+  if (!f) return;
+  size_t n = fread(data, 1, size, f);
+  (void)n;
+  fclose(f);
+}
+
+bool EEPROMClass::commit(){
+  FILE *f = fopen(simRunPath(".eeprom").c_str(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(data, 1, size, f) == size;
+  fclose(f);
+  return ok;
+}
+
+// ==================== UPDATER ====================
+
+bool UpdaterClass::begin(size_t size){
+  file = fopen(simRunPath(".bin").c_str(), "wb");
+  expected = size;
+  written = 0;
+  return file != nullptr;
+}
+
+size_t UpdaterClass::write(uint8_t *data, size_t length){
+  if (!file) return 0;
+  size_t n = fwrite(data, 1, length, file);
+  written += n;
+  return n;
+}
+
+bool UpdaterClass::end(bool evenIfRemaining){
+  if (!file) return false;
+  fclose(file);
+  file = nullptr;
+  return evenIfRemaining || written == expected;
+}
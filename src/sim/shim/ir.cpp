@@ -0,0 +1,180 @@
+/*
+ * Host Shim: IR Frames over Unix Datagram Sockets
+ */
+
+#include "sim.h"
+#include <IRremote.h>
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+IRrecv IrReceiver;
+IRsend IrSender;
+
+static int irFd = -1;
+static struct sockaddr_un brokerAddr;
+static bool brokerWarned = false;
+
+// Receiver state: on/off, a decoded frame held until resume()
+static bool rxEnabled = false;
+static bool rxHeld = false;
+static bool rxFresh = false;
+static void (*rxCallback)() = nullptr;
+
+// Transmitter state
+static uint8_t txDir = 0;
+static uint64_t txUntilUs = 0;
+
+// ==================== SOCKET ====================
+
+static void unixAddress(struct sockaddr_un &addr, const String &path){
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+}
+
+void simIrOpen(){
+  irFd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if (irFd < 0) {
+    perror("socket");
+    exit(1);
+  }
+
+  struct sockaddr_un own;
+  String path = simRunPath(".sock");
+  unixAddress(own, path);
+  unlink(path.c_str());
+  if (bind(irFd, (struct sockaddr *)&own, sizeof(own)) < 0) {
+    perror(path.c_str());
+    exit(1);
+  }
+
+  unixAddress(brokerAddr, simRunFile("broker.sock"));
+}
+
+int simIrFd(){
+  return irFd;
+}
+
+// ==================== FRAME TIMING ====================
+
+/*
+ * NEC Airtime of a Frame
+ * 9ms + 4.5ms leader, 32 bits of 1.125ms (0) or 2.25ms (1), 562us stop bit
+ */
+static uint32_t necAirtimeUs(uint32_t raw){
+  return 13500 + 32 * 1125 + __builtin_popcount(raw) * 1125 + 562;
+}
+
+// ==================== RECEIVER ====================
+
+/*
+ * Take one Frame from the Broker (called from simPump)
+ * Lost, as on the board, while the receiver is off, still holds the last
+ * frame, or while this node was transmitting
+ */
+void simIrReceive(){
+  SimFrame f;
+  while (recv(irFd, &f, sizeof(f), 0) == (ssize_t)sizeof(f)) {
+    if (memcmp(f.magic, SIM_FRAME_MAGIC, 4) != 0) continue;
+    if (!rxEnabled || rxHeld || f.startUs < txUntilUs) continue;
+
+    IRData &d = IrReceiver.decodedIRData;
+    uint8_t address = f.raw & 0xFF, addressInv = (f.raw >> 8) & 0xFF;
+    uint8_t command = (f.raw >> 16) & 0xFF, commandInv = f.raw >> 24;
+
+    d.decodedRawData = f.raw;
+    d.flags = 0;
+    if ((command ^ commandInv) == 0xFF) {
+      d.protocol = NEC;
+      d.command = command;
+      d.address = (address ^ addressInv) == 0xFF ? address : (f.raw & 0xFFFF);
+    } else {
+      d.protocol = ONKYO;  // IRremote's name for NEC without command parity
+      d.address = f.raw & 0xFFFF;
+      d.command = f.raw >> 16;
+    }
+
+    rxHeld = true;
+    rxFresh = true;
+    if (rxCallback) rxCallback();
+  }
+}
+
+void IRrecv::begin(uint8_t, bool){
+  start();
+}
+
+void IRrecv::start(){
+  rxEnabled = true;
+  rxHeld = false;
+  rxFresh = false;
+}
+
+void IRrecv::stop(){
+  rxEnabled = false;
+}
+
+bool IRrecv::isIdle(){
+  return !rxHeld;
+}
+
+bool IRrecv::decode(){
+  simPump(0);
+  if (!rxFresh) return false;
+  rxFresh = false;
+  return true;
+}
+
+void IRrecv::resume(){
+  rxHeld = false;
+  rxFresh = false;
+}
+
+void IRrecv::registerReceiveCompleteCallback(void (*callback)()){
+  rxCallback = callback;
+}
+
+// ==================== TRANSMITTER ====================
+
+void IRsend::begin(uint8_t pin, bool){
+  for (int i = 0; i < 4; i++) {
+    if (simTxPins[i] == pin) txDir = i;
+  }
+}
+
+void IRsend::sendNEC(uint16_t address, uint16_t command, int_fast8_t repeats){
+  uint32_t raw = address < 0x100 ? (address | ((uint32_t)(~address & 0xFF) << 8)) : address;
+  raw |= command < 0x100 ? ((uint32_t)(command | ((~command & 0xFF) << 8)) << 16)
+                         : ((uint32_t)command << 16);
+  sendNECRaw(raw, repeats);
+}
+
+/*
+ * Send one Frame and Block for its Airtime
+ * The frame reaches neighbors when it ends; what arrives meanwhile is lost
+ */
+void IRsend::sendNECRaw(uint32_t raw, int_fast8_t){
+  SimFrame f;
+  memcpy(f.magic, SIM_FRAME_MAGIC, 4);
+  f.src = (uint16_t)strtoul(simNodeId, nullptr, 16);
+  f.dir = txDir;
+  f.unused = 0;
+  f.startUs = simNowUs();
+  f.raw = raw;
+  f.durUs = necAirtimeUs(raw);
+  txUntilUs = f.startUs + f.durUs;
+
+  if (sendto(irFd, &f, sizeof(f), 0, (struct sockaddr *)&brokerAddr, sizeof(brokerAddr)) < 0) {
+    if (!brokerWarned) perror("[sim] broker unreachable");
+    brokerWarned = true;
+  } else {
+    brokerWarned = false;
+  }
+
+  while (simNowUs() < txUntilUs) {
+    simPump((int)((txUntilUs - simNowUs() + 999) / 1000));
+  }
+}
@@ -0,0 +1,112 @@
+/*
+ * Host Shim: Serial
+ * Output goes to stdout (the node's log) and, with --pty, to a pseudo
+ * terminal whose slave is linked as <run>/<id>.pty; input is read from
+ * that pty. The dashboard opens the link like a USB serial port.
+ */
+
+#include "sim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <termios.h>
+#include <unistd.h>
+
+HardwareSerial Serial;
+
+static int ptyMaster = -1;
+static int ptySlave = -1;
+static std::string rxBuffer;
+
+void simSerialOpen(bool pty){
+  if (!pty) return;
+
+  ptyMaster = posix_openpt(O_RDWR | O_NOCTTY);
+  if (ptyMaster < 0 || grantpt(ptyMaster) < 0 || unlockpt(ptyMaster) < 0) {
+    perror("posix_openpt");
+    exit(1);
+  }
+  const char *slaveName = ptsname(ptyMaster);
+
+  // Raw bytes both ways, like a USB serial bridge
+  ptySlave = open(slaveName, O_RDWR | O_NOCTTY);  // Kept open: no EIO while nobody is attached
+  struct termios tio;
+  tcgetattr(ptySlave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(ptySlave, TCSANOW, &tio);
+  fcntl(ptyMaster, F_SETFL, fcntl(ptyMaster, F_GETFL) | O_NONBLOCK);
+
+  String link = simRunPath(".pty");
+  unlink(link.c_str());
+  if (symlink(slaveName, link.c_str()) < 0) perror("symlink");
+  fprintf(stderr, "[sim %s] serial on %s (%s)\n", simNodeId, slaveName, link.c_str());
+}
+
+int simSerialFd(){
+  return ptyMaster;
+}
+
+void simSerialReceive(){
+  char buf[256];
+  ssize_t n = read(ptyMaster, buf, sizeof(buf));
+  if (n > 0) rxBuffer.append(buf, n);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t n){
+  fwrite(buf, 1, n, stdout);
+  if (ptyMaster >= 0) {
+    // Nobody reading: drop the backlog rather than stall the sketch
+    if (::write(ptyMaster, buf, n) < 0 && errno == EAGAIN) {
+      tcflush(ptySlave, TCIFLUSH);
+      if (::write(ptyMaster, buf, n) < 0) perror("pty write");
+    }
+  }
+  return n;
+}
+
+int HardwareSerial::available(){
+  if (ptyMaster >= 0 && rxBuffer.empty()) simPump(0);
+  return rxBuffer.size();
+}
+
+int HardwareSerial::peek(){
+  return available() ? (uint8_t)rxBuffer[0] : -1;
+}
+
+int HardwareSerial::read(){
+  if (!available()) return -1;
+  int c = (uint8_t)rxBuffer[0];
+  rxBuffer.erase(0, 1);
+  return c;
+}
+
+String HardwareSerial::readStringUntil(char terminator){
+  String line;
+  unsigned long start = millis();
+  while (millis() - start < timeout) {
+    int c = read();
+    if (c < 0) {
+      simPump(1);
+      continue;
+    }
+    if (c == terminator) break;
+    line += (char)c;
+    start = millis();
+  }
+  return line;
+}
+
+String HardwareSerial::readString(){
+  return readStringUntil(0);
+}
+
+size_t Print::printf(const char *fmt, ...){
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  if (n < 0) return 0;
+  return write((const uint8_t *)buf, n < (int)sizeof(buf) ? n : sizeof(buf) - 1);
+}
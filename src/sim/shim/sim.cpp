@@ -0,0 +1,266 @@
+/*
+ * Host Shim: Process Main, Time, Pins and Control Input
+ *
+ *   node --id 102A --run DIR [--pty] [--battery RAW]
+ *
+ * Runs setup() once and loop() forever. Control commands arrive as lines
+ * on stdin (from run.py or a terminal):
+ *   press              pull the SOS button low for 300ms
+ *   pin <n> <0|1>      set a digital input (fires attached interrupts)
+ *   analog <n> <raw>   set an analog input (A0 = 17: battery divider)
+ *   reboot             restart the process, keeping EEPROM and flash
+ *   quit               exit
+ */
+
+#include "sim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <random>
+
+const char *simNodeId = "0000";
+
+static const char *runDir = ".";
+static char **savedArgv;
+static uint64_t bootUs;
+
+#define SIM_PINS 32
+static uint8_t pinModes[SIM_PINS];
+static uint8_t pinValues[SIM_PINS];
+static int analogValues[SIM_PINS];
+static void (*pinHandlers[SIM_PINS])();
+static int pinHandlerModes[SIM_PINS];
+
+static uint64_t buttonReleaseUs = 0;
+static std::string controlBuffer;
+static bool controlOpen = true;
+
+static std::mt19937 rng;
+
+// ==================== TIME ====================
+
+uint64_t simNowUs(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+unsigned long millis(){
+  return (simNowUs() - bootUs) / 1000;
+}
+
+unsigned long micros(){
+  return simNowUs() - bootUs;
+}
+
+void delay(unsigned long ms){
+  uint64_t until = simNowUs() + ms * 1000ULL;
+  do {
+    uint64_t now = simNowUs();
+    simPump(now >= until ? 0 : (int)((until - now + 999) / 1000));
+  } while (simNowUs() < until);
+}
+
+void delayMicroseconds(unsigned int us){
+  uint64_t until = simNowUs() + us;
+  while (simNowUs() < until) {}
+}
+
+void yield(){
+  simPump(0);
+}
+
+// ==================== PINS ====================
+
+void pinMode(uint8_t pin, uint8_t mode){
+  if (pin >= SIM_PINS) return;
+  pinModes[pin] = mode;
+  if (mode == INPUT_PULLUP) pinValues[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value){
+  if (pin < SIM_PINS && pinModes[pin] == OUTPUT) pinValues[pin] = value ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin){
+  return pin < SIM_PINS ? pinValues[pin] : LOW;
+}
+
+int analogRead(uint8_t pin){
+  return pin < SIM_PINS ? analogValues[pin] : 0;
+}
+
+void analogWrite(uint8_t, int){}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode){
+  if (interrupt >= SIM_PINS) return;
+  pinHandlers[interrupt] = handler;
+  pinHandlerModes[interrupt] = mode;
+}
+
+void detachInterrupt(uint8_t interrupt){
+  if (interrupt < SIM_PINS) pinHandlers[interrupt] = nullptr;
+}
+
+// Drive an input from outside, as the hardware would
+static void setInput(int pin, int value){
+  if (pin < 0 || pin >= SIM_PINS) return;
+  int before = pinValues[pin];
+  pinValues[pin] = value ? HIGH : LOW;
+  if (before == pinValues[pin] || !pinHandlers[pin]) return;
+
+  int mode = pinHandlerModes[pin];
+  if (mode == CHANGE || (mode == FALLING && before == HIGH) || (mode == RISING && before == LOW)) {
+    pinHandlers[pin]();
+  }
+}
+
+// ==================== RANDOM ====================
+
+long random(long howbig){
+  if (howbig <= 0) return 0;
+  return (long)(rng() % (unsigned long)howbig);
+}
+
+long random(long howsmall, long howbig){
+  if (howsmall >= howbig) return howsmall;
+  return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed){
+  if (seed != 0) rng.seed(seed);
+}
+
+// ==================== CONTROL INPUT ====================
+
+static void controlCommand(const std::string &line){
+  char cmd[16] = "";
+  int a = 0, b = 0;
+  int n = sscanf(line.c_str(), "%15s %d %d", cmd, &a, &b);
+  if (n < 1) return;
+
+  if (!strcmp(cmd, "press") && simButtonPin >= 0) {
+    setInput(simButtonPin, LOW);
+    buttonReleaseUs = simNowUs() + 300000;
+  } else if (!strcmp(cmd, "pin") && n == 3) {
+    setInput(a, b);
+  } else if (!strcmp(cmd, "analog") && n == 3 && a >= 0 && a < SIM_PINS) {
+    analogValues[a] = b;
+  } else if (!strcmp(cmd, "reboot")) {
+    simRestart();
+  } else if (!strcmp(cmd, "quit")) {
+    exit(0);
+  } else {
+    fprintf(stderr, "[sim %s] unknown command: %s\n", simNodeId, line.c_str());
+  }
+}
+
+static void controlReceive(){
+  char buf[256];
+  ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+  if (n <= 0) {
+    if (n == 0 || (errno != EAGAIN && errno != EINTR)) controlOpen = false;
+    return;
+  }
+  controlBuffer.append(buf, n);
+
+  size_t end;
+  while ((end = controlBuffer.find('\n')) != std::string::npos) {
+    std::string line = controlBuffer.substr(0, end);
+    controlBuffer.erase(0, end + 1);
+    controlCommand(line);
+  }
+}
+
+// ==================== EVENT PUMP ====================
+
+/*
+ * Wait up to timeoutMs for input and handle all of it
+ * Called from delay() and yield(), so frames and button presses reach the
+ * sketch's interrupt handlers while it waits, as on the board
+ */
+void simPump(int timeoutMs){
+  struct pollfd fds[3];
+  int n = 0;
+  fds[n++] = {simIrFd(), POLLIN, 0};
+  if (simSerialFd() >= 0) fds[n++] = {simSerialFd(), POLLIN, 0};
+  if (controlOpen) fds[n++] = {STDIN_FILENO, POLLIN, 0};
+
+  if (buttonReleaseUs) {
+    uint64_t now = simNowUs();
+    int untilRelease = now >= buttonReleaseUs ? 0 : (int)((buttonReleaseUs - now) / 1000);
+    if (untilRelease < timeoutMs) timeoutMs = untilRelease;
+  }
+
+  if (poll(fds, n, timeoutMs) > 0) {
+    for (int i = 0; i < n; i++) {
+      if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+      if (fds[i].fd == simIrFd()) simIrReceive();
+      else if (fds[i].fd == STDIN_FILENO) controlReceive();
+      else simSerialReceive();
+    }
+  }
+
+  if (buttonReleaseUs && simNowUs() >= buttonReleaseUs) {
+    buttonReleaseUs = 0;
+    setInput(simButtonPin, HIGH);
+  }
+}
+
+// ==================== PROCESS ====================
+
+String simRunPath(const char *suffix){
+  return String(runDir) + "/" + simNodeId + suffix;
+}
+
+String simRunFile(const char *name){
+  return String(runDir) + "/" + name;
+}
+
+void simRestart(){
+  fflush(stdout);
+  execv("/proc/self/exe", savedArgv);
+  perror("execv");
+  exit(1);
+}
+
+static void usage(const char *prog){
+  fprintf(stderr, "usage: %s --id ID --run DIR [--pty] [--battery RAW]\n", prog);
+  exit(2);
+}
+
+int main(int argc, char **argv){
+  savedArgv = argv;
+  bool pty = false;
+  int battery = 1023;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--id") && i + 1 < argc) simNodeId = argv[++i];
+    else if (!strcmp(argv[i], "--run") && i + 1 < argc) runDir = argv[++i];
+    else if (!strcmp(argv[i], "--battery") && i + 1 < argc) battery = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--pty")) pty = true;
+    else usage(argv[0]);
+  }
+  if (strlen(simNodeId) != 4) usage(argv[0]);
+
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  signal(SIGPIPE, SIG_IGN);
+  fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+  bootUs = simNowUs();
+  rng.seed(strtoul(simNodeId, nullptr, 16) ^ getpid());
+  for (int i = 0; i < SIM_PINS; i++) analogValues[i] = battery;
+
+  simSerialOpen(pty);
+  simIrOpen();
+
+  setup();
+  for (;;) {
+    loop();
+    simPump(0);
+  }
+}
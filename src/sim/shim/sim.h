@@ -0,0 +1,69 @@
+#ifndef SIM_SIM_H
+#define SIM_SIM_H
+
+/*
+ * Host Shim: Process Glue
+ * Shared by the shim's translation units and the build wrappers
+ * (lamp.cpp, hq.cpp). Not included by the sketches.
+ */
+
+#include <Arduino.h>
+
+// ==================== BROKER PROTOCOL ====================
+
+/*
+ * One datagram per NEC frame, node <-> broker (little-endian, 24 bytes)
+ *   magic   "LMF1"
+ *   src     sender address (0x102A = "102A")
+ *   dir     TX direction 0-3 (FRONT, RIGHT, BACK, LEFT)
+ *   unused  0
+ *   startUs host CLOCK_MONOTONIC when the frame started
+ *   raw     32-bit NEC frame as IRremote's decodedRawData
+ *   durUs   airtime of the frame
+ * Nodes bind <run>/<id>.sock and send to <run>/broker.sock; the broker
+ * sends to <run>/<id>.sock, so nothing needs registering.
+ * Must match FRAME in broker.py
+ */
+struct __attribute__((packed)) SimFrame {
+  char magic[4];
+  uint16_t src;
+  uint8_t dir;
+  uint8_t unused;
+  uint64_t startUs;
+  uint32_t raw;
+  uint32_t durUs;
+};
+
+#define SIM_FRAME_MAGIC "LMF1"
+
+// ==================== BUILD WRAPPER HOOKS ====================
+
+// TX pins in direction order, from the sketch's config.h
+extern const int simTxPins[4];
+
+// Pushbutton pulled low by the "press" control command (-1: none)
+extern const int simButtonPin;
+
+// Sketch entry points
+void setup();
+void loop();
+
+// ==================== SHIM INTERNALS ====================
+
+uint64_t simNowUs();                     // Host monotonic clock
+String simRunPath(const char *suffix);   // <run dir>/<node id><suffix>
+String simRunFile(const char *name);     // <run dir>/<name>
+void simPump(int timeoutMs);             // Wait for and handle socket, pty and control input
+void simRestart();                       // Re-exec the process (ESP.restart)
+
+// IR socket (ir.cpp)
+void simIrOpen();
+int simIrFd();
+void simIrReceive();
+
+// Serial pty (serial.cpp)
+void simSerialOpen(bool pty);
+int simSerialFd();
+void simSerialReceive();
+
+#endif // SIM_SIM_H
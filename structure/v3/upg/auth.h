@@ -0,0 +1,114 @@
+#ifndef AUTH_H
+#define AUTH_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ==================== MESSAGE AUTHENTICATION ====================
+
+/*
+ * Keyed Tag for HQ-Originated Packets (MESH_AUTH)
+ * SipHash-2-4 under MESH_KEY over [src][dst][type] + message, truncated
+ * to the 16-bit hash field of Types 1, 2 and A. Same airtime as
+ * simpleHash, but a node without the key cannot produce a valid field,
+ * so the first lamp to hear a forged HQ alert drops it instead of
+ * flooding it. Fields relays rewrite (CONFIG delay, retry counter)
+ * are not covered.
+ *
+ * The tag is absorbed one char at a time as the message segment arrives
+ * (see irReceiveString), so checking it costs no second pass.
+ */
+
+#define SIP_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+inline void sipRound(SipState &s){
+  s.v0 += s.v1; s.v1 = SIP_ROTL(s.v1, 13); s.v1 ^= s.v0; s.v0 = SIP_ROTL(s.v0, 32);
+  s.v2 += s.v3; s.v3 = SIP_ROTL(s.v3, 16); s.v3 ^= s.v2;
+  s.v0 += s.v3; s.v3 = SIP_ROTL(s.v3, 21); s.v3 ^= s.v0;
+  s.v2 += s.v1; s.v1 = SIP_ROTL(s.v1, 17); s.v1 ^= s.v2; s.v2 = SIP_ROTL(s.v2, 32);
+}
+
+/*
+ * Start a Tag (keys from MESH_KEY, little-endian)
+ */
+inline void sipInit(SipState &s){
+  uint64_t k0 = 0, k1 = 0;
+  for(int i = 7; i >= 0; i--){
+    k0 = (k0 << 8) | MESH_KEY[i];
+    k1 = (k1 << 8) | MESH_KEY[i + 8];
+  }
+  s.v0 = k0 ^ 0x736f6d6570736575ULL;
+  s.v1 = k1 ^ 0x646f72616e646f6dULL;
+  s.v2 = k0 ^ 0x6c7967656e657261ULL;
+  s.v3 = k1 ^ 0x7465646279746573ULL;
+  s.m = 0;
+  s.length = 0;
+}
+
+/*
+ * Absorb One Byte (compresses every 8th)
+ */
+inline void sipUpdate(SipState &s, uint8_t b){
+  s.m |= (uint64_t)b << (8 * (s.length & 7));
+  s.length++;
+  if((s.length & 7) == 0){
+    s.v3 ^= s.m;
+    sipRound(s);
+    sipRound(s);
+    s.v0 ^= s.m;
+    s.m = 0;
+  }
+}
+
+/*
+ * Finish a Tag (full 64 bits)
+ * Takes a copy, so a running state can be finished more than once
+ */
+inline uint64_t sipFinal(SipState s){
+  uint64_t b = ((uint64_t)(s.length & 0xFF) << 56) | s.m;
+  s.v3 ^= b;
+  sipRound(s);
+  sipRound(s);
+  s.v0 ^= b;
+  s.v2 ^= 0xFF;
+  for(int i = 0; i < 4; i++) sipRound(s);
+  return s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+}
+
+/*
+ * Finish a Tag, Truncated to the 16-bit Hash Field
+ */
+inline uint16_t sipFinal16(SipState s){
+  return (uint16_t)sipFinal(s);
+}
+
+/*
+ * Does This Packet Type Carry a Keyed Tag
+ */
+inline bool authCovers(char type){
+  #if MESH_AUTH
+    return type == MSG_TYPE_BROADCAST || type == MSG_TYPE_TARGETED || type == MSG_TYPE_CONFIG;
+  #else
+    return false;
+  #endif
+}
+
+/*
+ * Start a Tag over a Header's [src][dst][type]
+ */
+inline void authBegin(SipState &s, String header){
+  sipInit(s);
+  for(int i = 0; i < 9; i++) sipUpdate(s, header[i]);
+}
+
+/*
+ * Tag of a Complete Packet (sending, or when the streamed tag is unusable)
+ */
+inline uint16_t authTag(String header, String message){
+  SipState s;
+  authBegin(s, header);
+  for(unsigned int i = 0; i < message.length(); i++) sipUpdate(s, message[i]);
+  return sipFinal16(s);
+}
+
+#endif // AUTH_H
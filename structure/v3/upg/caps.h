@@ -0,0 +1,170 @@
+#ifndef CAPS_H
+#define CAPS_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "lifi.h"
+
+// ==================== CAPABILITY NEGOTIATION ====================
+
+/*
+ * Per-Street Framing for Mixed Firmware (Type I)
+ * IR reaches every neighbor on a side at once, so the framing of a send
+ * is the best one all neighbors heard lately share:
+ * - Burst frames (3 chars per NEC frame) once every neighbor has CAP_BURST
+ * - Compressed headers only if every neighbor can expand them
+ * - Coded repairs only between neighbors that both decode them
+ * Neighbors are learned from one-hop packets (digests, pulls, ...) like
+ * the VLC peers; one that never announced counts as plain framing, so a
+ * lamp keeps talking to older firmware until it is reflashed. When an
+ * unknown neighbor turns up we announce at once (held off CAPS_HOLDOFF),
+ * and it answers with its own when it hears an unknown lamp: us.
+ */
+
+/*
+ * Find or Make the Entry for a Neighbor
+ * Its entry, else a free or the stalest slot
+ */
+inline int capsPeerSlot(String id){
+  int slot = -1;
+  for(int i = 0; i < CAPS_PEER_SIZE && slot < 0; i++){
+    if(capsPeers[i].active && capsPeers[i].id == id) slot = i;
+  }
+  if(slot >= 0) return slot;
+
+  slot = 0;
+  for(int i = 0; i < CAPS_PEER_SIZE; i++){
+    if(!capsPeers[i].active){
+      slot = i;
+      break;
+    }
+    if((long)(capsPeers[i].heardAt - capsPeers[slot].heardAt) < 0) slot = i;
+  }
+  capsPeers[slot].id = id;
+  capsPeers[slot].caps = 0;
+  capsPeers[slot].heardAt = millis();
+  capsPeers[slot].active = true;
+  return slot;
+}
+
+/*
+ * Note a Neighbor Heard (call for every packet received)
+ * A new one that has not announced makes us announce
+ */
+inline void capsNotePeer(String header){
+  String id = (header[8] == MSG_TYPE_CAPS) ? header.substring(0, 4) : vlcNeighborOf(header);
+  if(id.length() == 0 || id == NODE_ID) return;
+
+  int slot = capsPeerSlot(id);
+  capsPeers[slot].heardAt = millis();
+
+  if(header[8] == MSG_TYPE_CAPS && header.length() == HEADER_LENGTH_CAPS){
+    uint8_t caps = (uint8_t) strtol(header.substring(9, 11).c_str(), NULL, 16);
+    if(caps != capsPeers[slot].caps){
+      Serial.print(">>> CAPS: ");
+      Serial.print(id);
+      Serial.print(" supports 0x");
+      Serial.println(caps, HEX);
+    }
+    capsPeers[slot].caps = caps;
+  } else if(capsPeers[slot].caps == 0 && (long)(capsNextAnnounce - (millis() + CAPS_HOLDOFF)) > 0){
+    capsNextAnnounce = millis() + CAPS_HOLDOFF;  // Unknown neighbor: tell it ours soon
+  }
+}
+
+/*
+ * Does Every Neighbor Heard Lately Support a Feature
+ * False if this build lacks it, with no neighbors known, and while a v2.5
+ * lamp is within earshot
+ */
+inline bool capsLinkAllows(uint8_t cap){
+  if(!(LAMP_CAPS & cap)) return false;
+  if(capsLegacyHeardAt != 0 && millis() - capsLegacyHeardAt < CAPS_PEER_HOLD) return false;
+
+  bool any = false;
+  for(int i = 0; i < CAPS_PEER_SIZE; i++){
+    CapsPeer &p = capsPeers[i];
+    if(!p.active || millis() - p.heardAt >= CAPS_PEER_HOLD) continue;
+    if(!(p.caps & cap)) return false;
+    any = true;
+  }
+  return any;
+}
+
+/*
+ * Does One Neighbor Support a Feature
+ */
+inline bool capsPeerHas(String id, uint8_t cap){
+  for(int i = 0; i < CAPS_PEER_SIZE; i++){
+    if(capsPeers[i].active && capsPeers[i].id == id) return capsPeers[i].caps & cap;
+  }
+  return false;
+}
+
+/*
+ * Give a v2.5 Packet a v3 Header
+ * SOS and Type 4 toward HQ get a hop one past ours, HQ_ID for "000h" and
+ * an upper-case src; returns false for anything that is not a v2.5 format
+ */
+inline bool capsBridgeLegacy(String &header){
+  String src = header.substring(0, 4);
+  String dst = header.substring(4, 8);
+  bool sos = header.length() == HEADER_LENGTH_SOS_V25 && header[8] == MSG_TYPE_SOS;
+  bool msg = header.length() == HEADER_LENGTH_MESSAGE_V25 && header[8] == MSG_TYPE_MESSAGE &&
+             (dst == LEGACY_HQ_ID || dst == HQ_ID);
+  if(!sos && !msg) return false;
+
+  src.toUpperCase();
+  if(dst == LEGACY_HQ_ID) dst = HQ_ID;
+
+  char hopStr[3];
+  sprintf(hopStr, "%02X", min(myHop + 1, INITIAL_HOP - 1));
+  header = src + dst + header.substring(8) + hopStr;
+  capsLegacyHeardAt = millis();
+  capsStats.bridged++;
+
+  Serial.print(">>> CAPS: Bridged v2.5 ");
+  Serial.print(sos ? "SOS" : "message");
+  Serial.print(" as ");
+  Serial.println(header);
+  return true;
+}
+
+/*
+ * Announce Our Capabilities (scheduler task)
+ */
+inline void processCaps(){
+  if((long)(millis() - capsNextAnnounce) < 0) return;
+  capsNextAnnounce = millis() + CAPS_INTERVAL;
+
+  char capsStr[3];
+  sprintf(capsStr, "%02X", LAMP_CAPS);
+  irSend(String(NODE_ID) + BROADCAST_ID + MSG_TYPE_CAPS + capsStr);
+}
+
+/*
+ * Print Neighbor Capabilities
+ */
+inline void printCaps(){
+  Serial.print("Framing: ");
+  Serial.print(capsLinkAllows(CAP_BURST) ? "burst" : "plain");
+  Serial.print(capsLinkAllows(CAP_HC) ? ", compressed" : ", full headers");
+  Serial.print(" (");
+  Serial.print(capsStats.burstSends);
+  Serial.print(" burst, ");
+  Serial.print(capsStats.plainSends);
+  Serial.print(" plain, ");
+  Serial.print(capsStats.bridged);
+  Serial.println(" v2.5 bridged)");
+
+  for(int i = 0; i < CAPS_PEER_SIZE; i++){
+    CapsPeer &p = capsPeers[i];
+    if(!p.active || millis() - p.heardAt >= CAPS_PEER_HOLD) continue;
+    Serial.print("  ");
+    Serial.print(p.id);
+    Serial.print(": 0x");
+    Serial.println(p.caps, HEX);
+  }
+}
+
+#endif // CAPS_H
@@ -0,0 +1,206 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ==================== HEADER COMPRESSION ====================
+
+/*
+ * Context-Based Header Compression (link level)
+ * A compressed header is '#' + context ID (2 hex) + base check (1 hex) +
+ * everything after the 9-char [src][dst][type] base:
+ *   0000FFFF1A3F2      ->  #F3DA3F2      (13 -> 8 chars)
+ *   102A00004B1C003    ->  #762B1C003    (15 -> 10 chars)
+ * The ID is derived from the base, so every node files the same base
+ * under the same ID without negotiating. The check is a second hash of
+ * the base: a receiver that missed the sender's full header but holds
+ * another base under that ID sees a mismatch and reports a miss instead
+ * of expanding to the wrong src/dst. A node only compresses a base
+ * it has already sent in full within HC_REFRESH_INTERVAL, so neighbors
+ * that heard it can expand. A receiver without the context drops the
+ * packet and sends CTX_MISS; senders then go back to a full header for
+ * that context, which the retransmit copy picks up.
+ *
+ * INIT (different layout), TIMESYNC (airtime is part of its timing),
+ * CTX_MISS itself and CAPS (read by lamps without compression) always go
+ * out in full.
+ */
+
+/*
+ * Context ID of a 9-char Base
+ */
+inline uint8_t hcContextId(String base){
+  uint16_t h = 0;
+  for(unsigned int i = 0; i < base.length(); i++){
+    h = h * 31 + base[i];
+  }
+  return (h ^ (h >> 8)) & 0xFF;
+}
+
+/*
+ * Check Nibble of a 9-char Base (independent of the context ID)
+ */
+inline uint8_t hcBaseCheck(String base){
+  uint8_t c = 0;
+  for(unsigned int i = 0; i < base.length(); i++){
+    c = (uint8_t)((c << 1) | (c >> 7)) ^ base[i];
+  }
+  return (c ^ (c >> 4)) & 0x0F;
+}
+
+/*
+ * Can This Header Be Compressed
+ */
+inline bool hcCompressible(String header){
+  if(!HC_ENABLED || header.length() <= 9 || header[0] == HC_MARK) return false;
+  char type = header[8];
+  return type != MSG_TYPE_INIT && type != MSG_TYPE_TIMESYNC && type != MSG_TYPE_CTX_MISS &&
+         type != MSG_TYPE_CAPS;
+}
+
+/*
+ * Is This Line a Compressed Header
+ */
+inline bool hcIsCompressed(String line){
+  return HC_ENABLED && line.length() >= 4 && line[0] == HC_MARK &&
+         isHexadecimalDigit(line[1]) && isHexadecimalDigit(line[2]) && isHexadecimalDigit(line[3]);
+}
+
+/*
+ * Find Live Context by ID (-1 if none)
+ */
+inline int hcFind(uint8_t id){
+  for(int i = 0; i < HC_CONTEXT_SIZE; i++){
+    HcContext &c = hcContexts[i];
+    if(c.active && c.id == id && millis() - c.heardAt < HC_CONTEXT_HOLD) return i;
+  }
+  return -1;
+}
+
+/*
+ * Learn a Base from a Full Header (received or sent)
+ * Returns the context slot, or -1 if the header is not compressible
+ */
+inline int hcLearn(String header){
+  if(!hcCompressible(header)) return -1;
+  String base = header.substring(0, 9);
+  uint8_t id = hcContextId(base);
+
+  int slot = hcFind(id);
+  if(slot >= 0){
+    HcContext &c = hcContexts[slot];
+    if(c.base != base && !c.ambiguous){
+      c.ambiguous = true;  // Two bases, one ID: neither is compressed while both are around
+      #if DEBUG_IR_RX
+        Serial.print(">>> HC: Context ");
+        Serial.print(id, HEX);
+        Serial.println(" is ambiguous");
+      #endif
+    }
+    c.heardAt = millis();
+    return slot;
+  }
+
+  // Free or expired slot, else the stalest
+  slot = 0;
+  for(int i = 0; i < HC_CONTEXT_SIZE; i++){
+    if(!hcContexts[i].active || millis() - hcContexts[i].heardAt >= HC_CONTEXT_HOLD){
+      slot = i;
+      break;
+    }
+    if((long)(hcContexts[i].heardAt - hcContexts[slot].heardAt) < 0) slot = i;
+  }
+
+  HcContext &c = hcContexts[slot];
+  c.base = base;
+  c.id = id;
+  c.heardAt = millis();
+  c.sentFullAt = 0;
+  c.ambiguous = false;
+  c.active = true;
+  return slot;
+}
+
+/*
+ * Header as It Goes on Air
+ * Compressed if neighbors were given the base recently, full otherwise
+ */
+inline String hcCompress(String header){
+  String onAir = header;
+
+  int slot = hcFind(hcContextId(header.substring(0, 9)));
+  if(hcCompressible(header) && slot >= 0 && !hcContexts[slot].ambiguous &&
+     hcContexts[slot].base == header.substring(0, 9) && hcContexts[slot].sentFullAt != 0 &&
+     millis() - hcContexts[slot].sentFullAt < HC_REFRESH_INTERVAL){
+    char ctx[4];
+    sprintf(ctx, "%02X%X", hcContexts[slot].id, hcBaseCheck(hcContexts[slot].base));
+    onAir = String(HC_MARK) + ctx + header.substring(9);
+    hcContexts[slot].heardAt = millis();
+  } else {
+    slot = hcLearn(header);
+    if(slot >= 0) hcContexts[slot].sentFullAt = millis();
+  }
+
+  hcStats.packets++;
+  hcStats.chars += onAir.length();
+  hcStats.saved += header.length() - onAir.length();
+  return onAir;
+}
+
+/*
+ * Expand a Compressed Header in Place
+ * Returns false on a context miss, including a base that fails the check
+ * (line left as received)
+ */
+inline bool hcExpand(String &line){
+  uint8_t id = (uint8_t) strtol(line.substring(1, 3).c_str(), NULL, 16);
+  uint8_t check = (uint8_t) strtol(line.substring(3, 4).c_str(), NULL, 16);
+  int slot = hcFind(id);
+  if(slot < 0 || hcContexts[slot].ambiguous) return false;
+  if(hcBaseCheck(hcContexts[slot].base) != check) return false;
+
+  line = hcContexts[slot].base + line.substring(4);
+  return true;
+}
+
+/*
+ * Note a Context Miss (CTX_MISS goes out from processHcMiss)
+ */
+inline void hcReportMiss(String line){
+  hcStats.misses++;
+  hcMissPending = (uint8_t) strtol(line.substring(1, 3).c_str(), NULL, 16);
+
+  #if DEBUG_IR_RX
+    Serial.print(">>> HC: No context ");
+    Serial.print(line.substring(1, 3));
+    Serial.println(" - packet dropped");
+  #endif
+}
+
+/*
+ * Handle a Neighbor's CTX_MISS
+ * Our next send with that context goes out in full
+ */
+inline void hcProcessMiss(String header){
+  uint8_t id = (uint8_t) strtol(header.substring(9, 11).c_str(), NULL, 16);
+  int slot = hcFind(id);
+  if(slot >= 0) hcContexts[slot].sentFullAt = 0;
+}
+
+/*
+ * Print Header Compression Counters
+ */
+inline void printHcStats(){
+  Serial.print("Headers: ");
+  Serial.print(hcStats.packets);
+  Serial.print(" sent, ");
+  Serial.print(hcStats.packets ? (float)hcStats.chars / hcStats.packets : 0.0, 1);
+  Serial.print(" chars/packet (");
+  Serial.print(hcStats.saved);
+  Serial.print(" saved), ");
+  Serial.print(hcStats.misses);
+  Serial.println(" context misses");
+}
+
+#endif // COMPRESS_H
@@ -5,27 +5,68 @@
 
 // ==================== NODE CONFIGURATION ====================
 
-// Unique ID for this node (4 characters, alphanumeric)
-// IMPORTANT: Change this for each node! Examples: "102a", "203b", "304c"
-#define NODE_ID      "102a"
+// Unique hierarchical address for this node, 4 hex chars:
+//   [district(1)][street(1)][lamp(2)]   e.g. "102A" = district 1, street 0, lamp 2A
+// 16 districts x 16 streets x 256 lamps; HQ_ID and BROADCAST_ID are reserved.
+// Targeted messages may address a whole district or street with trailing
+// ADDR_WILDCARD chars: "1***" = district 1, "10**" = district 1 street 0
+// IMPORTANT: Change this for each node! Examples: "102A", "203B", "304C"
+// (The host emulation in src/sim sets it per process)
+#ifndef NODE_ID
+#define NODE_ID      "102A"
+#endif
+
+// Bit position of this lamp in broadcast coverage bitmaps (0-63)
+// Derived from the lamp number (low 6 bits), as the dashboard does for
+// lamps without a mesh_index. Lamps whose numbers are 64 apart, or on other
+// streets, share a bit: the dashboard lists them as ambiguous. To override,
+// define it here and set the same mesh_index in the dashboard
+#ifndef NODE_INDEX
+#define NODE_INDEX   ((uint8_t)(strtol(NODE_ID + 2, NULL, 16) & 0x3F))
+#endif
+
+// Image version of this firmware build (0-255), bump for every OTA release
+// Lamps only accept mesh firmware images newer than this
+#define FIRMWARE_VERSION 1
 
 // Reserved ID for broadcast messages (all nodes receive)
 #define BROADCAST_ID "FFFF"
 
 // Headquarters/Base Station ID (SOS messages are sent here)
-// Using "000h" pattern: 3 digits + 'h' for headquarters
-#define HQ_ID        "000h"
+// Lamps 00-0F of district 0 street 0 are reserved for headquarters
+#define HQ_ID        "0000"
 
 // Multi-HQ Support (optional additional headquarters)
 // Uncomment and configure if multiple HQ stations are needed
-// #define HQ_ID_2      "001h"
-// #define HQ_ID_3      "002h"
+// #define HQ_ID_2      "0001"
+// #define HQ_ID_3      "0002"
+
+// HQ boards in vehicles use the rest of the reserved range (0001-000F)
+// and sync with lamps they pass (see contact.h)
+#define IS_MOBILE_HQ(src) ((src).startsWith("000") && (src) != HQ_ID)
+
+// Prefix wildcard for district / street addressing (never in a node address)
+#define ADDR_WILDCARD '*'
 
 // Helper macro to check if source is authorized HQ
 // Add additional HQ IDs here if using multi-HQ setup
-#define IS_FROM_HQ(src) ((src) == HQ_ID)
+#define IS_FROM_HQ(src) ((src) == HQ_ID || IS_MOBILE_HQ(src))
 // For multi-HQ: #define IS_FROM_HQ(src) ((src) == HQ_ID || (src) == HQ_ID_2 || (src) == HQ_ID_3)
 
+// ==================== MESSAGE AUTHENTICATION ====================
+
+// HQ-originated broadcasts, targeted commands and CONFIG carry a keyed
+// 16-bit tag (truncated SipHash-2-4) in place of simpleHash (see auth.h)
+// Set 0 to fall back to the unkeyed hash
+#define MESH_AUTH 1
+
+// Shared mesh key (16 bytes), identical on every lamp, HQ and the dashboard
+// IMPORTANT: Change for each deployment and keep it out of public builds!
+const uint8_t MESH_KEY[16] = {
+  0x4C, 0x69, 0x46, 0x69, 0x4D, 0x65, 0x73, 0x68,
+  0x2D, 0x64, 0x65, 0x76, 0x2D, 0x6B, 0x65, 0x79
+};
+
 // ==================== PIN ASSIGNMENTS ====================
 
 #define SOS_PIN        D6  // Pushbutton for SOS (INPUT_PULLUP, active LOW)
@@ -40,6 +81,9 @@
 #define LED_STATUS     D1  // Status LED for visual feedback (OUTPUT)
 #define LAMP_LIGHT_PIN D8  // Lamp LED - for LiFi transmission (OUTPUT)
 
+#define BATTERY_SENSE_PIN A0  // Battery voltage via divider (analog)
+#define SOLAR_SENSE_PIN   D4  // Solar charger status (HIGH = charging)
+
 // ==================== LED CONFIGURATION ====================
 
 // LED polarity configuration
@@ -67,12 +111,28 @@
 #define DEBUG_LED         1  // LED state changes
 #define DEBUG_BUTTON      1  // Button press events
 #define DEBUG_GRADIENT    1  // Gradient system operations
+#define DEBUG_SYNC        1  // Anti-entropy digest/pull activity
+#define DEBUG_COVERAGE    1  // Broadcast coverage report aggregation
+#define DEBUG_AIRTIME     1  // Airtime limiter and congestion control
+#define DEBUG_HEALTH      1  // Health trailer piggybacking
+#define DEBUG_SCHED       1  // Task runtime accounting in status output
+#define DEBUG_ENERGY      1  // Energy-balanced relay hold-back
+#define DEBUG_OTA         1  // Firmware dissemination over the mesh
+#define DEBUG_TIMESYNC    1  // Mesh time synchronization
 
 // ==================== TIMING CONSTANTS ====================
 
 // SOS button cooldown period (10 seconds for testing, 3 minutes for production)
 const unsigned long SOS_COOLDOWN = 10000;  // 10 seconds
 
+// Button edges closer together than this are contact bounce
+const unsigned long BUTTON_DEBOUNCE = 50;
+
+// NOTE: LIFI_REBROADCAST_INTERVAL, IR_DIRECTION_GAP, RETRANSMIT_COUNT,
+// RETRANSMIT_INTERVAL and GRADIENT_TOLERANCE are factory defaults only.
+// The values in use live in the runtime parameter block (see params.h),
+// which HQ can retune with a CONFIG message.
+
 // LiFi rebroadcast interval for phone receivers (1 minute = 60,000 milliseconds)
 const unsigned long LIFI_REBROADCAST_INTERVAL = 60000;
 
@@ -95,6 +155,409 @@ const unsigned long REDUNDANCY_WINDOW = 60000;  // 1 minute
 // Cache size for message deduplication
 #define CACHE_SIZE 3
 
+// ==================== ANTI-ENTROPY SYNC ====================
+
+// Number of recent HQ broadcasts kept for neighbor repair
+// A lamp that was offline during a flood pulls missing entries from neighbors
+#define BCAST_STORE_SIZE 3
+
+// Interval between digest exchanges with neighbors (5 minutes)
+const unsigned long ANTI_ENTROPY_INTERVAL = 300000;
+
+// Random jitter added to each digest interval (avoids neighbors colliding)
+const unsigned long ANTI_ENTROPY_JITTER = 30000;
+
+// Broadcasts older than this are no longer advertised or repaired (30 minutes)
+const unsigned long ANTI_ENTROPY_MAX_AGE = 1800000;
+
+// Minimum gap between early digests sent to help a lagging neighbor
+const unsigned long ANTI_ENTROPY_REPLY_HOLDOFF = 20000;  // 20 seconds
+
+/*
+ * Network-coded repair (see netcode.h)
+ * Pulls are answered after a short hold, so pulls from several neighbors
+ * after one digest can be served together. If neighbor X is missing A but
+ * holds B and neighbor Y the reverse (known from their digests), one coded
+ * packet A+B replaces the two plain replays.
+ */
+#define NC_ENABLED 1
+#define NC_REPAIR_SIZE   4   // Pulled broadcasts waiting to be served
+#define NC_NEIGHBOR_SIZE 4   // Neighbors whose last digest we keep
+
+// Pulls are held this long before they are served
+const unsigned long NC_REPAIR_HOLD = 2000;
+
+// A neighbor's digest is trusted this long (one digest round plus jitter)
+const unsigned long NC_NEIGHBOR_HOLD = ANTI_ENTROPY_INTERVAL + ANTI_ENTROPY_JITTER;
+
+// ==================== AIRTIME LIMITER ====================
+
+/*
+ * Token bucket on irSend, measured in transmitted characters.
+ * Traffic classes:
+ *   CRITICAL - SOS, ACK, INIT, HQ downlink, congestion control, CONFIG:
+ *              never limited. Only types listed in txClass() are critical
+ *   NORMAL   - Type 4 messages, CTX_MISS, CONTACT and any unlisted type:
+ *              limited by the bucket
+ *   BULK     - Coverage reports, digests, pulls, coded repairs, CAPS: limited,
+ *              and held back entirely while HQ has declared congestion
+ *   OTA      - Firmware dissemination: charged like bulk, so a lamp serving
+ *              pages cannot crowd out messages
+ */
+
+// Bucket capacity (chars) - allows a short burst of 2-3 messages
+#define AIRTIME_BUCKET_SIZE 120
+
+// One token (char) is refilled every interval
+// One char costs ~170ms per direction (~0.7s for all 4), so 2s keeps a lamp
+// below ~35% duty cycle from non-critical traffic
+const unsigned long AIRTIME_REFILL_INTERVAL = 2000;
+
+// Traffic classes
+#define TX_CLASS_CRITICAL 0
+#define TX_CLASS_NORMAL   1
+#define TX_CLASS_BULK     2
+#define TX_CLASS_OTA      3  // Firmware dissemination: charged, held while congested
+
+// Highest congestion level HQ can declare
+// Level n slows the refill rate by a factor of (n + 1)
+#define CONGESTION_MAX_LEVEL 3
+
+// ==================== TRANSMIT PREEMPTION ====================
+
+/*
+ * A 4-direction send of a long packet keeps the receiver off for tens of
+ * seconds. Anything but an SOS can be suspended at a frame boundary:
+ *   - own SOS button: checked before every char
+ *   - neighbor traffic: the receiver listens between directions; a frame
+ *     heard there may be an SOS, so the rest of the send yields to it
+ * The suspended packet resumes at the interrupted direction once the
+ * channel is quiet (see processSuspendedTx).
+ */
+#define TX_PREEMPT_ENABLED 1
+
+// Receiver-on window between directions (at least one char airtime, so a
+// neighbor mid-packet is always heard; replaces a shorter direction gap)
+const unsigned long TX_PREEMPT_LISTEN = 200;
+
+// Resume once no frame has been heard for this long
+// (above the 2s segment timeout, so an incoming packet has finished)
+const unsigned long TX_RESUME_QUIET = 2500;
+
+// ==================== HEALTH TRAILER ====================
+
+/*
+ * Lamp health rides on upstream packets this lamp already sends
+ * (forwarded Type 4 messages and Type 8 reports) as a message trailer:
+ *   <message>~<entry><entry>...
+ *   entry = [nodeID(4)][battery(1)][solar(1)][errors(1)][sync(1)]
+ *           [K(1)][relays(1)][progress(1)] = 11 chars
+ *   battery = 0-9 (tenths of charge), solar = 0/1, errors = hex flags,
+ *   sync = mesh time error bound, hex n means within 2^(n+4) ms, F = unsynced,
+ *   K = current gradient tolerance, relays = parallel relays per upstream
+ *   packet (hex, capped at F), progress = tenths of upstream packets seen
+ *   to progress (0-A)
+ * '~' is reserved and must not appear in message content.
+ * Trailers are not covered by the message hash.
+ */
+#define HEALTH_TRAILER_MARK   '~'
+#define HEALTH_ENTRY_LENGTH   11
+#define HEALTH_TRAILER_MAX    2   // Entries per packet (23 chars max)
+#define HEALTH_RELAY_MAX      4   // Downstream entries held for the next packet
+
+// Battery ADC calibration (raw A0 readings through the divider)
+#define BATTERY_ADC_EMPTY 620   // ~3.0V cell
+#define BATTERY_ADC_FULL  870   // ~4.2V cell
+
+// Error flags (sticky until piggybacked once)
+#define HEALTH_ERR_QUEUE_FULL  0x1  // Retransmit queue overflowed
+#define HEALTH_ERR_RX_TIMEOUT  0x2  // Incomplete IR packets received
+#define HEALTH_ERR_CORRUPT     0x4  // Hash mismatch on received packet
+#define HEALTH_ERR_NO_GRADIENT 0x8  // No INIT received yet
+
+// ==================== LOW-POWER LISTENING ====================
+
+/*
+ * Duty-cycled receiver (see power.h)
+ * IMPORTANT: LPL_ENABLED, LPL_SLEEP_INTERVAL and LPL_LISTEN_WINDOW must
+ * match on every node (including HQ), since senders size the wake
+ * preamble from them.
+ */
+#define LPL_ENABLED 1
+
+// NEC address used for wake preamble frames (data frames use 0x00)
+#define LPL_WAKE_ADDRESS 0x01
+
+// Receiver off time between check windows
+// Longer = less receiver energy, but every hop waits this long for a preamble
+const unsigned long LPL_SLEEP_INTERVAL = 3600;
+
+// Receiver check window
+// Must exceed one preamble round (4 directions x ~78ms per wake frame)
+const unsigned long LPL_LISTEN_WINDOW = 400;
+
+// Stay awake this long after any received frame or own transmission
+// Covers the remaining directions of a neighbor's 4-direction send
+const unsigned long LPL_WAKE_HOLD = 30000;
+
+// How often the listening task checks window/sleep deadlines
+const unsigned long LPL_CHECK_INTERVAL = 50;
+
+// Neighbors that heard our last transmission are still awake within this
+// time of it, so the wake preamble is skipped (back-to-back sends, OTA)
+const unsigned long LPL_PREAMBLE_SKIP = LPL_WAKE_HOLD / 2;
+
+// ==================== ENERGY MODEL ====================
+
+/*
+ * Modelled current draw (mA) per state, used for energy accounting and
+ * projected autonomy. BASE is always drawn; the others add on top while
+ * the state is active. Calibrate against a bench measurement per board.
+ */
+#define POWER_BASE_MA         15.0   // MCU idle + regulator
+#define POWER_CPU_ACTIVE_MA   55.0   // Running a task
+#define POWER_RX_MA           6.0    // IR module + 50us decoder interrupt
+#define POWER_IR_TX_MA        60.0   // IR LED (carrier duty-cycle averaged)
+#define POWER_LAMP_LED_MA     350.0  // Lamp LED during LiFi transmission
+
+#define BATTERY_CAPACITY_MAH  6000.0
+
+// ==================== RUNTIME PARAMETERS ====================
+
+// EEPROM layout: [RuntimeParams][OtaRecord]
+#define OTA_RECORD_ADDRESS sizeof(RuntimeParams)
+#define EEPROM_SIZE (sizeof(RuntimeParams) + sizeof(OtaRecord))
+
+// Marks a valid parameter block in EEPROM (change if RuntimeParams changes)
+#define PARAMS_MAGIC 0xA6
+
+// Largest direction gap HQ may set (ms)
+#define CONFIG_MAX_DIRECTION_GAP 2000
+
+// Airtime of one IR char (or burst frame) per direction (NEC frame + gap, ~170ms)
+// Senders charge a CONFIG's apply delay for the header still to go out
+const unsigned long IR_CHAR_AIRTIME = 170;
+
+// ==================== FIRMWARE DISSEMINATION ====================
+
+/*
+ * Images are staged page by page in the flash filesystem partition
+ * (build with an FS size at least as large as the sketch), verified
+ * with CRC32 and then installed through Update.
+ * Each page is OTA_PAGE_PACKETS source packets; senders transmit random
+ * XOR combinations, so any OTA_PAGE_PACKETS independent packets decode
+ * the page and no specific packet ever needs retransmitting.
+ */
+#define OTA_PACKET_BYTES   16
+#define OTA_PAGE_PACKETS   8
+#define OTA_PAGE_BYTES     (OTA_PACKET_BYTES * OTA_PAGE_PACKETS)
+#define OTA_REPAIR_PACKETS 3     // Coded packets sent beyond the minimum per request
+#define OTA_MAX_PAGES      0xFFF // 3 hex digits (512KB)
+
+// Periodic image advertisement while holding an image (plus random jitter)
+const unsigned long OTA_ADV_INTERVAL = 60000;
+const unsigned long OTA_ADV_JITTER = 10000;
+
+// Re-request a page if it has not decoded by then
+const unsigned long OTA_REQ_TIMEOUT = 120000;
+
+// Keep serving the installed image to neighbors this long after boot
+const unsigned long OTA_SERVE_WINDOW = 7200000;  // 2 hours
+
+// EEPROM record of the last installed image (after RuntimeParams)
+#define OTA_RECORD_MAGIC 0x5B
+
+// ==================== MESH TIME SYNC ====================
+
+/*
+ * HQ floods TIMESYNC (Type E) beacons carrying its clock. Each relay
+ * restamps the beacon with its own mesh-time estimate just before sending
+ * it in each direction; receivers add the known airtime of the header and
+ * timestamp arrival in the IR interrupt. Offset and drift against the
+ * local millis() are fitted by linear regression over the last
+ * TIMESYNC_TABLE_SIZE beacons.
+ */
+#define TIMESYNC_TABLE_SIZE 8
+
+// Beacon stamp to arrival of the delimiter frame at the receiver:
+// header chars plus the closing space at IR_CHAR_AIRTIME each
+#define TIMESYNC_TX_DELAY ((HEADER_LENGTH_TIMESYNC + 1) * IR_CHAR_AIRTIME)
+
+// A point this far off the fit means HQ rebooted: start over
+const unsigned long TIMESYNC_RESET_ERROR = 5000;
+
+// Error budget added per hop (stamp and interrupt jitter, ms)
+#define TIMESYNC_HOP_ERROR 10
+
+// Clock skew the fit may still be off by between beacons (ppm)
+#define TIMESYNC_SKEW_PPM 50
+
+// Largest drift the fit may report (ppm); anything beyond is noise
+#define TIMESYNC_MAX_SKEW_PPM 500
+
+// Not synced any more if no beacon heard for this long
+const unsigned long TIMESYNC_TIMEOUT = 3600000;  // 1 hour
+
+// ==================== ENERGY-BALANCED FORWARDING ====================
+
+/*
+ * Lamps advertise a coarse energy class when relaying INIT. A lamp whose
+ * class is below the best class advertised by its gradient peers (lamps
+ * at its own hop, i.e. alternative relays - the parent and children
+ * re-relaying INIT are not) holds Type 4 messages back instead of relaying
+ * at once. A peer's class is trusted for ENERGY_PEER_HOLD only. If a peer is overheard
+ * relaying the message further upstream first, the held copy is dropped.
+ * SOS and ACK are never held back.
+ */
+#define ENERGY_DEPLETED  0
+#define ENERGY_LOW       1
+#define ENERGY_GOOD      2
+#define ENERGY_UNKNOWN   255
+
+// Battery levels (0-9) at or below which a lamp is depleted / low
+// A charging lamp is raised one class
+#define ENERGY_DEPLETED_LEVEL 2
+#define ENERGY_LOW_LEVEL      5
+
+// Hold-back per class below the best peer
+// Must stay below RETRANSMIT_INTERVAL so the sender's retransmission
+// is not mistaken for a peer's relay
+const unsigned long ENERGY_DEFER_STEP = 4000;
+
+// INIT is only flooded on demand, so a peer may have drained since:
+// after this long its advertised class no longer counts (30 min)
+const unsigned long ENERGY_PEER_HOLD = 1800000;
+
+// Relays held back at once (further ones are sent immediately)
+#define DEFERRED_FORWARD_SIZE 2
+
+// ==================== VISIBLE-LIGHT CHANNEL ====================
+
+/*
+ * Second mesh channel over the lamp LED (see vlc.h)
+ * LAMP_LIGHT_PIN doubles as an inverted UART TX (idle = dark) and a
+ * photodiode comparator on VLC_RX_PIN is the UART RX. At 2400 baud that
+ * is ~240 chars/s against ~6 on IR, but only toward neighbors fitted with
+ * the photodiode and in sight of our light.
+ * IMPORTANT: leave at 0 unless the photodiode is fitted
+ */
+#define VLC_ENABLED 0
+#define VLC_RX_PIN  10    // SD3 (GPIO10), free when the flash runs in DIO mode
+#define VLC_BAUD    2400
+#define VLC_MAX_FRAME 96  // Longest frame accepted (chars)
+#define VLC_PEER_SIZE 6   // Neighbors tracked per channel
+
+// A partial frame is dropped after this much silence
+const unsigned long VLC_FRAME_TIMEOUT = 500;
+
+// A neighbor counts as present on a channel this long after we last
+// heard it there (digests come every ANTI_ENTROPY_INTERVAL)
+const unsigned long VLC_PEER_HOLD = 2 * (ANTI_ENTROPY_INTERVAL + ANTI_ENTROPY_JITTER);
+
+// ==================== MOBILE HQ CONTACT ====================
+
+/*
+ * Bulk sync with a passing HQ vehicle (see contact.h)
+ * The vehicle beacons a summary of the downlink it carries (Type H).
+ * A lamp in range answers with how many upstream packets it is about to
+ * send and which downlink it is missing, streams the packets, and the
+ * vehicle then serves what was missing. All of it goes in burst frames:
+ * 3 chars per raw NEC frame instead of 1, with a 4-bit check standing in
+ * for NEC's inverted bytes.
+ * IMPORTANT: CONTACT_BURST_MARKER must match HQ's config.h
+ */
+#define CONTACT_ENABLED 1
+#define CONTACT_BURST_MARKER 0xC0  // Low byte of a burst frame: marker | check
+#define CONTACT_DOWN_MAX  3        // Downlink hashes in a beacon
+#define CONTACT_KEYS      2        // Upstream keys a beacon acknowledges
+#define UPLINK_STORE_SIZE 4        // Upstream packets kept for a vehicle
+
+// Directions facing the road (bit 0 FRONT, 1 RIGHT, 2 BACK, 3 LEFT)
+#define CONTACT_DIR_MASK 0x05
+
+// Upstream packets older than this are not handed to a vehicle
+const unsigned long UPLINK_MAX_AGE = 3600000;  // 1 hour
+
+// Contact is over this long after the last beacon
+const unsigned long CONTACT_HOLD = 10000;
+
+// Lamps in range spread their replies over this window, after the
+// channel has been quiet for CONTACT_QUIET
+const unsigned long CONTACT_REPLY_JITTER = 500;
+const unsigned long CONTACT_QUIET = 300;
+
+// A packet the vehicle has not acknowledged by then is sent again
+const unsigned long CONTACT_RESEND = 15000;
+
+// ==================== CAPABILITY NEGOTIATION ====================
+
+/*
+ * Mixed-firmware streets (see caps.h)
+ * Every lamp announces what framing it understands (Type I) and keeps
+ * what its neighbors announced. A send uses a feature only when every
+ * neighbor heard lately has it; a neighbor heard but never announced
+ * (older firmware) holds its side of the street to plain framing. A lamp
+ * between old and new neighbors decodes whatever it gets and resends in
+ * the framing its neighbors share, so it bridges without a special path.
+ * v2.5 SOS (9 chars) and Type 4 (13 chars) carry no hop; they are given
+ * one past ours so the gradient takes them on toward HQ.
+ */
+#define CAP_HC    0x01  // Compressed headers (compress.h)
+#define CAP_BURST 0x02  // Burst frames for mesh traffic, 3 chars per frame
+#define CAP_CODED 0x04  // Network-coded repairs (netcode.h)
+#define CAP_VLC   0x08  // Visible-light channel (vlc.h)
+
+// Only what this build can decode (burst frames come with CONTACT_ENABLED)
+#define LAMP_CAPS ((HC_ENABLED ? CAP_HC : 0) | (CONTACT_ENABLED ? CAP_BURST : 0) | \
+                   (NC_ENABLED ? CAP_CODED : 0) | (VLC_ENABLED ? CAP_VLC : 0))
+#define CAPS_PEER_SIZE 6
+
+// Announce this often, and at most this often when an unknown neighbor
+// turns up
+const unsigned long CAPS_INTERVAL = 600000;  // 10 minutes
+const unsigned long CAPS_HOLDOFF = 10000;
+
+// Neighbors count toward the shared framing this long after last heard
+const unsigned long CAPS_PEER_HOLD = VLC_PEER_HOLD;
+
+// ==================== HEADER COMPRESSION ====================
+
+/*
+ * Link-level header compression (see compress.h)
+ * [src(4)][dst(4)][type(1)] repeats across consecutive packets (HQ floods,
+ * one lamp's reports). Every node keeps a small table of these 9-char
+ * bases, learned from full headers it hears, under a 2-hex-char context
+ * ID derived from the base itself. Once a sender has sent a base in full,
+ * it sends '#' + context ID + a check nibble of the base + the remaining
+ * fields instead, until the refresh interval runs out or a neighbor
+ * reports a miss (Type F).
+ * IMPORTANT: HC_ENABLED and the hold/refresh times must match on every
+ * node, including HQ.
+ */
+#define HC_ENABLED 1
+#define HC_MARK    '#'   // Starts a compressed header (only looked for where a header is due)
+#define HC_CONTEXT_SIZE 6
+
+// A sender repeats a base in full at least this often
+const unsigned long HC_REFRESH_INTERVAL = 120000;  // 2 minutes
+
+// Receivers keep a base this long after last hearing it
+const unsigned long HC_CONTEXT_HOLD = 2 * HC_REFRESH_INTERVAL;
+
+// At most one CTX_MISS per this interval
+const unsigned long HC_MISS_HOLDOFF = 5000;
+
+// ==================== COVERAGE REPORTS ====================
+
+// Coverage reports for HQ broadcasts are sent farthest-first so each lamp
+// can merge its downstream neighbors' reports before reporting itself.
+// A lamp at hop h reports (REPORT_MAX_HOP - h) slots after receiving the broadcast.
+// The slot must exceed one hop of flood plus report airtime (~30s).
+const unsigned long REPORT_HOP_SLOT = 90000;  // 90 seconds
+
+// Lamps at or beyond this hop report immediately
+#define REPORT_MAX_HOP 8
+
 // ==================== GRADIENT SYSTEM ====================
 
 // Gradient tolerance (K value)
@@ -102,8 +565,33 @@ const unsigned long REDUNDANCY_WINDOW = 60000;  // 1 minute
 // Higher values = more redundancy, lower values = more selective forwarding
 #define GRADIENT_TOLERANCE 1
 
+/*
+ * Adaptive tolerance (see gradient.h)
+ * Each lamp tunes its own K, starting from the runtime parameter. It
+ * watches every upstream packet (SOS, ACK, Type 4) it hears, relayed or
+ * not, for GRADIENT_WATCH_WINDOW:
+ *   - no copy from further on overheard: the packet stalled around this
+ *     lamp, so K widens by one
+ *   - it progressed and GRADIENT_REDUNDANT_RELAYS or more parallel
+ *     relays were overheard: K narrows by one
+ */
+#define GRADIENT_ADAPTIVE 1
+#define GRADIENT_K_MIN 0
+#define GRADIENT_K_MAX 3
+#define GRADIENT_REDUNDANT_RELAYS 3
+#define GRADIENT_WATCH_SIZE 4
+
+// Covers two further hops of header-only relays; a Type 4 relay takes
+// ~40s per hop, so slow messages only count if they progressed in time
+const unsigned long GRADIENT_WATCH_WINDOW = 60000;
+
+// Weight of the newest packet in the redundancy / progress averages
+#define GRADIENT_EWMA 0.25
+
+// Hop fields are 2 hex chars: 0-MAX_HOP hops from HQ
 // Initial hop value for nodes (max distance, uninitialized)
-#define INITIAL_HOP 99
+#define INITIAL_HOP 0xFF
+#define MAX_HOP     0xFE
 
 // ==================== MESSAGE TYPE DEFINITIONS ====================
 
@@ -113,6 +601,8 @@ const unsigned long REDUNDANCY_WINDOW = 60000;  // 1 minute
  * Type '0' - INIT (HQ → All Lamps)
  *   Builds gradient map, spreads outward from HQ
  *   Header: [src(4)][id(2)][hop(2)][0] = 9 chars
+ *   Lamps relay it as [src(4)][id(2)][hop(2)][0][energy(1)] = 10 chars,
+ *   advertising their own energy class to neighbors
  *   No message content, no hash
  *   Hop increments as it spreads (HQ=00, adjacent=01, etc.)
  * 
@@ -123,8 +613,10 @@ const unsigned long REDUNDANCY_WINDOW = 60000;  // 1 minute
  * 
  * Type '2' - TARGETED BROADCAST (HQ → Specific Lamp)
  *   Only target lamp broadcasts to phones via LiFi
- *   Header: [src(4)][dst(4)][type(1)][hash(4)] = 13 chars
+ *   Header: [src(4)][dst(4)][type(1)][hash(4)][cmd(2)][try(1)] = 16 chars
+ *   (legacy 13-char form without cmd/try is still accepted, but not ACKed)
  *   No gradient check, forwards normally
+ *   Target lamp answers with a Type 7 ACK carrying cmd and try
  * 
  * Type '3' - SOS (Lamp → HQ)
  *   Emergency alert routes to HQ using gradient
@@ -139,6 +631,84 @@ const unsigned long REDUNDANCY_WINDOW = 60000;  // 1 minute
  *   Has message content and hash
  *   Hop decrements toward HQ (floors at 0)
  *   Gradient check: only forward if myHop <= msgHop + K
+ * 
+ * Type '5' - DIGEST (Lamp → Neighbors)
+ *   Anti-entropy summary of recently stored HQ broadcasts
+ *   Header: [src(4)][dst(4)][type(1)][hash(4) x n] = 9 + 4n chars
+ *   Header-only, never forwarded (one hop)
+ * 
+ * Type '6' - PULL (Lamp → Neighbor)
+ *   Requests the broadcasts a neighbor advertised but this lamp is missing
+ *   Header: [src(4)][dst(4)][type(1)][hash(4) x n] = 9 + 4n chars (n >= 1)
+ *   Header-only, never forwarded; neighbor replies with the stored broadcasts
+ * 
+ * Type '7' - ACK (Target Lamp → HQ)
+ *   End-to-end confirmation of a Type 2 targeted message
+ *   Header: [src(4)][dst(4)][type(1)][cmd(2)][try(1)][hop(2)] = 14 chars
+ *   Header-only, routed to HQ using gradient like SOS
+ * 
+ * Type '8' - REPORT (Lamp → HQ, aggregated per hop)
+ *   Coverage of one HQ broadcast: bitmap of lamps known to hold it
+ *   Header: [src(4)][dst(4)][type(1)][hash(4)][hop(2)] = 15 chars
+ *   Message: 64-bit coverage bitmap as 16 hex chars (bit = NODE_INDEX)
+ *   Not forwarded as-is: upstream lamps merge it into their own report
+ * 
+ * Type '9' - CONGESTION (HQ → All Lamps)
+ *   Backpressure: throttle non-critical traffic for a period
+ *   Header: [src(4)][dst(4)][type(1)][id(2)][level(1)][minutes(2)] = 14 chars
+ *   Header-only, flooded like INIT; level 0 clears congestion
+ * 
+ * Type 'A' - CONFIG (HQ → All Lamps)
+ *   Runtime parameter block, applied by every lamp at the same epoch
+ *   Header: [src(4)][dst(4)][type(1)][hash(4)][delay s(3)] = 16 chars
+ *   Message: [ver(5)][gap ms(4)][interval s(3)][count(1)][K(1)][lifi s(4)] = 18 chars
+ *   Flooded like a broadcast; delay = time left when the header ends,
+ *   restamped on every direction and retransmit. Relayed even by a lamp
+ *   that does not apply it (older version, or a block it cannot parse)
+ * 
+ * Type 'B' - OTA_ADV (Node → Neighbors)
+ *   Summary of the firmware image a node holds (see ota.h)
+ *   Header: [src(4)][dst(4)][type(1)][ver(2)][size(5)][have(3)][crc32(8)][tag(8)] = 35 chars
+ *   Header-only, one hop, all fields hex; tag is HQ's, relayed unchanged
+ * 
+ * Type 'C' - OTA_REQ (Lamp → Neighbor)
+ *   Request for the next firmware page this lamp is missing
+ *   Header: [src(4)][dst(4)][type(1)][ver(2)][page(3)] = 14 chars
+ *   Header-only, one hop
+ * 
+ * Type 'D' - OTA_DATA (Node → Neighbors)
+ *   One erasure-coded packet of a firmware page: XOR of the source
+ *   packets selected by mask
+ *   Header: [src(4)][dst(4)][type(1)][ver(2)][page(3)][mask(2)] = 16 chars
+ *   Message: 16 bytes as 32 hex chars
+ *   One hop; any neighbor waiting for that page can use it
+ * 
+ * Type 'E' - TIMESYNC (HQ → All Lamps)
+ *   Mesh time reference (see timesync.h)
+ *   Header: [src(4)][dst(4)][type(1)][seq(2)][hop(2)][time(8)] = 21 chars
+ *   Header-only, flooded; each relay restamps time per direction
+ * 
+ * Type 'F' - CTX_MISS (Node → Neighbors)
+ *   A compressed header named a context this node doesn't hold (see compress.h)
+ *   Header: [src(4)][dst(4)][type(1)][ctx(2)] = 11 chars
+ *   Header-only, one hop; senders go back to full headers for that context
+ * 
+ * Type 'G' - CODED (Lamp → Neighbors)
+ *   Two stored HQ broadcasts A and B combined for neighbors holding one each
+ *   (see netcode.h)
+ *   Header: [src(4)][dst(4)][type(1)][hashA(4)][hashB(4)][lenA(2)][lenB(2)] = 21 chars
+ *   Message: A + B char by char (mod 94 over '!'..'~'), as long as the longer one
+ *   One hop; the recovered broadcast is handled like a plain repair
+ * 
+ * Type 'H' - CONTACT (Mobile HQ ↔ Lamps in range, see contact.h)
+ *   Beacon:  [src(4)][FFFF][type(1)][n(1)][n x down hash(4)][upstream keys(4 each)]
+ *   Reply:   [src(4)][hq(4)][type(1)][n(1)][pulled hashes(4 each)]
+ *            n = upstream packets about to follow
+ *   Header-only, one hop, sent in burst frames
+ * 
+ * Type 'I' - CAPS (Node → Neighbors, see caps.h)
+ *   Header: [src(4)][FFFF][type(1)][caps(2 hex)]
+ *   Header-only, one hop, always plain framing (older lamps drop it)
  */
 
 #define MSG_TYPE_INIT      '0'  // HQ → All lamps (gradient setup)
@@ -146,12 +716,48 @@ const unsigned long REDUNDANCY_WINDOW = 60000;  // 1 minute
 #define MSG_TYPE_TARGETED  '2'  // HQ → Specific lamp (targeted broadcast)
 #define MSG_TYPE_SOS       '3'  // Lamp → HQ (emergency, header-only)
 #define MSG_TYPE_MESSAGE   '4'  // Node → HQ (normal message with content)
+#define MSG_TYPE_DIGEST    '5'  // Lamp → Neighbors (anti-entropy summary)
+#define MSG_TYPE_PULL      '6'  // Lamp → Neighbor (request missing broadcast)
+#define MSG_TYPE_ACK       '7'  // Lamp → HQ (targeted delivery confirmation)
+#define MSG_TYPE_REPORT    '8'  // Lamp → HQ (aggregated broadcast coverage)
+#define MSG_TYPE_CONGESTION '9' // HQ → All lamps (throttle non-critical traffic)
+#define MSG_TYPE_CONFIG    'A'  // HQ → All lamps (runtime parameter block)
+#define MSG_TYPE_OTA_ADV   'B'  // Node → Neighbors (firmware image summary)
+#define MSG_TYPE_OTA_REQ   'C'  // Lamp → Neighbor (request firmware page)
+#define MSG_TYPE_OTA_DATA  'D'  // Node → Neighbors (coded firmware packet)
+#define MSG_TYPE_TIMESYNC  'E'  // HQ → All lamps (mesh time reference)
+#define MSG_TYPE_CTX_MISS  'F'  // Node → Neighbors (unknown compression context)
+#define MSG_TYPE_CODED     'G'  // Lamp → Neighbors (two broadcasts, network-coded)
+#define MSG_TYPE_CONTACT   'H'  // Mobile HQ ↔ Lamps in range (bulk sync)
+#define MSG_TYPE_CAPS      'I'  // Node → Neighbors (supported framing)
 
 // Header lengths for validation
 #define HEADER_LENGTH_INIT     9   // Type 0 with id and hop
+#define HEADER_LENGTH_INIT_ENERGY 10  // Type 0 relayed by a lamp, plus its energy class
 #define HEADER_LENGTH_STANDARD 13  // Types 1, 2 with hash
+#define HEADER_LENGTH_TARGETED 16  // Type 2 with hash, command ID and attempt
 #define HEADER_LENGTH_SOS      11  // Type 3 with hop, no hash
 #define HEADER_LENGTH_MESSAGE  15  // Type 4 with hash and hop
+#define HEADER_LENGTH_SYNC     9   // Types 5, 6 base, plus 4 chars per hash
+#define HEADER_LENGTH_ACK      14  // Type 7 with command ID, attempt and hop
+#define HEADER_LENGTH_REPORT   15  // Type 8 with broadcast hash and hop
+#define COVERAGE_HEX_LENGTH    16  // Type 8 message: 64-bit bitmap in hex
+#define HEADER_LENGTH_CONGESTION 14  // Type 9 with id, level and duration
+#define HEADER_LENGTH_CONFIG   16  // Type A with hash and apply delay
+#define CONFIG_MESSAGE_LENGTH  18  // Type A message: parameter block
+#define HEADER_LENGTH_OTA_ADV  35  // Type B with version, size, pages held, CRC32, image tag
+#define HEADER_LENGTH_OTA_REQ  14  // Type C with version and page
+#define HEADER_LENGTH_OTA_DATA 16  // Type D with version, page and coding mask
+#define HEADER_LENGTH_TIMESYNC 21  // Type E with sequence, hop and mesh time
+#define HEADER_LENGTH_CTX_MISS 11  // Type F with context ID
+#define HEADER_LENGTH_CODED    21  // Type G with both hashes and lengths
+#define HEADER_LENGTH_CONTACT  10  // Type H base with count, plus 4 chars per hash or key
+#define HEADER_LENGTH_CAPS     11  // Type I with capability bits
+#define HEADER_LENGTH_SOS_V25  9   // v2.5 SOS, no hop (bridged)
+#define HEADER_LENGTH_MESSAGE_V25 13  // v2.5 Type 4, no hop (bridged)
+
+// v2.5 addresses HQ as "000h" (structure/v2/v2.5/config.h); bridged as HQ_ID
+#define LEGACY_HQ_ID "000h"
 
 // ==================== SOS CONFIGURATION ====================
 
@@ -159,6 +765,21 @@ const unsigned long REDUNDANCY_WINDOW = 60000;  // 1 minute
 // All SOS messages are identical emergency alerts
 #define SOS_MESSAGE "SOS"  // For display purposes only, not transmitted
 
+/*
+ * SOS Beacon (one raw 32-bit NEC frame per direction)
+ * Sent ahead of the 11-char SOS header, which still follows as the
+ * reliable path (retransmits). With LPL the frame repeats through one
+ * sleep interval in place of a wake preamble. Bytes, first sent first:
+ *   [marker | seq][origin high][origin low][hop]
+ * Data frames start with 0x00 and wake frames with 0x01, so the marker
+ * nibble can't be confused with either. The command byte carries no
+ * parity, so IRremote decodes the frame as NEC with a parity flag or as
+ * ONKYO depending on version; only decodedRawData is used.
+ */
+#define SOS_BEACON_ENABLED 1
+#define SOS_BEACON_MARKER  0xA0
+#define SOS_BEACON_SEEN_SIZE 4    // Beacons remembered for dedup (own table, not the message cache)
+
 // ==================== DATA STRUCTURES ====================
 
 /*
@@ -173,6 +794,17 @@ struct MsgCache {
   uint16_t msgHash; // Hash of message content
 };
 
+/*
+ * SOS Beacon Seen (dedup)
+ * Kept apart from the message cache: a beacon arrives as a train of
+ * repeated frames and would push message hashes out of it
+ */
+struct SosBeaconSeen {
+  uint16_t origin;
+  uint8_t seq;
+  bool active;
+};
+
 /*
  * Retransmission Tracker
  * Tracks messages that need redundant sending in first minute
@@ -188,6 +820,311 @@ struct RetransmitEntry {
 // Maximum number of concurrent messages being retransmitted
 #define RETRANSMIT_QUEUE_SIZE 3
 
+/*
+ * Broadcast Store Entry
+ * Keeps recent HQ broadcasts so they can be repaired for neighbors
+ * that missed the original flood (anti-entropy sync)
+ */
+struct BroadcastStoreEntry {
+  String header;                    // Original Type 1 header
+  String message;                   // Broadcast content
+  uint16_t msgHash;                 // Hash identifying the broadcast
+  unsigned long storedTime;         // When this lamp first received it
+  bool active;                      // Is this slot in use?
+  uint64_t coverage;                // Lamps known to hold it (self + downstream)
+  unsigned long reportDue;          // When the coverage report should go out
+  bool reportPending;               // Report (or updated report) not yet sent
+};
+
+/*
+ * Runtime Parameter Block
+ * Protocol timing HQ can retune without reflashing (see params.h)
+ */
+struct RuntimeParams {
+  uint8_t magic;                            // PARAMS_MAGIC if valid
+  uint16_t version;                         // Set by HQ (1-65535, 0 = factory), newer replaces older
+  unsigned long irDirectionGap;             // ms
+  unsigned long retransmitInterval;         // ms
+  uint8_t retransmitCount;
+  uint8_t gradientTolerance;                // K
+  unsigned long lifiRebroadcastInterval;    // ms
+};
+
+/*
+ * Firmware Image State
+ * Image being received and/or served to neighbors (see ota.h)
+ */
+struct OtaState {
+  uint8_t version;                  // Image version (0 = none)
+  uint32_t size;                    // Image size in bytes
+  uint16_t pages;                   // Total pages
+  uint16_t pagesHave;               // Pages staged so far (in order)
+  uint32_t crc;                     // Expected CRC32 of the image
+  uint32_t tag;                     // HQ's keyed tag over version, size and image
+  uint8_t rowMask[OTA_PAGE_PACKETS];                  // Decoder rows (0 = empty)
+  uint8_t rowData[OTA_PAGE_PACKETS][OTA_PACKET_BYTES];
+  uint8_t rank;                     // Independent packets held for current page
+  unsigned long lastReqTime;        // Last page request sent
+  unsigned long nextAdvTime;        // Next advertisement
+  int16_t servePage;                // Page a neighbor asked for (-1 = none)
+  uint8_t serveSent;                // Coded packets sent for it so far
+  unsigned long serveUntil;         // Stop advertising an installed image after this
+};
+
+/*
+ * Installed Image Record (EEPROM)
+ * Lets the new firmware keep serving its own image after reboot
+ */
+struct OtaRecord {
+  uint8_t magic;
+  uint8_t version;
+  uint32_t size;
+  uint32_t crc;
+  uint32_t tag;
+};
+
+/*
+ * Deferred Forward
+ * Relay held back by an energy-poor lamp (see ENERGY-BALANCED FORWARDING)
+ */
+struct DeferredForward {
+  String header;                    // Header to relay (hop already decremented)
+  String message;                   // Message to relay
+  String src;                       // Original source
+  uint16_t msgHash;                 // Message hash
+  uint8_t msgHop;                   // Hop of the copy we received
+  unsigned long due;                // Relay if no peer has by then
+  bool active;                      // Is this slot in use?
+};
+
+/*
+ * Upstream Packet Kept for a Mobile HQ
+ */
+struct UplinkEntry {
+  String header;                    // As relayed (SOS or Type 4 toward HQ)
+  String message;
+  uint16_t key;                     // contactKey(), as the vehicle acknowledges it
+  unsigned long storedAt;
+  unsigned long sentAt;             // Last handed to a vehicle (0 = never)
+  bool active;                      // Is this slot in use?
+};
+
+/*
+ * Contact with a Mobile HQ
+ */
+struct ContactState {
+  String hq;                        // Vehicle ID ("" = none yet)
+  unsigned long heardAt;            // Last beacon
+  uint16_t down[CONTACT_DOWN_MAX];  // Downlink it carries
+  uint8_t downCount;
+  uint16_t keys[CONTACT_KEYS];      // Upstream packets it already has
+  uint8_t keyCount;
+  unsigned long pulledAt;           // Last reply that pulled downlink
+  bool replyPending;                // Reply and stream due
+  unsigned long replyAfter;
+};
+
+/*
+ * Contact Counters (since boot)
+ */
+struct ContactStats {
+  unsigned long contacts;           // Vehicles met
+  unsigned long packetsUp;          // Upstream packets handed over
+  unsigned long chars;              // Chars sent in burst frames
+  unsigned long burstMs;            // Time spent sending them
+};
+
+/*
+ * Neighbor Capabilities (see caps.h)
+ */
+struct CapsPeer {
+  String id;                        // Neighbor node ID
+  uint8_t caps;                     // Announced bits (0 = never announced)
+  unsigned long heardAt;            // Last heard, any packet
+  bool active;                      // Is this slot in use?
+};
+
+/*
+ * Capability Counters (since boot)
+ */
+struct CapsStats {
+  unsigned long burstSends;         // Sends in burst frames
+  unsigned long plainSends;         // Sends in plain framing
+  unsigned long bridged;            // v2.5 packets translated
+};
+
+/*
+ * Neighbor Seen per Channel (see vlc.h)
+ */
+struct VlcPeer {
+  String id;                        // Neighbor node ID
+  unsigned long irHeardAt;          // Last heard on IR (0 = never)
+  unsigned long vlcHeardAt;         // Last heard on visible light (0 = never)
+  bool active;                      // Is this slot in use?
+};
+
+/*
+ * Visible-Light Channel Counters (since boot)
+ */
+struct VlcStats {
+  unsigned long sent;               // Frames sent
+  unsigned long chars;              // Chars sent
+  unsigned long irSkipped;          // Sends that left IR out entirely
+  unsigned long irCharsSaved;       // IR chars those would have cost
+  unsigned long received;           // Good frames received
+  unsigned long errors;             // Frames dropped (checksum, length, timeout)
+};
+
+/*
+ * Neighbor Holdings (from its last digest)
+ */
+struct NcNeighbor {
+  String id;                        // Neighbor node ID
+  uint16_t held[BCAST_STORE_SIZE];  // Broadcast hashes it advertised
+  uint8_t heldCount;
+  unsigned long heardAt;            // When the digest was heard
+  bool active;                      // Is this slot in use?
+};
+
+/*
+ * Pulled Broadcast Waiting to Be Served
+ */
+struct NcRepair {
+  String dst;                       // Neighbor that pulled it
+  uint16_t msgHash;                 // Broadcast it is missing
+  unsigned long due;                // Serve by then, coded or plain
+  bool active;                      // Is this slot in use?
+};
+
+/*
+ * Network-Coded Repair Counters (since boot)
+ */
+struct NcStats {
+  unsigned long plain;              // Plain replays sent
+  unsigned long coded;              // Coded packets sent
+  unsigned long saved;              // Chars saved against two plain replays
+  unsigned long decoded;            // Broadcasts we recovered from coded packets
+};
+
+/*
+ * Scheduler Task
+ * Timer and/or event driven unit of work run from loop() (see sched.h)
+ */
+struct Task {
+  const char* name;                 // For runtime accounting output
+  void (*fn)();                     // Task body (must not block long)
+  unsigned long period;             // Timer period in ms (0 = event-only)
+  unsigned long nextRun;            // Next timer deadline
+  volatile bool eventPending;       // Set from ISR or code via schedPostEvent()
+  unsigned long runCount;           // Times run
+  uint64_t totalMicros;             // Total runtime
+  unsigned long maxMicros;          // Worst-case single run
+};
+
+/*
+ * Energy Accounting
+ * Time spent in each power state since boot (see power.h)
+ */
+struct EnergyStats {
+  unsigned long rxMs;               // Receiver on
+  unsigned long rxSince;            // Last receiver accounting update
+  unsigned long txMs;               // IR transmitting
+  unsigned long ledMs;              // Lamp LED on (LiFi)
+};
+
+/*
+ * Mesh Time Estimate
+ * Regression table of (local arrival, mesh - local offset) pairs
+ */
+struct TimeSyncState {
+  unsigned long localTime[TIMESYNC_TABLE_SIZE];
+  long offset[TIMESYNC_TABLE_SIZE];
+  uint8_t count;                    // Valid entries
+  uint8_t next;                     // Slot for the next entry
+  unsigned long localRef;           // Newest point: local time
+  long offsetRef;                   // Newest point: offset
+  float intercept;                  // Fit: offset at localRef, relative to offsetRef
+  float skew;                       // Fit: offset drift per local ms
+  float maxResidual;                // Fit: worst point off the line (ms)
+  uint8_t hop;                      // Hops from HQ of the last beacon
+  uint8_t lastSeq;                  // Sequence number of the last beacon taken
+  unsigned long lastBeacon;         // Local time of the last beacon
+};
+
+/*
+ * Streaming SipHash State (see auth.h)
+ */
+struct SipState {
+  uint64_t v0, v1, v2, v3;
+  uint64_t m;                       // Bytes of the current 8-byte word
+  uint32_t length;                  // Bytes absorbed so far
+};
+
+/*
+ * Suspended Transmission
+ * Packet preempted at a frame boundary, resumed from nextDir
+ */
+struct SuspendedTx {
+  String header;
+  String message;
+  uint8_t nextDir;                  // First direction still to send (0-3)
+  unsigned long suspendedAt;        // When it was preempted
+  bool active;                      // Is this slot in use?
+};
+
+/*
+ * Upstream Packet Watch (adaptive gradient tolerance)
+ */
+struct GradientWatch {
+  String src;                       // Original source
+  uint16_t key;                     // Dedup key (hash, ACK key, 0 for SOS)
+  uint8_t hop;                      // Hop of the first copy heard
+  bool relaying;                    // Passed our gradient check
+  uint8_t copies;                   // Parallel relays (hop - 1) overheard
+  bool progressed;                  // Copy past the next relay step overheard
+  unsigned long heardAt;            // First copy
+  bool active;                      // Is this slot in use?
+};
+
+/*
+ * Adaptive Gradient State
+ */
+struct GradientState {
+  uint8_t tolerance;                // K in use by this lamp
+  float relays;                     // Average parallel relays per packet
+  float progress;                   // Average share of packets that progressed
+  uint16_t watched;                 // Packets watched since boot / K reset
+  uint16_t stalled;                 // Of those, never seen to progress
+};
+
+/*
+ * Header Compression Context
+ */
+struct HcContext {
+  String base;                      // [src][dst][type]
+  uint8_t id;                       // Derived from base
+  unsigned long heardAt;            // Last time the base was heard or sent
+  unsigned long sentFullAt;         // Last full send by us (0 = not since a miss)
+  bool ambiguous;                   // Another base with the same ID is around
+  bool active;                      // Is this slot in use?
+};
+
+/*
+ * Header Compression Counters (since boot)
+ */
+struct HcStats {
+  unsigned long packets;            // Headers sent
+  unsigned long chars;              // Header chars actually sent
+  unsigned long saved;              // Chars saved by compression
+  unsigned long misses;             // Compressed headers we could not expand
+};
+
+// Scheduler limits
+#define SCHED_MAX_TASKS      17
+#define SCHED_NO_TASK        255
+#define SCHED_MAX_SLEEP      1000        // Longest idle before re-checking (ms)
+#define SCHED_EVENT_PRIORITY 0x3FFFFFFFL // Events rank ahead of any timer lateness
+
 // ==================== GLOBAL VARIABLES (declared extern) ====================
 
 // Cache array (defined in main.ino)
@@ -197,6 +1134,106 @@ extern int cacheIndex;
 // Retransmission queue (defined in main.ino)
 extern RetransmitEntry retransmitQueue[RETRANSMIT_QUEUE_SIZE];
 
+// Broadcast store for anti-entropy sync (defined in main.ino)
+extern BroadcastStoreEntry bcastStore[BCAST_STORE_SIZE];
+extern int bcastStoreIndex;
+extern unsigned long nextDigestTime;       // When the next digest is due
+extern unsigned long lastDigestReplyTime;  // Last early digest for a lagging neighbor
+
+// Mobile HQ contact state (defined in main.ino)
+extern UplinkEntry uplinkStore[UPLINK_STORE_SIZE];
+extern int uplinkIndex;
+extern ContactState contact;
+extern ContactStats contactStats;
+
+// Capability negotiation state (defined in main.ino)
+extern CapsPeer capsPeers[CAPS_PEER_SIZE];
+extern CapsStats capsStats;
+extern unsigned long capsNextAnnounce;
+extern unsigned long capsLegacyHeardAt;    // Last v2.5 packet (0 = never)
+
+// Visible-light channel state (defined in main.ino)
+extern VlcPeer vlcPeers[VLC_PEER_SIZE];
+extern VlcStats vlcStats;
+
+// Network-coded repair state (defined in main.ino)
+extern NcNeighbor ncNeighbors[NC_NEIGHBOR_SIZE];
+extern NcRepair ncRepairs[NC_REPAIR_SIZE];
+extern NcStats ncStats;
+
+// Airtime limiter and congestion state (defined in main.ino)
+extern uint16_t airtimeTokens;             // Chars that may be sent right now
+extern unsigned long lastAirtimeRefill;    // Last token refill
+extern uint8_t congestionLevel;            // 0 = normal, set by HQ
+extern unsigned long congestionUntil;      // When declared congestion expires
+
+// Health trailer state (defined in main.ino)
+extern uint8_t healthErrors;               // HEALTH_ERR_* flags since last report
+extern String lastHealthEntry;             // Own entry last piggybacked
+extern String healthRelay;                 // Downstream entries awaiting a packet
+
+// Runtime parameters (defined in main.ino)
+extern RuntimeParams params;               // Active block
+extern RuntimeParams pendingParams;        // Received, waiting for its epoch
+extern bool pendingParamsActive;
+extern unsigned long pendingParamsApplyAt;
+extern uint16_t configFloodVersion;         // Last CONFIG relayed, for its delay restamp
+extern unsigned long configFloodApplyAt;
+
+// Firmware dissemination state (defined in main.ino)
+extern OtaState ota;
+
+// Energy-balanced forwarding state (defined in main.ino)
+extern uint8_t peerEnergy;                 // Best class advertised by gradient peers
+extern unsigned long peerEnergyAt;         // When that class was last advertised
+extern DeferredForward deferredForwards[DEFERRED_FORWARD_SIZE];
+
+// Scheduler state (defined in main.ino)
+extern Task tasks[SCHED_MAX_TASKS];
+extern uint8_t taskCount;
+extern volatile bool schedEventPosted;     // Wakes the idle wait early
+extern uint8_t txCompleteTask;             // Task notified when IR TX finishes
+
+// SOS beacon state (defined in main.ino)
+extern uint32_t rxSosBeacon;               // Last beacon frame heard
+extern bool rxSosBeaconPending;            // Waiting for irReceive
+extern uint8_t sosBeaconSeq;               // Our next beacon sequence (4 bits)
+extern SosBeaconSeen sosBeaconSeen[SOS_BEACON_SEEN_SIZE];
+extern int sosBeaconSeenIndex;
+
+// Header compression state (defined in main.ino)
+extern HcContext hcContexts[HC_CONTEXT_SIZE];
+extern HcStats hcStats;
+extern int16_t hcMissPending;              // Context to report missing (-1 = none)
+extern unsigned long hcLastMiss;           // Last CTX_MISS sent
+
+// Transmit preemption state (defined in main.ino)
+extern SuspendedTx suspendedTx;
+extern volatile bool txPreemptRequested;   // Own SOS pressed during a transmission
+
+// Low-power listening and energy state (defined in main.ino)
+extern bool lplAwake;                      // Receiver currently on
+extern unsigned long lplAwakeUntil;        // Receiver may sleep after this
+extern unsigned long lplNextWake;          // Next check window
+extern unsigned long lplLastTxTime;        // End of our last transmission
+extern EnergyStats energy;
+
+// Message authentication (tag absorbed while the message segment arrives)
+extern SipState rxAuth;
+extern bool rxAuthActive;                  // Absorbing received chars
+extern bool rxAuthReady;                   // rxAuth covers the last complete packet
+extern String rxAuthHeader;                // Header rxAuth was started for
+
+// Mesh time sync
+extern TimeSyncState timeSync;
+extern volatile unsigned long irFrameTime; // Last decoded IR frame (set in interrupt)
+extern unsigned long irSegmentTime;        // Arrival of the last complete segment
+extern unsigned long irHeaderTime;         // Arrival of the last two-segment header
+
+// Adaptive gradient state (defined in main.ino)
+extern GradientState gradient;
+extern GradientWatch gradientWatch[GRADIENT_WATCH_SIZE];
+
 // Gradient system state (defined in main.ino)
 extern String lastInitID;  // Last seen INIT ID
 extern uint8_t myHop;      // This node's distance from HQ
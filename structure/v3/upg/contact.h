@@ -0,0 +1,224 @@
+#ifndef CONTACT_H
+#define CONTACT_H
+
+#include <Arduino.h>
+#include <IRremote.h>
+#include "config.h"
+#include "lifi.h"
+
+// ==================== MOBILE HQ CONTACT ====================
+
+/*
+ * Bulk Sync with a Passing HQ Vehicle (Type H)
+ *
+ * A vehicle is in range for a few seconds, and every round trip on IR
+ * costs seconds, so the exchange is summary-first and has one turn each:
+ * - Vehicle beacon: downlink hashes it carries, plus the keys of the
+ *   last upstream packets it collected (so lamps skip those)
+ * - Lamp reply: how many upstream packets follow, and the downlink
+ *   hashes it is missing; the packets follow back to back
+ * - The vehicle serves the missing downlink once the announced packets
+ *   are in (or stop coming)
+ * Everything goes in burst frames toward the road (CONTACT_DIR_MASK),
+ * without a wake preamble: the vehicle's receiver is always on.
+ *
+ * Lamps keep the last UPLINK_STORE_SIZE SOS / Type 4 packets they relayed
+ * toward HQ, so a vehicle can pick them up where the mesh is cut off.
+ */
+
+/*
+ * Key of an Upstream Packet (same on HQ)
+ * SOS by origin, Type 4 by origin and message hash
+ */
+inline uint16_t contactKey(String header){
+  String id = header.substring(0, 4) + header[8];
+  if(header[8] == MSG_TYPE_MESSAGE) id += header.substring(9, 13);
+  return simpleHash(id);
+}
+
+/*
+ * Keep an Upstream Packet for the Next Vehicle
+ * Oldest entry is overwritten (circular, like the dedup cache)
+ */
+inline void uplinkStoreAdd(String header, String message){
+  if(!CONTACT_ENABLED) return;
+  uint16_t key = contactKey(header);
+  for(int i = 0; i < UPLINK_STORE_SIZE; i++){
+    if(uplinkStore[i].active && uplinkStore[i].key == key) return;
+  }
+
+  UplinkEntry &e = uplinkStore[uplinkIndex];
+  e.header = header;
+  e.message = message;
+  e.key = key;
+  e.storedAt = millis();
+  e.sentAt = 0;
+  e.active = true;
+  uplinkIndex = (uplinkIndex + 1) % UPLINK_STORE_SIZE;
+}
+
+/*
+ * Should This Stored Packet Go to the Vehicle Now
+ */
+inline bool uplinkDue(UplinkEntry &e){
+  return e.active && millis() - e.storedAt <= UPLINK_MAX_AGE &&
+         (e.sentAt == 0 || millis() - e.sentAt > CONTACT_RESEND);
+}
+
+/*
+ * Downlink the Vehicle Carries That We Are Missing
+ * Returns the hashes as they go into the reply ("" if none or pulled lately)
+ */
+inline String contactPulls(){
+  if(contact.pulledAt != 0 && millis() - contact.pulledAt <= CONTACT_RESEND) return "";
+
+  String pulls = "";
+  for(int i = 0; i < contact.downCount; i++){
+    if(bcastStoreHas(contact.down[i])) continue;
+    char hashStr[5];
+    sprintf(hashStr, "%04X", contact.down[i]);
+    pulls += hashStr;
+  }
+  return pulls;
+}
+
+/*
+ * Send a Contact Packet in Burst Frames toward the Road
+ */
+inline void contactSend(String header, String message){
+  const int txPins[] = {IR_TX_FRONT, IR_TX_RIGHT, IR_TX_BACK, IR_TX_LEFT};
+  unsigned long start = millis();
+  IrReceiver.stop();
+
+  for(int i = 0; i < 4; i++){
+    if(!(CONTACT_DIR_MASK & (1 << i))) continue;
+
+    String headerWithDelim = header + " ";
+    irSendBurst(headerWithDelim.c_str(), txPins[i]);
+    contactStats.chars += headerWithDelim.length();
+
+    if(message.length() > 0){
+      delay(50);
+      String messageWithDelim = message + " ";
+      irSendBurst(messageWithDelim.c_str(), txPins[i]);
+      contactStats.chars += messageWithDelim.length();
+    }
+  }
+
+  energy.txMs += millis() - start;
+  contactStats.burstMs += millis() - start;
+  energyUpdateRx();
+  IrReceiver.start();
+  lplAwake = true;
+  lplAwakeUntil = millis() + LPL_WAKE_HOLD;
+  schedNotifyTxComplete();
+}
+
+/*
+ * Handle a Type H Packet
+ * Beacons from a vehicle schedule our reply; other lamps' replies are
+ * only traffic to wait out
+ */
+inline void processContactBeacon(String header){
+  String src = header.substring(0, 4);
+  if(header.substring(4, 8) != BROADCAST_ID || !IS_MOBILE_HQ(src)) return;
+
+  int n = (int) strtol(header.substring(9, 10).c_str(), NULL, 16);
+  if(n > CONTACT_DOWN_MAX || header.length() < (unsigned int)(HEADER_LENGTH_CONTACT + 4 * n)) return;
+
+  if(src != contact.hq || millis() - contact.heardAt > CONTACT_HOLD){
+    contact.hq = src;
+    contact.pulledAt = 0;
+    contact.replyPending = false;
+    contactStats.contacts++;
+    Serial.print(">>> CONTACT: Mobile HQ ");
+    Serial.print(src);
+    Serial.println(" in range");
+  }
+  contact.heardAt = millis();
+
+  contact.downCount = 0;
+  unsigned int pos = HEADER_LENGTH_CONTACT;
+  for(; contact.downCount < n; pos += 4){
+    contact.down[contact.downCount++] = (uint16_t) strtol(header.substring(pos, pos + 4).c_str(), NULL, 16);
+  }
+  contact.keyCount = 0;
+  for(; pos + 4 <= header.length() && contact.keyCount < CONTACT_KEYS; pos += 4){
+    contact.keys[contact.keyCount++] = (uint16_t) strtol(header.substring(pos, pos + 4).c_str(), NULL, 16);
+  }
+
+  // Acknowledged packets have reached an HQ
+  int due = 0;
+  for(int i = 0; i < UPLINK_STORE_SIZE; i++){
+    for(int k = 0; k < contact.keyCount; k++){
+      if(uplinkStore[i].active && uplinkStore[i].key == contact.keys[k]) uplinkStore[i].active = false;
+    }
+    if(uplinkDue(uplinkStore[i])) due++;
+  }
+
+  if(!contact.replyPending && (due > 0 || contactPulls().length() > 0)){
+    contact.replyPending = true;
+    contact.replyAfter = millis() + random(CONTACT_REPLY_JITTER);
+  }
+}
+
+/*
+ * Reply to the Vehicle and Stream Upstream Packets (scheduler task)
+ */
+inline void processContact(){
+  if(!contact.replyPending) return;
+  if(millis() - contact.heardAt > CONTACT_HOLD){
+    contact.replyPending = false;  // Gone before we got a turn
+    return;
+  }
+  if((long)(millis() - contact.replyAfter) < 0) return;
+  if(millis() - irFrameTime < CONTACT_QUIET) return;  // Vehicle or another lamp still talking
+
+  int due = 0;
+  for(int i = 0; i < UPLINK_STORE_SIZE; i++){
+    if(uplinkDue(uplinkStore[i])) due++;
+  }
+  String pulls = contactPulls();
+
+  char count[2];
+  sprintf(count, "%X", due);
+  String reply = String(NODE_ID) + contact.hq + MSG_TYPE_CONTACT + count + pulls;
+  if(!airtimeAllowed(reply)) return;  // Retried until CONTACT_HOLD runs out
+  contact.replyPending = false;
+
+  Serial.print(">>> CONTACT: ");
+  Serial.print(due);
+  Serial.print(" upstream packet(s) for ");
+  Serial.print(contact.hq);
+  Serial.print(", pulling ");
+  Serial.print(pulls.length() / 4);
+  Serial.println(" broadcast(s)");
+
+  contactSend(reply, "");
+  if(pulls.length() > 0) contact.pulledAt = millis();
+
+  // Oldest first, back to back
+  for(int j = 0; j < UPLINK_STORE_SIZE; j++){
+    UplinkEntry &e = uplinkStore[(uplinkIndex + j) % UPLINK_STORE_SIZE];
+    if(!uplinkDue(e)) continue;
+    if(!airtimeAllowed(e.header, e.message)) break;  // Rest wait for the next vehicle
+    contactSend(e.header, e.message);
+    e.sentAt = millis();
+    contactStats.packetsUp++;
+  }
+}
+
+/*
+ * Print Contact Counters
+ */
+inline void printContact(){
+  Serial.print("Contacts: ");
+  Serial.print(contactStats.contacts);
+  Serial.print(" vehicles, ");
+  Serial.print(contactStats.packetsUp);
+  Serial.print(" packets up, ");
+  Serial.print(contactStats.burstMs ? contactStats.chars * 1000.0 / contactStats.burstMs : 0.0, 1);
+  Serial.println(" chars/s in bursts");
+}
+
+#endif // CONTACT_H
@@ -0,0 +1,162 @@
+#ifndef GRADIENT_H
+#define GRADIENT_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ==================== ADAPTIVE GRADIENT TOLERANCE ====================
+
+/*
+ * Per-Lamp Gradient Tolerance (K)
+ * One K for the whole mesh is too generous in dense grids (every lamp
+ * near the path relays) and too strict on sparse lines (one dark lamp
+ * and the packet dies). Each lamp watches the upstream packets it hears
+ * and adjusts its own K from what happens to them next. For a first copy
+ * at hop h:
+ *   - if we relay it (copy h - 1), a copy at h - 2 or less means someone
+ *     took it on from us; other copies at h - 1 are parallel relays
+ *   - if the gradient check turned it down, any copy below h means
+ *     someone else relayed it
+ * Lamps more than one hop outside the check can't hear what happens
+ * upstream and don't watch. The sender's own retransmits come back at h
+ * and are not counted.
+ */
+
+/*
+ * Restart Adaptation from the Runtime Parameter
+ * Called at boot and when HQ pushes a new K
+ */
+inline void gradientReset(){
+  gradient.tolerance = constrain(params.gradientTolerance, GRADIENT_K_MIN, GRADIENT_K_MAX);
+  gradient.relays = 0;
+  gradient.progress = 1.0;
+  gradient.watched = 0;
+  gradient.stalled = 0;
+  for(int i = 0; i < GRADIENT_WATCH_SIZE; i++){
+    gradientWatch[i].active = false;
+  }
+}
+
+/*
+ * Close a Watch and Adjust K
+ */
+inline void gradientFinish(GradientWatch &w){
+  w.active = false;
+
+  #if GRADIENT_ADAPTIVE
+    // Each relay sends its copy retransmitCount times
+    float relays = (float)w.copies / max((uint8_t)1, params.retransmitCount);
+
+    gradient.watched++;
+    gradient.relays += GRADIENT_EWMA * (relays - gradient.relays);
+    gradient.progress += GRADIENT_EWMA * ((w.progressed ? 1.0 : 0.0) - gradient.progress);
+
+    #if DEBUG_GRADIENT
+      uint8_t before = gradient.tolerance;
+    #endif
+    if(!w.progressed){
+      gradient.stalled++;
+      if(gradient.tolerance < GRADIENT_K_MAX) gradient.tolerance++;
+    } else if(relays >= GRADIENT_REDUNDANT_RELAYS && gradient.tolerance > GRADIENT_K_MIN){
+      gradient.tolerance--;
+    }
+
+    #if DEBUG_GRADIENT
+      Serial.print(">>> GRADIENT: Packet from ");
+      Serial.print(w.src);
+      Serial.print(w.progressed ? " progressed, " : " stalled, ");
+      Serial.print(relays, 1);
+      Serial.print(" parallel relays");
+      if(gradient.tolerance != before){
+        Serial.print(" - K now ");
+        Serial.print(gradient.tolerance);
+      }
+      Serial.println();
+    #endif
+  #endif
+}
+
+/*
+ * Observe an Upstream Copy (call before the gradient check)
+ * @param src    - Original source
+ * @param key    - Dedup key of the packet
+ * @param msgHop - Hop field of this copy
+ */
+inline void gradientObserve(String src, uint16_t key, uint8_t msgHop){
+  for(int i = 0; i < GRADIENT_WATCH_SIZE; i++){
+    GradientWatch &w = gradientWatch[i];
+    if(!w.active || w.key != key || w.src != src) continue;
+
+    uint8_t nextHop = w.relaying ? w.hop - 1 : w.hop;
+    if(msgHop < nextHop) w.progressed = true;
+    else if(w.relaying && msgHop == nextHop && w.copies < 255) w.copies++;
+    return;
+  }
+
+  bool relaying = myHop <= msgHop + gradient.tolerance;
+  if(!relaying && myHop > msgHop + gradient.tolerance + 1) return;  // Too far off to tell
+
+  // Our relay reaches HQ directly, which never relays on
+  if(myHop < 2 || (relaying && msgHop < 2)) return;
+
+  // New packet: free slot, or close the oldest watch early
+  int slot = 0;
+  for(int i = 0; i < GRADIENT_WATCH_SIZE; i++){
+    if(!gradientWatch[i].active){
+      slot = i;
+      break;
+    }
+    if((long)(gradientWatch[i].heardAt - gradientWatch[slot].heardAt) < 0) slot = i;
+  }
+  if(gradientWatch[slot].active) gradientFinish(gradientWatch[slot]);
+
+  GradientWatch &w = gradientWatch[slot];
+  w.src = src;
+  w.key = key;
+  w.hop = msgHop;
+  w.relaying = relaying;
+  w.copies = 0;
+  w.progressed = false;
+  w.heardAt = millis();
+  w.active = true;
+}
+
+/*
+ * Close Expired Watches (scheduler task)
+ */
+inline void processGradientWatch(){
+  for(int i = 0; i < GRADIENT_WATCH_SIZE; i++){
+    GradientWatch &w = gradientWatch[i];
+    if(w.active && millis() - w.heardAt >= GRADIENT_WATCH_WINDOW) gradientFinish(w);
+  }
+}
+
+/*
+ * Health Trailer Fields: [K][parallel relays][progress tenths]
+ */
+inline String gradientHealth(){
+  char fields[4];
+  sprintf(fields, "%X%X%X", gradient.tolerance & 0xF,
+          (unsigned int)min(15, (int)(gradient.relays + 0.5)),
+          (unsigned int)(gradient.progress * 10 + 0.5));
+  return String(fields);
+}
+
+/*
+ * Print Adaptive Gradient Status
+ */
+inline void printGradient(){
+  Serial.print("Gradient K: ");
+  Serial.print(gradient.tolerance);
+  Serial.print(" (base ");
+  Serial.print(params.gradientTolerance);
+  Serial.print("), ");
+  Serial.print(gradient.watched);
+  Serial.print(" watched, ");
+  Serial.print(gradient.stalled);
+  Serial.print(" stalled, ");
+  Serial.print(gradient.relays, 1);
+  Serial.println(" parallel relays avg");
+}
+
+#endif // GRADIENT_H
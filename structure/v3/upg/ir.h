@@ -4,6 +4,8 @@
 #include <Arduino.h>
 #include <IRremote.h>
 #include "config.h"
+#include "power.h"
+#include "auth.h"
 
 // ==================== IR COMMUNICATION LAYER ====================
 
@@ -33,8 +35,10 @@ inline void irInit() {
  * 
  * @param str - Null-terminated string to send
  * @param txPin - Pin number to transmit from (e.g., IR_TX_FRONT)
+ * @param preemptible - Stop before the next char if our own SOS is pending
+ * @return false if preempted part-way
  */
-inline void irSendString(const char* str, int txPin) {
+inline bool irSendString(const char* str, int txPin, bool preemptible = false) {
   #if DEBUG_IR_TX
     Serial.print(">>> IR TX: Initializing pin D");
     Serial.print(txPin);
@@ -55,6 +59,14 @@ inline void irSendString(const char* str, int txPin) {
   // Send each character
   int charCount = 0;
   while (*str) {
+    // Frame boundary: a pending SOS goes first
+    if (preemptible && txPreemptRequested) {
+      #if DEBUG_IR_TX
+        Serial.println(">>> IR TX: Preempted by SOS");
+      #endif
+      return false;
+    }
+    
     IrSender.sendNEC(0x00, *str, 0);
     
     #if DEBUG_IR_TX && DEBUG_TIMING
@@ -72,6 +84,186 @@ inline void irSendString(const char* str, int txPin) {
   #if DEBUG_IR_TX
     Serial.println(">>> IR TX: Transmission complete");
   #endif
+  return true;
+}
+
+/*
+ * Listen Between Directions (Transmit Preemption)
+ * Turns the receiver on for one window; any frame heard may be the start
+ * of a neighbor's SOS, so the caller yields the rest of its send.
+ * The receiver is left running if something was heard (the frame stays
+ * buffered for irReceiveString), otherwise it is stopped again.
+ *
+ * @return true if a frame arrived during the window
+ */
+inline bool irListenForTraffic(unsigned long window) {
+  unsigned long heardBefore = irFrameTime;
+  IrReceiver.start();
+  
+  unsigned long start = millis();
+  while (millis() - start < window && irFrameTime == heardBefore) {
+    delay(1);
+  }
+  
+  if (irFrameTime != heardBefore) {
+    #if DEBUG_IR_TX
+      Serial.println(">>> IR TX: Neighbor traffic heard between directions");
+    #endif
+    return true;
+  }
+  
+  IrReceiver.stop();
+  return false;
+}
+
+/*
+ * Send Wake Preamble (Low-Power Listening)
+ * Repeats wake frames round-robin over all 4 directions for one full
+ * sleep interval plus check window, so every sleeping neighbor hears
+ * at least one and stays awake for the packet that follows
+ */
+inline void irSendWakePreamble() {
+  #if LPL_ENABLED
+    const int txPins[] = {IR_TX_FRONT, IR_TX_RIGHT, IR_TX_BACK, IR_TX_LEFT};
+    
+    // Neighbors are still awake from our previous transmission
+    if (lplLastTxTime != 0 && millis() - lplLastTxTime < LPL_PREAMBLE_SKIP) return;
+    
+    #if DEBUG_IR_TX
+      Serial.println(">>> IR TX: Sending wake preamble...");
+    #endif
+    
+    unsigned long start = millis();
+    int frames = 0;
+    while (millis() - start < LPL_SLEEP_INTERVAL + LPL_LISTEN_WINDOW) {
+      IrSender.begin(txPins[frames % 4], ENABLE_LED_FEEDBACK);
+      IrSender.sendNEC(LPL_WAKE_ADDRESS, 0, 0);
+      frames++;
+      delay(10);
+    }
+    
+    #if DEBUG_IR_TX
+      Serial.print(">>> IR TX: Wake preamble done (");
+      Serial.print(frames);
+      Serial.println(" frames)");
+    #endif
+  #endif
+}
+
+/*
+ * Send SOS Beacon Frame to All 4 Directions
+ * One raw NEC frame per direction (~70ms each). With LPL the beacon is
+ * its own wake preamble: frames repeat round-robin for one sleep interval
+ * plus check window, so every sleeping neighbor's check window catches
+ * one and it stays awake for the full SOS, which then skips its preamble.
+ * Skipped, like the preamble, while neighbors are awake from our last send.
+ */
+inline void irSendSosBeacon(uint32_t raw) {
+  const int txPins[] = {IR_TX_FRONT, IR_TX_RIGHT, IR_TX_BACK, IR_TX_LEFT};
+  
+  unsigned long train = 0;
+  #if LPL_ENABLED
+    if (lplLastTxTime == 0 || millis() - lplLastTxTime >= LPL_PREAMBLE_SKIP) {
+      train = LPL_SLEEP_INTERVAL + LPL_LISTEN_WINDOW;
+    }
+  #endif
+  
+  #if DEBUG_IR_TX
+    Serial.print(">>> IR TX: SOS beacon 0x");
+    Serial.print(raw, HEX);
+    Serial.println(train ? " (repeated through a sleep interval)" : "");
+  #endif
+  
+  IrReceiver.stop();
+  unsigned long start = millis();
+  int frames = 0;
+  
+  do {
+    IrSender.begin(txPins[frames % 4], ENABLE_LED_FEEDBACK);
+    IrSender.sendNECRaw(raw, 0);
+    frames++;
+    delay(10);
+  } while (frames % 4 != 0 || millis() - start < train);
+  
+  energy.txMs += millis() - start;
+  energyUpdateRx();
+  IrReceiver.start();
+  lplLastTxTime = millis();
+  lplAwake = true;
+  lplAwakeUntil = millis() + LPL_WAKE_HOLD;
+}
+
+/*
+ * Is the Decoded Frame an SOS Beacon
+ * Checked before data frames: no parity on the command byte
+ */
+inline bool irIsSosBeacon() {
+  #if SOS_BEACON_ENABLED
+    return (IrReceiver.decodedIRData.protocol == NEC || IrReceiver.decodedIRData.protocol == ONKYO) &&
+           (IrReceiver.decodedIRData.decodedRawData & 0xF0) == SOS_BEACON_MARKER;
+  #else
+    return false;
+  #endif
+}
+
+/*
+ * 4-bit Check of a Burst Frame's Chars
+ */
+inline uint8_t irBurstCheck(uint8_t c1, uint8_t c2, uint8_t c3) {
+  uint8_t x = c1 ^ c2 ^ c3;
+  return (x ^ (x >> 4)) & 0x0F;
+}
+
+/*
+ * Send String in Burst Frames (Mobile HQ Contact, Burst-Capable Neighbors)
+ * Raw NEC [marker | check][c1][c2][c3], unused chars 0; a segment never
+ * shares a frame with the next, so ' ' always ends one
+ *
+ * @param str - Null-terminated segment, ' ' delimiter included
+ * @param txPin - Pin number to transmit from
+ * @param preemptible - Stop before the next frame if our own SOS is pending
+ * @return false if preempted part-way
+ */
+inline bool irSendBurst(const char* str, int txPin, bool preemptible = false) {
+  IrSender.begin(txPin, ENABLE_LED_FEEDBACK);
+  
+  #if DEBUG_IR_TX
+    Serial.print(">>> IR TX: Burst '");
+    Serial.print(str);
+    Serial.print("' (");
+    Serial.print((strlen(str) + 2) / 3);
+    Serial.println(" frames)");
+  #endif
+  
+  while (*str) {
+    if (preemptible && txPreemptRequested) {
+      #if DEBUG_IR_TX
+        Serial.println(">>> IR TX: Preempted by SOS");
+      #endif
+      return false;
+    }
+    
+    uint8_t c[3] = {0, 0, 0};
+    for (int i = 0; i < 3 && *str; i++) c[i] = *str++;
+    
+    uint32_t raw = (CONTACT_BURST_MARKER | irBurstCheck(c[0], c[1], c[2])) |
+                   ((uint32_t)c[0] << 8) | ((uint32_t)c[1] << 16) | ((uint32_t)c[2] << 24);
+    IrSender.sendNECRaw(raw, 0);
+    delay(100);  // Same gap as single chars
+  }
+  return true;
+}
+
+/*
+ * Is the Decoded Frame a Burst Frame
+ */
+inline bool irIsBurstFrame() {
+  #if CONTACT_ENABLED
+    return (IrReceiver.decodedIRData.protocol == NEC || IrReceiver.decodedIRData.protocol == ONKYO) &&
+           (IrReceiver.decodedIRData.decodedRawData & 0xF0) == CONTACT_BURST_MARKER;
+  #else
+    return false;
+  #endif
 }
 
 /*
@@ -93,11 +285,63 @@ inline bool irReceiveString(String &receivedLine) {
       Serial.println("'");
     #endif
     buffer = "";
+    rxAuthActive = false;  // Streamed tag no longer matches the buffer
   }
   
   // Try to decode incoming IR
   if (IrReceiver.decode()) {
+    // A whole SOS in one frame: handed to irReceive ahead of everything else
+    if (irIsSosBeacon()) {
+      lplExtendAwake();
+      rxSosBeacon = IrReceiver.decodedIRData.decodedRawData;
+      rxSosBeaconPending = true;
+      
+      #if DEBUG_IR_RX
+        Serial.print(">>> IR RX: SOS beacon 0x");
+        Serial.println(rxSosBeacon, HEX);
+      #endif
+      
+      IrReceiver.resume();
+      return false;
+    }
+    
+    // Three chars at once; a garbled frame loses the segment
+    if (irIsBurstFrame()) {
+      lplExtendAwake();
+      uint32_t raw = IrReceiver.decodedIRData.decodedRawData;
+      uint8_t c[3] = {(uint8_t)(raw >> 8), (uint8_t)(raw >> 16), (uint8_t)(raw >> 24)};
+      IrReceiver.resume();
+      
+      if ((raw & 0x0F) != irBurstCheck(c[0], c[1], c[2])) {
+        #if DEBUG_IR_RX
+          Serial.println(">>> IR RX: Burst frame check failed - segment dropped");
+        #endif
+        buffer = "";
+        rxAuthActive = false;
+        return false;
+      }
+      
+      for (int i = 0; i < 3 && c[i] != 0; i++) {
+        if (c[i] == ' ') {
+          receivedLine = buffer;
+          irSegmentTime = irFrameTime ? irFrameTime : millis();
+          buffer = "";
+          return true;
+        }
+        buffer += (char)c[i];
+        if (rxAuthActive) sipUpdate(rxAuth, c[i]);
+      }
+      lastCharTime = millis();
+      return false;
+    }
+    
     if (IrReceiver.decodedIRData.protocol == NEC) {
+      lplExtendAwake();
+    }
+    
+    // Wake preamble frames only keep the receiver up
+    if (IrReceiver.decodedIRData.protocol == NEC &&
+        IrReceiver.decodedIRData.address != LPL_WAKE_ADDRESS) {
       char c = (char)IrReceiver.decodedIRData.command;
       
       #if DEBUG_IR_RX
@@ -111,6 +355,7 @@ inline bool irReceiveString(String &receivedLine) {
       if (c == ' ') {
         // Space delimiter = end of message segment
         receivedLine = buffer;
+        irSegmentTime = irFrameTime ? irFrameTime : millis();  // Decode time, not task time
         
         #if DEBUG_IR_RX
           Serial.println(">>> IR RX: COMPLETE SEGMENT RECEIVED");
@@ -127,6 +372,7 @@ inline bool irReceiveString(String &receivedLine) {
       } else {
         // Accumulate character
         buffer += c;
+        if (rxAuthActive) sipUpdate(rxAuth, c);
         lastCharTime = millis();
         
         #if DEBUG_IR_RX
@@ -4,6 +4,13 @@
 #include <Arduino.h>
 #include "config.h"
 #include "ir.h"  // IR communication layer
+#include "sched.h"  // TX complete notification
+#include "params.h"  // Runtime parameter block
+#include "timesync.h"  // Mesh time estimate
+#include "gradient.h"  // Adaptive gradient tolerance
+#include "compress.h"  // Link-level header compression
+#include "netcode.h"  // Network-coded broadcast repair
+#include "vlc.h"  // Visible-light lamp-to-lamp channel
 
 // ==================== UTILITY FUNCTIONS ====================
 
@@ -19,6 +26,67 @@ inline uint16_t simpleHash(String s){
   return h;
 }
 
+/*
+ * Expected Hash Field of a Received Packet
+ * Keyed tag for covered types (streamed during reception when it matches
+ * this packet), simpleHash otherwise
+ */
+inline uint16_t packetHash(String header, String message){
+  if(!authCovers(header[8])) return simpleHash(message);
+
+  if(rxAuthReady && rxAuth.length == 9 + message.length() && rxAuthHeader == header){
+    return sipFinal16(rxAuth);
+  }
+  return authTag(header, message);
+}
+
+/*
+ * Parse Hierarchical Address
+ * Packs [district][street][lamp] hex chars into 16 bits; trailing
+ * ADDR_WILDCARD chars clear the matching nibbles of mask (prefix)
+ * Returns false if id is not an address or prefix
+ */
+inline bool addrParse(String id, uint16_t &addr, uint16_t &mask){
+  if(id.length() != 4) return false;
+  addr = 0;
+  mask = 0;
+  bool wildcard = false;
+  for(int i = 0; i < 4; i++){
+    char c = id[i];
+    uint8_t nibble = 0;
+    if(c == ADDR_WILDCARD) wildcard = true;
+    else if(wildcard) return false;  // Wildcards only as a suffix
+    else if(c >= '0' && c <= '9') nibble = c - '0';
+    else if(c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+    else if(c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+    else return false;
+    addr = (addr << 4) | nibble;
+    mask = (mask << 4) | (wildcard ? 0x0 : 0xF);
+  }
+  return true;
+}
+
+/*
+ * Is Destination This Lamp
+ * Exact address or a district / street prefix containing it
+ * (compares packed integers, not Strings)
+ */
+inline bool addrMatches(String dst){
+  static uint16_t self, selfMask;
+  static bool selfValid = addrParse(NODE_ID, self, selfMask);
+  
+  uint16_t addr, mask;
+  if(!selfValid || !addrParse(dst, addr, mask)) return false;
+  return (self & mask) == addr;
+}
+
+/*
+ * Is Destination a District / Street Prefix
+ */
+inline bool addrIsGroup(String dst){
+  return dst.indexOf(ADDR_WILDCARD) >= 0;
+}
+
 /*
  * Check if Message is New (Not in Cache)
  * Returns true if new, false if duplicate
@@ -59,23 +127,116 @@ inline bool isNew(String src, uint16_t hash){
   return true;
 }
 
+// ==================== AIRTIME LIMITER ====================
+
+/*
+ * Classify Packet for Airtime Limiting
+ * Based on the type char at header position 8
+ */
+inline uint8_t txClass(String header){
+  switch(header[8]){
+    case MSG_TYPE_INIT:
+    case MSG_TYPE_BROADCAST:
+    case MSG_TYPE_TARGETED:
+    case MSG_TYPE_SOS:
+    case MSG_TYPE_ACK:
+    case MSG_TYPE_CONGESTION:
+    case MSG_TYPE_CONFIG:
+      return TX_CLASS_CRITICAL;
+    case MSG_TYPE_REPORT:
+    case MSG_TYPE_DIGEST:
+    case MSG_TYPE_PULL:
+    case MSG_TYPE_CODED:
+    case MSG_TYPE_CAPS:
+    case MSG_TYPE_TIMESYNC:  // Restamped when finally sent, so deferral is harmless
+      return TX_CLASS_BULK;
+    case MSG_TYPE_OTA_ADV:
+    case MSG_TYPE_OTA_REQ:
+    case MSG_TYPE_OTA_DATA:
+      return TX_CLASS_OTA;
+    default:
+      return TX_CLASS_NORMAL;  // Type 4, CTX_MISS, CONTACT, anything added later
+  }
+}
+
+/*
+ * Check Airtime Budget and Consume Tokens
+ * Returns true if the packet may be sent now
+ * Critical traffic is always allowed and does not consume tokens;
+ * everything else, firmware pages included, pays for its characters
+ */
+inline bool airtimeAllowed(String header, String message = ""){
+  uint8_t cls = txClass(header);
+  if(cls == TX_CLASS_CRITICAL) return true;
+  if(vlcCarries(header[8]) && vlcReplacesIr()) return true;  // Not going on IR at all
+  
+  unsigned long now = millis();
+  
+  // Declared congestion expires on its own
+  if(congestionLevel > 0 && (long)(now - congestionUntil) >= 0){
+    congestionLevel = 0;
+    #if DEBUG_AIRTIME
+      Serial.println(">>> AIRTIME: Congestion period over");
+    #endif
+  }
+  
+  if((cls == TX_CLASS_BULK || cls == TX_CLASS_OTA) && congestionLevel > 0) return false;
+  
+  // Refill, slower while congested
+  unsigned long interval = AIRTIME_REFILL_INTERVAL * (1 + congestionLevel);
+  unsigned long refill = (now - lastAirtimeRefill) / interval;
+  if(refill > 0){
+    airtimeTokens = min((unsigned long)AIRTIME_BUCKET_SIZE, airtimeTokens + refill);
+    lastAirtimeRefill = (airtimeTokens == AIRTIME_BUCKET_SIZE) ? now : lastAirtimeRefill + refill * interval;
+  }
+  
+  uint16_t cost = header.length() + message.length() + 2;  // Plus delimiters
+  if(airtimeTokens < cost){
+    #if DEBUG_AIRTIME
+      Serial.print(">>> AIRTIME: Budget exhausted (need ");
+      Serial.print(cost);
+      Serial.print(", have ");
+      Serial.print(airtimeTokens);
+      Serial.println(")");
+    #endif
+    return false;
+  }
+  
+  airtimeTokens -= cost;
+  return true;
+}
+
 // Forward declaration for retransmit queue
-inline void irSendRaw(String header, String message);
+inline void irSendRaw(String header, String message = "", uint8_t firstDir = 0);
+
+// Firmware dissemination handlers (defined in ota.h)
+inline void processOtaAdv(String header);
+inline void processOtaReq(String header);
+inline void processOtaData(String header, String message);
+
+// Mobile HQ contact handlers (defined in contact.h)
+inline void processContactBeacon(String header);
+inline void uplinkStoreAdd(String header, String message);
+
+// Capability negotiation (defined in caps.h)
+inline bool capsLinkAllows(uint8_t cap);
+inline bool capsPeerHas(String id, uint8_t cap);
 
 // ==================== RETRANSMISSION QUEUE MANAGEMENT ====================
 
 /*
  * Add Message to Retransmission Queue
- * Messages will be sent RETRANSMIT_COUNT times over the first minute
+ * Messages will be sent params.retransmitCount times over the first minute
+ * sentCount = 0 queues a message held back by the airtime limiter
  */
-inline void addToRetransmitQueue(String header, String message = ""){
+inline void addToRetransmitQueue(String header, String message = "", uint8_t sentCount = 1){
   // Find empty slot
   for(int i = 0; i < RETRANSMIT_QUEUE_SIZE; i++){
     if(!retransmitQueue[i].active){
       retransmitQueue[i].header = header;
       retransmitQueue[i].message = message;
       retransmitQueue[i].firstSentTime = millis();
-      retransmitQueue[i].sentCount = 1;  // First transmission already done
+      retransmitQueue[i].sentCount = sentCount;  // 1 = first transmission already done
       retransmitQueue[i].active = true;
       
       #if DEBUG_RETRANSMIT
@@ -87,6 +248,7 @@ inline void addToRetransmitQueue(String header, String message = ""){
     }
   }
   Serial.println(">>> RETRANSMIT: Warning - Queue full!");
+  healthErrors |= HEALTH_ERR_QUEUE_FULL;
 }
 
 /*
@@ -104,6 +266,9 @@ inline void processRetransmitQueue(){
     // Check if redundancy window expired (1 minute passed)
     if(elapsed > REDUNDANCY_WINDOW){
       retransmitQueue[i].active = false;  // Deactivate slot
+      if(retransmitQueue[i].sentCount == 0){
+        Serial.println(">>> RETRANSMIT: Deferred message dropped (no airtime)");
+      }
       #if DEBUG_RETRANSMIT
         Serial.print(">>> RETRANSMIT: Complete for slot ");
         Serial.println(i);
@@ -112,9 +277,10 @@ inline void processRetransmitQueue(){
     }
     
     // Check if it's time for next retransmission
-    unsigned long nextSendTime = retransmitQueue[i].sentCount * RETRANSMIT_INTERVAL;
+    unsigned long nextSendTime = retransmitQueue[i].sentCount * params.retransmitInterval;
     
-    if(elapsed >= nextSendTime && retransmitQueue[i].sentCount < RETRANSMIT_COUNT){
+    if(elapsed >= nextSendTime && retransmitQueue[i].sentCount < params.retransmitCount &&
+       airtimeAllowed(retransmitQueue[i].header, retransmitQueue[i].message)){
       // Time to retransmit!
       #if DEBUG_RETRANSMIT
         Serial.print(">>> RETRANSMIT: #");
@@ -131,22 +297,737 @@ inline void processRetransmitQueue(){
   }
 }
 
+// ==================== ANTI-ENTROPY SYNC ====================
+
+/*
+ * Check if Broadcast is Held in Store
+ * Returns true if an unexpired broadcast with this hash is stored
+ */
+inline bool bcastStoreHas(uint16_t hash){
+  unsigned long now = millis();
+  for(int i = 0; i < BCAST_STORE_SIZE; i++){
+    if(bcastStore[i].active && bcastStore[i].msgHash == hash &&
+       now - bcastStore[i].storedTime <= ANTI_ENTROPY_MAX_AGE){
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Add HQ Broadcast to Store
+ * Oldest entry is overwritten (circular, like the dedup cache)
+ */
+inline void bcastStoreAdd(String header, String message, uint16_t hash){
+  if(bcastStoreHas(hash)) return;
+  
+  bcastStore[bcastStoreIndex].header = header;
+  bcastStore[bcastStoreIndex].message = message;
+  bcastStore[bcastStoreIndex].msgHash = hash;
+  bcastStore[bcastStoreIndex].storedTime = millis();
+  bcastStore[bcastStoreIndex].active = true;
+  
+  // Schedule coverage report, farthest lamps first
+  uint8_t slots = (myHop < REPORT_MAX_HOP) ? (REPORT_MAX_HOP - myHop) : 0;
+  bcastStore[bcastStoreIndex].coverage = (uint64_t)1 << NODE_INDEX;
+  bcastStore[bcastStoreIndex].reportDue = millis() + slots * REPORT_HOP_SLOT;
+  bcastStore[bcastStoreIndex].reportPending = true;
+  
+  #if DEBUG_SYNC
+    Serial.print(">>> SYNC: Stored broadcast 0x");
+    Serial.print(hash, HEX);
+    Serial.print(" in slot ");
+    Serial.println(bcastStoreIndex);
+  #endif
+  
+  bcastStoreIndex = (bcastStoreIndex + 1) % BCAST_STORE_SIZE;
+}
+
+/*
+ * Parse Hash List from Sync Header (Type 5/6)
+ * Hashes follow the 9-char base header, 4 hex chars each
+ * Returns number of hashes parsed (at most maxHashes)
+ */
+inline int parseSyncHashes(String header, uint16_t hashes[], int maxHashes){
+  int count = 0;
+  for(unsigned int pos = HEADER_LENGTH_SYNC; pos + 4 <= header.length() && count < maxHashes; pos += 4){
+    hashes[count++] = (uint16_t) strtol(header.substring(pos, pos + 4).c_str(), NULL, 16);
+  }
+  return count;
+}
+
+/*
+ * Build Digest Header (Type 5)
+ * Lists hashes of all unexpired stored broadcasts
+ */
+inline String buildDigestHeader(){
+  String header = String(NODE_ID) + BROADCAST_ID + MSG_TYPE_DIGEST;
+  unsigned long now = millis();
+  
+  for(int i = 0; i < BCAST_STORE_SIZE; i++){
+    if(bcastStore[i].active && now - bcastStore[i].storedTime <= ANTI_ENTROPY_MAX_AGE){
+      char hashStr[5];
+      sprintf(hashStr, "%04X", bcastStore[i].msgHash);
+      header += hashStr;
+    }
+  }
+  return header;
+}
+
+/*
+ * Send Digest to Neighbors (Type 5)
+ * One hop only, never queued
+ */
+inline void sendDigest(String header){
+  #if DEBUG_SYNC
+    Serial.print(">>> SYNC: Sending digest (");
+    Serial.print((header.length() - HEADER_LENGTH_SYNC) / 4);
+    Serial.println(" broadcasts)");
+  #endif
+  
+  irSendRaw(header, "");
+}
+
+/*
+ * Process Neighbor Digest (Type 5)
+ * Pulls broadcasts the neighbor has and we are missing, and answers
+ * early with our own digest if the neighbor is missing ours
+ */
+inline void processDigest(String header){
+  String src = header.substring(0, 4);
+  uint16_t hashes[BCAST_STORE_SIZE];
+  int count = parseSyncHashes(header, hashes, BCAST_STORE_SIZE);
+  ncNoteHeld(src, hashes, count);
+  
+  #if DEBUG_SYNC
+    Serial.print(">>> SYNC: Digest from ");
+    Serial.print(src);
+    Serial.print(" (");
+    Serial.print(count);
+    Serial.println(" broadcasts)");
+  #endif
+  
+  // Collect hashes the neighbor advertises that we don't hold
+  String pullHeader = String(NODE_ID) + src + MSG_TYPE_PULL;
+  int missing = 0;
+  for(int i = 0; i < count; i++){
+    if(!bcastStoreHas(hashes[i])){
+      char hashStr[5];
+      sprintf(hashStr, "%04X", hashes[i]);
+      pullHeader += hashStr;
+      missing++;
+    }
+  }
+  
+  if(missing > 0){
+    if(!airtimeAllowed(pullHeader)) return;  // Next digest round will retry
+    
+    #if DEBUG_SYNC
+      Serial.print(">>> SYNC: Gap detected, pulling ");
+      Serial.print(missing);
+      Serial.print(" broadcast(s) from ");
+      Serial.println(src);
+    #endif
+    irSendRaw(pullHeader, "");
+    return;  // Our own store is behind, no point advertising it yet
+  }
+  
+  // Check whether the neighbor lags behind us
+  unsigned long now = millis();
+  bool neighborBehind = false;
+  for(int i = 0; i < BCAST_STORE_SIZE && !neighborBehind; i++){
+    if(!bcastStore[i].active || now - bcastStore[i].storedTime > ANTI_ENTROPY_MAX_AGE) continue;
+    
+    bool advertised = false;
+    for(int j = 0; j < count; j++){
+      if(hashes[j] == bcastStore[i].msgHash){
+        advertised = true;
+        break;
+      }
+    }
+    neighborBehind = !advertised;
+  }
+  
+  if(neighborBehind && now - lastDigestReplyTime >= ANTI_ENTROPY_REPLY_HOLDOFF){
+    String digest = buildDigestHeader();
+    if(!airtimeAllowed(digest)) return;
+    
+    #if DEBUG_SYNC
+      Serial.println(">>> SYNC: Neighbor is behind, sending early digest");
+    #endif
+    lastDigestReplyTime = now;
+    sendDigest(digest);
+  }
+}
+
+/*
+ * Replay a Stored Broadcast (plain repair)
+ * Serves every held pull for it at once
+ */
+inline void sendPlainRepair(int slot){
+  #if DEBUG_SYNC
+    Serial.print(">>> SYNC: Repairing broadcast 0x");
+    Serial.println(bcastStore[slot].msgHash, HEX);
+  #endif
+  irSendRaw(bcastStore[slot].header, bcastStore[slot].message);
+  ncStats.plain++;
+  
+  for(int i = 0; i < NC_REPAIR_SIZE; i++){
+    if(ncRepairs[i].active && ncRepairs[i].msgHash == bcastStore[slot].msgHash){
+      ncRepairs[i].active = false;
+    }
+  }
+}
+
+/*
+ * Send Two Stored Broadcasts as One Coded Packet (Type G)
+ * Serves every held pull whose neighbor holds the other one
+ * Returns false if the airtime budget held it back (pulls stay held)
+ */
+inline bool sendCodedRepair(int a, int b){
+  BroadcastStoreEntry &ea = bcastStore[a];
+  BroadcastStoreEntry &eb = bcastStore[b];
+  
+  char fields[13];
+  sprintf(fields, "%04X%04X%02X%02X", ea.msgHash, eb.msgHash,
+          ea.message.length(), eb.message.length());
+  String header = String(NODE_ID) + BROADCAST_ID + MSG_TYPE_CODED + fields;
+  String message = ncCombine(ea.message, eb.message);
+  if(!airtimeAllowed(header, message)) return false;
+  
+  #if DEBUG_SYNC
+    Serial.print(">>> SYNC: Coded repair of 0x");
+    Serial.print(ea.msgHash, HEX);
+    Serial.print(" + 0x");
+    Serial.println(eb.msgHash, HEX);
+  #endif
+  irSendRaw(header, message);
+  
+  // Two plain replays: header, message and both delimiters each
+  unsigned int plainChars = ea.header.length() + ea.message.length() + eb.header.length() + eb.message.length() + 4;
+  ncStats.coded++;
+  ncStats.saved += plainChars - (header.length() + message.length() + 2);
+  
+  for(int i = 0; i < NC_REPAIR_SIZE; i++){
+    NcRepair &r = ncRepairs[i];
+    if(!r.active) continue;
+    if((r.msgHash == ea.msgHash && ncHolds(r.dst, eb.msgHash)) ||
+       (r.msgHash == eb.msgHash && ncHolds(r.dst, ea.msgHash))){
+      r.active = false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Serve Held Pulls (called from processAntiEntropy)
+ * A due pull is paired with another one if each neighbor holds what the
+ * other is missing, else replayed plain
+ */
+inline void processRepairs(){
+  for(int i = 0; i < NC_REPAIR_SIZE; i++){
+    NcRepair &r = ncRepairs[i];
+    if(!r.active || (long)(millis() - r.due) < 0) continue;
+    
+    int a = ncStoreFind(r.msgHash);
+    if(a < 0){
+      r.active = false;  // Expired while held
+      continue;
+    }
+    
+    int b = -1;
+    for(int j = 0; j < NC_REPAIR_SIZE && b < 0; j++){
+      NcRepair &o = ncRepairs[j];
+      if(!o.active || o.msgHash == r.msgHash || o.dst == r.dst) continue;
+      if(!ncHolds(r.dst, o.msgHash) || !ncHolds(o.dst, r.msgHash)) continue;
+      if(!capsPeerHas(r.dst, CAP_CODED) || !capsPeerHas(o.dst, CAP_CODED)) continue;
+      
+      int k = ncStoreFind(o.msgHash);
+      if(k >= 0 && ncCodable(bcastStore[a], bcastStore[k])) b = k;
+    }
+    
+    if(b >= 0){
+      if(!sendCodedRepair(a, b)) return;  // Out of budget; next round retries
+    }
+    else sendPlainRepair(a);
+  }
+}
+
+/*
+ * Process Pull Request (Type 6)
+ * Serves requested stored broadcasts if addressed to this node, after
+ * NC_REPAIR_HOLD so pulls from other neighbors can share a coded packet
+ */
+inline void processPull(String header){
+  String dst = header.substring(4, 8);
+  if(dst != NODE_ID) return;  // Pull meant for another neighbor
+  
+  String src = header.substring(0, 4);
+  uint16_t hashes[BCAST_STORE_SIZE];
+  int count = parseSyncHashes(header, hashes, BCAST_STORE_SIZE);
+  
+  // It answers our digest: what it did not pull, it holds
+  uint16_t held[BCAST_STORE_SIZE];
+  int heldCount = 0;
+  for(int j = 0; j < BCAST_STORE_SIZE; j++){
+    if(!bcastStore[j].active || ncStoreFind(bcastStore[j].msgHash) != j) continue;
+    bool pulled = false;
+    for(int i = 0; i < count; i++){
+      if(hashes[i] == bcastStore[j].msgHash) pulled = true;
+    }
+    if(!pulled) held[heldCount++] = bcastStore[j].msgHash;
+  }
+  ncNoteHeld(src, held, heldCount);
+  
+  for(int i = 0; i < count; i++){
+    for(int j = 0; j < BCAST_STORE_SIZE; j++){
+      if(bcastStore[j].active && bcastStore[j].msgHash == hashes[i]){
+        if(!NC_ENABLED || !ncQueueRepair(src, hashes[i])) sendPlainRepair(j);
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * Periodic Anti-Entropy Exchange
+ * Called every loop iteration; serves held pulls and sends a digest
+ * every ANTI_ENTROPY_INTERVAL plus random jitter
+ */
+inline void processAntiEntropy(){
+  processRepairs();
+  
+  if((long)(millis() - nextDigestTime) < 0) return;
+  
+  String digest = buildDigestHeader();
+  if(!airtimeAllowed(digest)){
+    nextDigestTime = millis() + ANTI_ENTROPY_JITTER;  // Try again later
+    return;
+  }
+  
+  sendDigest(digest);
+  nextDigestTime = millis() + ANTI_ENTROPY_INTERVAL + random(ANTI_ENTROPY_JITTER);
+}
+
+// ==================== HEALTH TRAILER ====================
+
+/*
+ * Read This Lamp's Health Entry
+ * [nodeID(4)][battery 0-9][solar 0/1][error flags hex][sync class hex]
+ * [K hex][parallel relays hex][progress tenths]
+ */
+inline String readHealthEntry(){
+  int battery = readBatteryLevel();
+  int solar = digitalRead(SOLAR_SENSE_PIN) == HIGH ? 1 : 0;
+  
+  uint8_t errors = healthErrors;
+  if(myHop == INITIAL_HOP) errors |= HEALTH_ERR_NO_GRADIENT;
+  
+  char entry[HEALTH_ENTRY_LENGTH + 1];
+  sprintf(entry, "%s%d%d%X%X", NODE_ID, battery, solar, errors & 0xF, timeSyncClass());
+  return String(entry) + gradientHealth();
+}
+
+/*
+ * Split Health Trailer from Message
+ * Strips a well-formed trailer from message and returns its entries
+ * (empty string if none)
+ */
+inline String splitHealthTrailer(String &message){
+  int mark = message.lastIndexOf(HEALTH_TRAILER_MARK);
+  if(mark < 0) return "";
+  
+  String trailer = message.substring(mark + 1);
+  if(trailer.length() == 0 || trailer.length() % HEALTH_ENTRY_LENGTH != 0 ||
+     trailer.length() > HEALTH_ENTRY_LENGTH * HEALTH_TRAILER_MAX){
+    return "";  // Not a trailer, leave message untouched
+  }
+  
+  message = message.substring(0, mark);
+  return trailer;
+}
+
+/*
+ * Remember Downstream Entries for a Later Packet
+ * Used when the packet carrying them is merged rather than forwarded
+ * Newer entries for the same node replace older ones; oldest dropped when full
+ */
+inline void relayHealthEntries(String entries){
+  for(unsigned int pos = 0; pos + HEALTH_ENTRY_LENGTH <= entries.length(); pos += HEALTH_ENTRY_LENGTH){
+    String entry = entries.substring(pos, pos + HEALTH_ENTRY_LENGTH);
+    String node = entry.substring(0, 4);
+    if(node == NODE_ID) continue;
+    
+    // Drop any older entry for this node
+    for(unsigned int i = 0; i + HEALTH_ENTRY_LENGTH <= healthRelay.length(); i += HEALTH_ENTRY_LENGTH){
+      if(healthRelay.substring(i, i + 4) == node){
+        healthRelay.remove(i, HEALTH_ENTRY_LENGTH);
+        break;
+      }
+    }
+    
+    if(healthRelay.length() >= HEALTH_ENTRY_LENGTH * HEALTH_RELAY_MAX){
+      healthRelay.remove(0, HEALTH_ENTRY_LENGTH);
+    }
+    healthRelay += entry;
+  }
+}
+
+/*
+ * Attach Health Trailer to Upstream Message
+ * Keeps entries already on the packet, updates our own entry in place,
+ * adds our entry only if it changed since last piggybacked, then fills
+ * any remaining space from the relay buffer
+ */
+inline String attachHealth(String message, String trailer){
+  String own = readHealthEntry();
+  bool ownPlaced = false;
+  
+  // Update our own entry in place if the packet already carries one
+  for(unsigned int pos = 0; pos + HEALTH_ENTRY_LENGTH <= trailer.length(); pos += HEALTH_ENTRY_LENGTH){
+    if(trailer.substring(pos, pos + 4) == NODE_ID){
+      trailer = trailer.substring(0, pos) + own + trailer.substring(pos + HEALTH_ENTRY_LENGTH);
+      ownPlaced = true;
+      break;
+    }
+  }
+  
+  unsigned int maxLength = HEALTH_ENTRY_LENGTH * HEALTH_TRAILER_MAX;
+  
+  if(!ownPlaced && own != lastHealthEntry && trailer.length() < maxLength){
+    trailer += own;
+    ownPlaced = true;
+  }
+  
+  if(ownPlaced){
+    lastHealthEntry = own;
+    healthErrors = 0;  // Reported
+  }
+  
+  // Fill remaining space with relayed downstream entries
+  while(trailer.length() < maxLength && healthRelay.length() >= HEALTH_ENTRY_LENGTH){
+    trailer += healthRelay.substring(0, HEALTH_ENTRY_LENGTH);
+    healthRelay.remove(0, HEALTH_ENTRY_LENGTH);
+  }
+  
+  #if DEBUG_HEALTH
+    if(trailer.length() > 0){
+      Serial.print(">>> HEALTH: Trailer '");
+      Serial.print(trailer);
+      Serial.println("'");
+    }
+  #endif
+  
+  if(trailer.length() == 0) return message;
+  return message + HEALTH_TRAILER_MARK + trailer;
+}
+
+// ==================== BROADCAST COVERAGE REPORTS ====================
+
+/*
+ * Format Coverage Bitmap as 16 Hex Chars
+ * Split into two 32-bit halves (printf has no portable 64-bit format)
+ */
+inline String coverageToHex(uint64_t coverage){
+  char hexStr[COVERAGE_HEX_LENGTH + 1];
+  sprintf(hexStr, "%08lX%08lX", (unsigned long)(coverage >> 32), (unsigned long)(coverage & 0xFFFFFFFF));
+  return String(hexStr);
+}
+
+/*
+ * Parse Coverage Bitmap from 16 Hex Chars
+ * Returns false if the payload is malformed
+ */
+inline bool coverageFromHex(String hexStr, uint64_t &coverage){
+  if(hexStr.length() != COVERAGE_HEX_LENGTH) return false;
+  
+  coverage = 0;
+  for(int i = 0; i < COVERAGE_HEX_LENGTH; i++){
+    char c = hexStr[i];
+    uint8_t nibble;
+    if(c >= '0' && c <= '9') nibble = c - '0';
+    else if(c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+    else if(c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+    else return false;
+    coverage = (coverage << 4) | nibble;
+  }
+  return true;
+}
+
+/*
+ * Send Coverage Report for Stored Broadcast (Type 8)
+ * One hop upstream; the receiving lamp merges it into its own report
+ */
+inline void sendCoverageReport(BroadcastStoreEntry &entry){
+  char hashStr[5];
+  sprintf(hashStr, "%04X", entry.msgHash);
+  char hopStr[3];
+  sprintf(hopStr, "%02X", myHop);
+  
+  String header = String(NODE_ID) + HQ_ID + MSG_TYPE_REPORT + String(hashStr) + String(hopStr);
+  String bitmap = coverageToHex(entry.coverage);
+  
+  #if DEBUG_COVERAGE
+    Serial.print(">>> COVERAGE: Reporting broadcast 0x");
+    Serial.print(entry.msgHash, HEX);
+    Serial.print(" bitmap=");
+    Serial.println(bitmap);
+  #endif
+  
+  irSendRaw(header, attachHealth(bitmap, ""));  // One-shot; late merges trigger a fresh report
+  entry.reportPending = false;
+}
+
+/*
+ * Process Downstream Coverage Report (Type 8)
+ * Merges the neighbor's bitmap; if our report already went out and the
+ * neighbor added new lamps, a fresh report is scheduled right away
+ */
+inline void processCoverageReport(String header, String message){
+  uint16_t hash = (uint16_t) strtol(header.substring(9, 13).c_str(), NULL, 16);
+  uint8_t msgHop = (uint8_t) strtol(header.substring(13, 15).c_str(), NULL, 16);
+  uint64_t coverage;
+  
+  if(msgHop <= myHop) return;  // Only merge reports from downstream lamps
+  
+  // Health entries ride on our own next upstream packet
+  relayHealthEntries(splitHealthTrailer(message));
+  
+  if(!coverageFromHex(message, coverage)){
+    Serial.println(">>> ERROR: Malformed coverage report - discarded");
+    return;
+  }
+  
+  for(int i = 0; i < BCAST_STORE_SIZE; i++){
+    BroadcastStoreEntry &entry = bcastStore[i];
+    if(!entry.active || entry.msgHash != hash) continue;
+    
+    uint64_t added = coverage & ~entry.coverage;
+    if(added == 0) return;  // Nothing new
+    
+    entry.coverage |= added;
+    
+    #if DEBUG_COVERAGE
+      Serial.print(">>> COVERAGE: Merged report from ");
+      Serial.print(header.substring(0, 4));
+      Serial.print(", bitmap now ");
+      Serial.println(coverageToHex(entry.coverage));
+    #endif
+    
+    if(!entry.reportPending){
+      entry.reportPending = true;
+      entry.reportDue = millis();
+    }
+    return;
+  }
+  
+  #if DEBUG_COVERAGE
+    Serial.println(">>> COVERAGE: Report for unknown broadcast, ignored");
+  #endif
+}
+
+/*
+ * Send Due Coverage Reports
+ * Called every loop iteration
+ */
+inline void processCoverageReports(){
+  for(int i = 0; i < BCAST_STORE_SIZE; i++){
+    BroadcastStoreEntry &entry = bcastStore[i];
+    if(entry.active && entry.reportPending && (long)(millis() - entry.reportDue) >= 0){
+      // Header + bitmap size, checked against the budget (held back while congested)
+      String probe = String(NODE_ID) + HQ_ID + MSG_TYPE_REPORT + "000000";
+      if(!airtimeAllowed(probe, coverageToHex(entry.coverage))) return;
+      sendCoverageReport(entry);
+    }
+  }
+}
+
+// ==================== SOS BEACON ====================
+
+/*
+ * Pack an SOS Beacon Frame (layout in config.h)
+ */
+inline uint32_t sosBeaconEncode(uint16_t origin, uint8_t hop, uint8_t seq){
+  return (uint32_t)(SOS_BEACON_MARKER | (seq & 0x0F))
+       | ((uint32_t)(origin >> 8) << 8)
+       | ((uint32_t)(origin & 0xFF) << 16)
+       | ((uint32_t)hop << 24);
+}
+
+/*
+ * Is This Beacon New (records it if so)
+ */
+inline bool sosBeaconIsNew(uint16_t origin, uint8_t seq){
+  for(int i = 0; i < SOS_BEACON_SEEN_SIZE; i++){
+    SosBeaconSeen &s = sosBeaconSeen[i];
+    if(s.active && s.origin == origin && s.seq == seq) return false;
+  }
+  sosBeaconSeen[sosBeaconSeenIndex].origin = origin;
+  sosBeaconSeen[sosBeaconSeenIndex].seq = seq;
+  sosBeaconSeen[sosBeaconSeenIndex].active = true;
+  sosBeaconSeenIndex = (sosBeaconSeenIndex + 1) % SOS_BEACON_SEEN_SIZE;
+  return true;
+}
+
+/*
+ * Handle a Received SOS Beacon
+ * Same gradient rule as the full SOS, but relayed as a beacon straight
+ * from the receive path, so each hop costs ~0.3s (one sleep interval more
+ * toward sleeping lamps) instead of ~8s. Deduplicated per origin and
+ * sequence in its own table (sosBeaconSeen), so the repeated frames
+ * neither crowd the message cache nor stop the full SOS being relayed.
+ */
+inline void processSosBeacon(uint32_t raw){
+  uint8_t seq = raw & 0x0F;
+  uint16_t origin = (((raw >> 8) & 0xFF) << 8) | ((raw >> 16) & 0xFF);
+  uint8_t msgHop = raw >> 24;
+  
+  char srcStr[5];
+  sprintf(srcStr, "%04X", origin);
+  String src = String(srcStr);
+  
+  Serial.print(">>> SOS BEACON: From ");
+  Serial.print(src);
+  Serial.print(", hop ");
+  Serial.print(msgHop);
+  Serial.print(", seq ");
+  Serial.println(seq);
+  
+  if(myHop > msgHop + gradient.tolerance){
+    #if DEBUG_GRADIENT
+      Serial.println(">>> GRADIENT: NOT forwarding beacon (too far downstream)");
+    #endif
+    return;
+  }
+  if(!sosBeaconIsNew(origin, seq)) return;
+  
+  uint8_t newHop = (msgHop > 0) ? (msgHop - 1) : 0;
+  
+  LED_ON();
+  irSendSosBeacon(sosBeaconEncode(origin, newHop, seq));
+  LED_OFF();
+}
+
+// ==================== TRANSMIT PREEMPTION ====================
+
+/*
+ * Park the Rest of a Preempted Send
+ * One slot: if another send is already parked, the newer one wins (the
+ * older one still has its retransmit queue copies)
+ */
+inline void suspendTx(String header, String message, uint8_t nextDir){
+  if(nextDir >= 4) return;  // All directions already out
+  
+  #if DEBUG_IR_TX
+    if(suspendedTx.active && suspendedTx.header != header){
+      Serial.print(">>> PREEMPT: Dropping older suspended send ");
+      Serial.println(suspendedTx.header);
+    }
+    Serial.print(">>> PREEMPT: Suspended ");
+    Serial.print(header);
+    Serial.print(" at direction ");
+    Serial.print(nextDir + 1);
+    Serial.println("/4");
+  #endif
+  
+  suspendedTx.header = header;
+  suspendedTx.message = message;
+  suspendedTx.nextDir = nextDir;
+  suspendedTx.suspendedAt = millis();
+  suspendedTx.active = true;
+}
+
+/*
+ * Resume a Suspended Send
+ * Waits until our own SOS has gone out and the channel has been quiet
+ * long enough for any incoming packet (and our relay of it) to finish
+ */
+inline void processSuspendedTx(){
+  if(!suspendedTx.active || txPreemptRequested) return;
+  if(millis() - irFrameTime < TX_RESUME_QUIET) return;
+  
+  SuspendedTx tx = suspendedTx;
+  suspendedTx.active = false;
+  
+  #if DEBUG_IR_TX
+    Serial.print(">>> PREEMPT: Resuming ");
+    Serial.print(tx.header);
+    Serial.print(" from direction ");
+    Serial.print(tx.nextDir + 1);
+    Serial.print("/4 after ");
+    Serial.print(millis() - tx.suspendedAt);
+    Serial.println("ms");
+  #endif
+  
+  irSendRaw(tx.header, tx.message, tx.nextDir);
+}
+
+/*
+ * Send a Pending CTX_MISS (scheduler task)
+ * One hop, once the channel is quiet; rate limited
+ */
+inline void processHcMiss(){
+  if(hcMissPending < 0) return;
+  if(millis() - hcLastMiss < HC_MISS_HOLDOFF) return;
+  if(millis() - irFrameTime < TX_RESUME_QUIET) return;
+
+  char ctx[3];
+  sprintf(ctx, "%02X", (uint8_t)hcMissPending);
+  String header = String(NODE_ID) + BROADCAST_ID + MSG_TYPE_CTX_MISS + ctx;
+  if(!airtimeAllowed(header)) return;  // Stays pending
+  hcMissPending = -1;
+  hcLastMiss = millis();
+
+  irSendRaw(header);
+}
+
 // ==================== IR COMMUNICATION FUNCTIONS ====================
 
 /*
  * Raw IR Transmission (used internally by retransmit and initial send)
  * Sends header (and optional message) to ALL 4 directions sequentially
  * Uses IRremote library with pin parameter for multi-directional TX
+ *
+ * Anything but an SOS may be preempted at a frame boundary; the rest of
+ * the send is parked in suspendedTx (see TRANSMIT PREEMPTION)
+ * @param firstDir - Direction to start from (resuming a suspended send)
  */
-inline void irSendRaw(String header, String message = ""){
+inline void irSendRaw(String header, String message, uint8_t firstDir){
+  // Visible-light copy first; IR is left out if it reaches every neighbor
+  if(firstDir == 0 && vlcCarries(header[8])){
+    vlcSend(header[8] == MSG_TYPE_CONFIG ? configRestamp(header, message, 0) : header, message);
+    if(vlcReplacesIr()){
+      Serial.print(">>> VLC: Sent ");
+      Serial.print(header);
+      Serial.println(" on visible light only");
+      vlcStats.irSkipped++;
+      vlcStats.irCharsSaved += 4 * (header.length() + message.length() + 2);
+      return;
+    }
+  }
+  
   const int txPins[] = {IR_TX_FRONT, IR_TX_RIGHT, IR_TX_BACK, IR_TX_LEFT};
   const char* dirNames[] = {"FRONT", "RIGHT", "BACK", "LEFT"};
+  bool preemptible = TX_PREEMPT_ENABLED && header[8] != MSG_TYPE_SOS;
+  bool receiverOn = false;  // Left on by a listen window that heard traffic
+  
+  // Framing every neighbor heard lately understands (caps.h)
+  bool burst = header[8] != MSG_TYPE_TIMESYNC && header[8] != MSG_TYPE_CAPS && capsLinkAllows(CAP_BURST);
+  String onAirHeader = capsLinkAllows(CAP_HC) ? hcCompress(header) : header;
+  if(burst) capsStats.burstSends++;
+  else if(header[8] != MSG_TYPE_CAPS) capsStats.plainSends++;
   
   Serial.println("╔════════════════════════════════════╗");
   Serial.println("║   IR TRANSMISSION (4 DIRECTIONS)   ║");
   Serial.println("╚════════════════════════════════════╝");
   Serial.print("Header: ");
-  Serial.println(header);
+  Serial.print(header);
+  if(onAirHeader != header){
+    Serial.print(" (sent as ");
+    Serial.print(onAirHeader);
+    Serial.print(")");
+  }
+  Serial.println();
   if(message.length() > 0){
     Serial.print("Message: ");
     Serial.println(message);
@@ -161,12 +1042,13 @@ inline void irSendRaw(String header, String message = ""){
   // Stop receiver during entire transmission sequence
   IrReceiver.stop();
   
-  #if DEBUG_TIMING
-    unsigned long txStartTime = millis();
-  #endif
+  unsigned long txStartTime = millis();
+  
+  // Wake duty-cycled neighbors before the packet
+  irSendWakePreamble();
   
   // Transmit to all 4 directions sequentially
-  for(int i = 0; i < 4; i++){
+  for(int i = firstDir; i < 4; i++){
     Serial.println("────────────────────────────────────");
     Serial.print("Direction ");
     Serial.print(i + 1);
@@ -178,18 +1060,34 @@ inline void irSendRaw(String header, String message = ""){
     #endif
     
     // Send header with space delimiter
-    String headerWithDelim = header + " ";
-    irSendString(headerWithDelim.c_str(), txPins[i]);
+    // (time beacons carry the sender's mesh time at the start of each direction,
+    // CONFIG the apply delay left when the header ends)
+    String headerWithDelim = onAirHeader;
+    if(header[8] == MSG_TYPE_TIMESYNC) headerWithDelim = timeSyncRestamp(header);
+    if(header[8] == MSG_TYPE_CONFIG){
+      unsigned long frames = burst ? (onAirHeader.length() + 3) / 3 : onAirHeader.length() + 1;
+      headerWithDelim = configRestamp(onAirHeader, message, frames * IR_CHAR_AIRTIME);
+    }
+    headerWithDelim += " ";
+    bool sent = burst ? irSendBurst(headerWithDelim.c_str(), txPins[i], preemptible)
+                      : irSendString(headerWithDelim.c_str(), txPins[i], preemptible);
     
     // Send message if present
-    if(message.length() > 0){
+    if(sent && message.length() > 0){
       #if DEBUG_TIMING
         Serial.println(">>> Delay 50ms before message...");
       #endif
       delay(50);  // Small gap between header and message
       
       String messageWithDelim = message + " ";
-      irSendString(messageWithDelim.c_str(), txPins[i]);
+      sent = burst ? irSendBurst(messageWithDelim.c_str(), txPins[i], preemptible)
+                   : irSendString(messageWithDelim.c_str(), txPins[i], preemptible);
+    }
+    
+    // Own SOS pressed: this direction is resent from the start later
+    if(!sent){
+      suspendTx(header, message, i);
+      break;
     }
     
     #if DEBUG_TIMING
@@ -203,15 +1101,25 @@ inline void irSendRaw(String header, String message = ""){
     if(i < 3){
       #if DEBUG_TIMING
         Serial.print(">>> Delay ");
-        Serial.print(IR_DIRECTION_GAP);
+        Serial.print(params.irDirectionGap);
         Serial.println("ms before next direction...");
       #endif
-      delay(IR_DIRECTION_GAP);
+      if(!preemptible){
+        delay(params.irDirectionGap);
+      }
+      // Listen through the gap; a neighbor's packet may be an SOS
+      else if(irListenForTraffic(max(params.irDirectionGap, TX_PREEMPT_LISTEN))){
+        receiverOn = true;
+        suspendTx(header, message, i + 1);
+        break;
+      }
     }
   }
   
+  unsigned long txTotalTime = millis() - txStartTime;
+  energy.txMs += txTotalTime;
+  
   #if DEBUG_TIMING
-    unsigned long txTotalTime = millis() - txStartTime;
     Serial.println("────────────────────────────────────");
     Serial.print(">>> Total transmission time: ");
     Serial.print(txTotalTime);
@@ -223,12 +1131,19 @@ inline void irSendRaw(String header, String message = ""){
   #endif
   
   // Resume receiver after all transmissions complete
-  IrReceiver.start();
+  // (replies such as ACK/PULL may follow, so hold off low-power sleep)
+  energyUpdateRx();
+  if(!receiverOn) IrReceiver.start();  // Restarting would drop the frame just heard
+  lplAwake = true;
+  lplAwakeUntil = millis() + LPL_WAKE_HOLD;
+  lplLastTxTime = millis();
   
   #if DEBUG_IR_RX
     Serial.println(">>> IR RX: Receiver ACTIVE again");
   #endif
   
+  schedNotifyTxComplete();
+  
   Serial.println("════════════════════════════════════");
   Serial.println();
 }
@@ -238,8 +1153,17 @@ inline void irSendRaw(String header, String message = ""){
  * Sends header (and optional message) via IR + adds to retransmit queue
  * 
  * This is the public function - it handles both initial send and queuing
+ * Non-critical traffic over the airtime budget is deferred to the queue
  */
 inline void irSend(String header, String message = ""){
+  if(!airtimeAllowed(header, message)){
+    #if DEBUG_AIRTIME
+      Serial.println(">>> AIRTIME: Deferring transmission");
+    #endif
+    addToRetransmitQueue(header, message, 0);
+    return;
+  }
+  
   // Send immediately to all 4 directions
   irSendRaw(header, message);
   
@@ -253,7 +1177,14 @@ inline void irSend(String header, String message = ""){
  *   - 9 chars: INIT (Type 0)
  *   - 11 chars: SOS (Type 3)
  *   - 13 chars: Broadcast/Targeted (Type 1/2) + expects message
- *   - 15 chars: Message (Type 4) + expects message
+ *   - 15 chars: Message (Type 4) or Report (Type 8) + expects message
+ *   - 9 + 4n chars: Digest/Pull (Type 5/6), header-only
+ *   - 14 chars: ACK (Type 7) or CONGESTION (Type 9), header-only
+ *   - 16 chars: Targeted (Type 2) with command ID, CONFIG (Type A) or OTA_DATA (Type D) + expects message
+ *   - 35 / 14 chars: OTA_ADV (Type B) / OTA_REQ (Type C), header-only
+ *   - 21 chars: TIMESYNC (Type E), header-only
+ * While a header waits for its message segment, the next line is that
+ * segment whatever its shape; header-only packets are matched in between
  */
 inline bool irReceive(String &header, String &message){
   static bool waitingForMessage = false;
@@ -261,22 +1192,54 @@ inline bool irReceive(String &header, String &message){
   static unsigned long headerReceivedTime = 0;
   
   String line;
-  if(irReceiveString(line)){
+  bool lineReady = irReceiveString(line);
+  
+  // SOS beacon: relayed before any general parsing
+  if(rxSosBeaconPending){
+    rxSosBeaconPending = false;
+    processSosBeacon(rxSosBeacon);
+  }
+  
+  if(lineReady){
     line.trim();
     
-    // Check for header-only INIT packet (9 chars, Type 0)
-    if(line.length() == HEADER_LENGTH_INIT && line[8] == MSG_TYPE_INIT){
+    // Compressed header: expand from the neighbor-shared context, only where
+    // a header is expected (a message segment may well start with '#')
+    if(!waitingForMessage && hcIsCompressed(line) && !hcExpand(line)){
+      hcReportMiss(line);
+      
+      // Swallow the message segment that belongs to the dropped header
+      unsigned int fullLength = line.length() - 4 + 9;
+      if(fullLength == HEADER_LENGTH_STANDARD || fullLength == HEADER_LENGTH_MESSAGE ||
+         fullLength == HEADER_LENGTH_TARGETED || fullLength == HEADER_LENGTH_CODED){
+        receivedHeader = "";
+        waitingForMessage = true;
+        headerReceivedTime = millis();
+        rxAuthActive = false;
+      }
+      return false;
+    }
+    
+    // Second segment: a pending header takes the next line as its message,
+    // even one shaped like a header-only packet (message text is free-form)
+    if(waitingForMessage){
+      header = receivedHeader;
+      message = line;
+      waitingForMessage = false;
+      receivedHeader = "";
+      rxAuthReady = rxAuthActive;
+      rxAuthActive = false;
+      if(header.length() == 0) return false;  // Its header was a context miss
+      Serial.println("RX IR: Message received (complete packet)");
+      return true;  // Complete packet received
+    }
+    
+    // Check for header-only INIT packet (9 chars from HQ, 10 relayed, Type 0)
+    if((line.length() == HEADER_LENGTH_INIT || line.length() == HEADER_LENGTH_INIT_ENERGY) &&
+       line[8] == MSG_TYPE_INIT){
       header = line;
       message = "";
       Serial.println("RX IR: INIT header-only packet");
-      
-      // Reset waiting state if we were waiting for a different message
-      if(waitingForMessage){
-        Serial.println("Warning: Previous message segment lost, resetting");
-        waitingForMessage = false;
-        receivedHeader = "";
-      }
-      
       return true;
     }
     
@@ -285,43 +1248,108 @@ inline bool irReceive(String &header, String &message){
       header = line;
       message = "";
       Serial.println("RX IR: SOS header-only packet");
-      
-      // Reset waiting state if we were waiting for a different message
-      if(waitingForMessage){
-        Serial.println("Warning: Previous message segment lost, resetting");
-        waitingForMessage = false;
-        receivedHeader = "";
-      }
-      
       return true;
     }
     
-    // Otherwise, handle standard two-segment format
-    if(!waitingForMessage){
-      // First segment: receive header
-      if(line.length() == HEADER_LENGTH_STANDARD || line.length() == HEADER_LENGTH_MESSAGE){
-        receivedHeader = line;
-        waitingForMessage = true;
-        headerReceivedTime = millis();  // Record time for timeout check
-        Serial.println("RX IR: Header received, waiting for message...");
+    // Check for header-only CONGESTION packet (14 chars, Type 9)
+    if(line.length() == HEADER_LENGTH_CONGESTION && line[8] == MSG_TYPE_CONGESTION){
+      header = line;
+      message = "";
+      Serial.println("RX IR: CONGESTION header-only packet");
+      return true;
+    }
+    
+    // Check for header-only ACK packet (14 chars, Type 7)
+    if(line.length() == HEADER_LENGTH_ACK && line[8] == MSG_TYPE_ACK){
+      header = line;
+      message = "";
+      Serial.println("RX IR: ACK header-only packet");
+      return true;
+    }
+    
+    // Check for header-only firmware packets (Type B ADV, Type C REQ)
+    if((line.length() == HEADER_LENGTH_OTA_ADV && line[8] == MSG_TYPE_OTA_ADV) ||
+       (line.length() == HEADER_LENGTH_OTA_REQ && line[8] == MSG_TYPE_OTA_REQ)){
+      header = line;
+      message = "";
+      Serial.println("RX IR: OTA header-only packet");
+      return true;
+    }
+    
+    // Check for header-only CONTACT packet (10 + 4n chars, Type H)
+    if(line.length() >= HEADER_LENGTH_CONTACT && (line.length() - HEADER_LENGTH_CONTACT) % 4 == 0 &&
+       line[8] == MSG_TYPE_CONTACT){
+      header = line;
+      message = "";
+      return true;
+    }
+    
+    // Check for header-only CAPS packet (11 chars, Type I)
+    if(line.length() == HEADER_LENGTH_CAPS && line[8] == MSG_TYPE_CAPS){
+      header = line;
+      message = "";
+      return true;
+    }
+    
+    // Check for v2.5 SOS (9 chars, no hop) - bridged in caps.h
+    if(line.length() == HEADER_LENGTH_SOS_V25 && line[8] == MSG_TYPE_SOS){
+      header = line;
+      message = "";
+      return true;
+    }
+    
+    // Check for header-only CTX_MISS packet (11 chars, Type F)
+    if(line.length() == HEADER_LENGTH_CTX_MISS && line[8] == MSG_TYPE_CTX_MISS){
+      header = line;
+      message = "";
+      return true;
+    }
+    
+    // Check for header-only TIMESYNC packet (21 chars, Type E)
+    if(line.length() == HEADER_LENGTH_TIMESYNC && line[8] == MSG_TYPE_TIMESYNC){
+      header = line;
+      message = "";
+      Serial.println("RX IR: TIMESYNC header-only packet");
+      return true;
+    }
+    
+    // Check for header-only sync packets (Type 5 DIGEST, Type 6 PULL)
+    if(line.length() >= HEADER_LENGTH_SYNC && (line.length() - HEADER_LENGTH_SYNC) % 4 == 0 &&
+       (line[8] == MSG_TYPE_DIGEST || line[8] == MSG_TYPE_PULL)){
+      header = line;
+      message = "";
+      Serial.println("RX IR: Sync header-only packet");
+      return true;
+    }
+    
+    // Otherwise, first segment of the standard two-segment format
+    if(line.length() == HEADER_LENGTH_STANDARD || line.length() == HEADER_LENGTH_MESSAGE ||
+       line.length() == HEADER_LENGTH_TARGETED ||
+       (line.length() == HEADER_LENGTH_CODED && line[8] == MSG_TYPE_CODED)){
+      receivedHeader = line;
+      waitingForMessage = true;
+      headerReceivedTime = millis();  // Record time for timeout check
+      irHeaderTime = irSegmentTime;   // CONFIG's delay counts from here
+      
+      // Keyed tag is absorbed while the message segment arrives
+      rxAuthReady = false;
+      rxAuthActive = authCovers(line[8]);
+      if(rxAuthActive){
+        authBegin(rxAuth, line);
+        rxAuthHeader = line;
       }
-      return false;
-    } else {
-      // Second segment: receive message
-      header = receivedHeader;
-      message = line;
-      waitingForMessage = false;
-      receivedHeader = "";
-      Serial.println("RX IR: Message received (complete packet)");
-      return true;  // Complete packet received
+      Serial.println("RX IR: Header received, waiting for message...");
     }
+    return false;
   }
   
   // Timeout check: if waiting too long for message segment, reset state
   if(waitingForMessage && (millis() - headerReceivedTime > IR_MESSAGE_TIMEOUT)){
     Serial.println("RX IR: Message segment timeout, resetting state");
+    healthErrors |= HEALTH_ERR_RX_TIMEOUT;
     waitingForMessage = false;
     receivedHeader = "";
+    rxAuthActive = false;
   }
   
   return false;
@@ -340,6 +1368,7 @@ inline void lifiTransmit(String message){
   digitalWrite(LAMP_LIGHT_PIN, HIGH);
   delay(100);
   digitalWrite(LAMP_LIGHT_PIN, LOW);
+  energy.ledMs += 100;
 }
 
 // ==================== GRADIENT SYSTEM FUNCTIONS ====================
@@ -352,7 +1381,7 @@ inline void processInit(String header){
   String src = header.substring(0, 4);
   String initID = header.substring(4, 6);
   String hopStr = header.substring(6, 8);
-  uint8_t receivedHop = hopStr.toInt();
+  uint8_t receivedHop = (uint8_t) strtol(hopStr.c_str(), NULL, 16);
   
   Serial.println();
   Serial.println("╔════════════════════════════════════╗");
@@ -362,12 +1391,21 @@ inline void processInit(String header){
   Serial.print("ID: "); Serial.println(initID);
   Serial.print("Received Hop: "); Serial.println(receivedHop);
   
+  // Hop field is 2 hex chars; the gradient cannot extend past MAX_HOP
+  if(receivedHop >= MAX_HOP){
+    Serial.println(">>> GRADIENT: INIT already at MAX_HOP - ignored");
+    return;
+  }
+  
+  bool newInit = (initID != lastInitID);
+  
   // Check if this is a new INIT ID or an update to existing one
-  if(initID == lastInitID){
+  if(!newInit){
     // Same ID, update hop only if smaller
     if(receivedHop < myHop - 1){
       uint8_t oldHop = myHop;
       myHop = receivedHop + 1;
+      peerEnergy = ENERGY_UNKNOWN;  // Old peers are downstream of us now
       
       #if DEBUG_GRADIENT
         Serial.print(">>> GRADIENT: myHop updated ");
@@ -399,12 +1437,29 @@ inline void processInit(String header){
     #endif
   }
   
-  // Forward INIT with incremented hop (spreads outward)
+  // Track the best-charged alternative relay (sender's hop is receivedHop)
+  // Only a lamp at our own hop can carry a message in our place
+  if(newInit) peerEnergy = ENERGY_UNKNOWN;
+  if(header.length() == HEADER_LENGTH_INIT_ENERGY && receivedHop == myHop){
+    uint8_t senderEnergy = header[9] - '0';
+    if(senderEnergy <= ENERGY_GOOD &&
+       (peerEnergy == ENERGY_UNKNOWN || senderEnergy >= peerEnergy)){
+      peerEnergy = senderEnergy;
+      peerEnergyAt = millis();
+      
+      #if DEBUG_ENERGY
+        Serial.print(">>> ENERGY: Best peer energy class now ");
+        Serial.println(peerEnergy);
+      #endif
+    }
+  }
+  
+  // Forward INIT with incremented hop (spreads outward) and own energy class
   uint8_t newHop = receivedHop + 1;
   char newHopStr[3];
-  sprintf(newHopStr, "%02d", newHop);
+  sprintf(newHopStr, "%02X", newHop);
   
-  String newHeader = src + initID + String(newHopStr) + MSG_TYPE_INIT;
+  String newHeader = src + initID + String(newHopStr) + MSG_TYPE_INIT + String(energyClass());
   
   Serial.print("Forwarding INIT with hop=");
   Serial.println(newHop);
@@ -415,6 +1470,235 @@ inline void processInit(String header){
   Serial.println();
 }
 
+// ==================== CONGESTION CONTROL ====================
+
+/*
+ * Process CONGESTION Message (Type 9)
+ * Applies HQ backpressure and floods it onward
+ */
+inline void processCongestion(String header){
+  String src = header.substring(0, 4);
+  String congestionID = header.substring(9, 11);
+  uint8_t level = header.substring(11, 12).toInt();
+  uint8_t minutes = header.substring(12, 14).toInt();
+  
+  if(!IS_FROM_HQ(src)){
+    Serial.println(">>> AIRTIME: Congestion message not from HQ - ignored");
+    return;
+  }
+  
+  // Dedup on the 2-char ID, keyed away from message hashes
+  if(!isNew(src, 0xC000 | (uint16_t) strtol(congestionID.c_str(), NULL, 16))) return;
+  
+  congestionLevel = min(level, (uint8_t)CONGESTION_MAX_LEVEL);
+  congestionUntil = millis() + (unsigned long)minutes * 60000;
+  
+  #if DEBUG_AIRTIME
+    Serial.print(">>> AIRTIME: HQ congestion level ");
+    Serial.print(congestionLevel);
+    Serial.print(" for ");
+    Serial.print(minutes);
+    Serial.println(" min");
+  #endif
+  
+  irSend(header);  // Flood onward (critical class)
+}
+
+// ==================== RUNTIME TUNING ====================
+
+/*
+ * Process CONFIG Message (Type A)
+ * Stores a newer parameter block as pending for its epoch and floods every
+ * authentic one on with the remaining delay, so all lamps switch at about
+ * the same time
+ */
+inline void processConfig(String header, String message){
+  String src = header.substring(0, 4);
+  String hashStr = header.substring(9, 13);
+  unsigned long delaySec = header.substring(13, 16).toInt();
+  uint16_t receivedHash = (uint16_t) strtol(hashStr.c_str(), NULL, 16);
+  
+  if(!IS_FROM_HQ(src)){
+    Serial.println(">>> PARAMS: CONFIG not from HQ - ignored");
+    return;
+  }
+  
+  if(packetHash(header, message) != receivedHash){
+    Serial.println(">>> ERROR: Corrupted or forged CONFIG (tag mismatch) - discarded");
+    healthErrors |= HEALTH_ERR_CORRUPT;
+    return;
+  }
+  
+  if(!isNew(src, receivedHash)) return;
+  
+  // The sender stamped the delay for the moment its header finished
+  unsigned long applyIn = delaySec * 1000;
+  unsigned long sinceHeader = millis() - irHeaderTime;
+  applyIn = applyIn > sinceHeader ? applyIn - sinceHeader : 0;
+  
+  // Flood onward whether or not we apply it, so lamps behind us still get
+  // it; irSendRaw restamps the delay on every send (configRestamp)
+  configFloodVersion = message.substring(0, 5).toInt();
+  configFloodApplyAt = millis() + applyIn;
+  irSend(src + BROADCAST_ID + MSG_TYPE_CONFIG + hashStr + "000", message);
+  
+  RuntimeParams received;
+  if(!parseParams(message, received)){
+    Serial.println(">>> PARAMS: Invalid CONFIG block - relayed, not applied");
+    return;
+  }
+  
+  uint16_t newest = pendingParamsActive ? pendingParams.version : params.version;
+  if(!paramsVersionNewer(received.version, newest)){
+    Serial.println(">>> PARAMS: CONFIG version not newer - relayed, not applied");
+    return;
+  }
+  
+  pendingParams = received;
+  pendingParamsActive = true;
+  pendingParamsApplyAt = millis() + applyIn;
+  
+  Serial.println();
+  Serial.println("╔════════════════════════════════════╗");
+  Serial.println("║   CONFIG RECEIVED FROM HQ          ║");
+  Serial.println("╚════════════════════════════════════╝");
+  printParams(received);
+  Serial.print("Applying in: "); Serial.print(applyIn / 1000); Serial.println("s");
+  Serial.println("════════════════════════════════════");
+}
+
+// ==================== MESH TIME SYNC ====================
+
+/*
+ * Process TIMESYNC Beacon (Type E)
+ * [src][FFFF][E][seq(2)][hop(2)][mesh time(8 hex)]
+ * The stamp was taken as the sender started this direction; the header's
+ * airtime is added to get mesh time at our decode of the delimiter.
+ */
+inline void processTimeSync(String header){
+  String src = header.substring(0, 4);
+  String seqStr = header.substring(9, 11);
+  uint8_t msgHop = (uint8_t) strtol(header.substring(11, 13).c_str(), NULL, 16);
+  unsigned long stamp = strtoul(header.substring(13, 21).c_str(), NULL, 16);
+  
+  if(!IS_FROM_HQ(src)){
+    Serial.println(">>> TIMESYNC: Beacon not from HQ - ignored");
+    return;
+  }
+  
+  // Take only beacons newer than the last one taken (wraps at 255). Any
+  // beacon goes while unsynced, or once HQ's clock has plainly restarted
+  // (its sequence restarts with it)
+  uint8_t seq = (uint8_t) strtol(seqStr.c_str(), NULL, 16);
+  unsigned long mesh = stamp + TIMESYNC_TX_DELAY;
+  bool restarted = (long)(mesh - meshTime(irSegmentTime)) < -(long)TIMESYNC_RESET_ERROR;
+  if(meshTimeValid() && !restarted && !timeSyncSeqNewer(seq, timeSync.lastSeq)) return;
+  timeSync.lastSeq = seq;
+  
+  uint8_t hop = min(msgHop + 1, (int)MAX_HOP);
+  timeSyncAddPoint(irSegmentTime, mesh, hop);
+  
+  #if DEBUG_TIMESYNC
+    Serial.print(">>> TIMESYNC: Beacon ");
+    Serial.print(seqStr);
+    Serial.print(" via hop ");
+    Serial.println(msgHop);
+    printTimeSync();
+  #endif
+  
+  // Flood onward; irSendRaw fills in our own mesh time
+  char hopStr[3];
+  sprintf(hopStr, "%02X", hop);
+  irSend(src + BROADCAST_ID + MSG_TYPE_TIMESYNC + seqStr + String(hopStr) + "00000000");
+}
+
+// ==================== ENERGY-BALANCED FORWARDING ====================
+
+/*
+ * Relay or Hold Back (Type 4)
+ * Relays at once unless a better-charged gradient peer can carry the message,
+ * in which case the relay is held back ENERGY_DEFER_STEP per class of difference
+ */
+inline void relayOrDefer(String header, String message, String src, uint16_t hash, uint8_t msgHop){
+  uint8_t myEnergy = energyClass();
+  
+  if(peerEnergy != ENERGY_UNKNOWN && millis() - peerEnergyAt > ENERGY_PEER_HOLD){
+    peerEnergy = ENERGY_UNKNOWN;  // Not re-advertised since; may have drained
+    
+    #if DEBUG_ENERGY
+      Serial.println(">>> ENERGY: Peer energy class aged out");
+    #endif
+  }
+  
+  if(peerEnergy != ENERGY_UNKNOWN && peerEnergy > myEnergy){
+    for(int i = 0; i < DEFERRED_FORWARD_SIZE; i++){
+      if(deferredForwards[i].active) continue;
+      
+      deferredForwards[i].header = header;
+      deferredForwards[i].message = message;
+      deferredForwards[i].src = src;
+      deferredForwards[i].msgHash = hash;
+      deferredForwards[i].msgHop = msgHop;
+      deferredForwards[i].due = millis() + ENERGY_DEFER_STEP * (peerEnergy - myEnergy);
+      deferredForwards[i].active = true;
+      
+      #if DEBUG_ENERGY
+        Serial.print(">>> ENERGY: Holding relay back (mine=");
+        Serial.print(myEnergy);
+        Serial.print(", peer=");
+        Serial.print(peerEnergy);
+        Serial.println(")");
+      #endif
+      return;
+    }
+  }
+  
+  LED_ON();
+  irSend(header, message);
+  LED_OFF();
+}
+
+/*
+ * Duplicate Overheard (Type 4)
+ * A copy that has moved closer to HQ than ours means a peer relayed it
+ */
+inline void deferredOverheard(String src, uint16_t hash, uint8_t msgHop){
+  for(int i = 0; i < DEFERRED_FORWARD_SIZE; i++){
+    if(!deferredForwards[i].active) continue;
+    if(deferredForwards[i].src != src || deferredForwards[i].msgHash != hash) continue;
+    if(msgHop >= deferredForwards[i].msgHop) continue;  // Sender's own retransmission
+    
+    deferredForwards[i].active = false;
+    
+    #if DEBUG_ENERGY
+      Serial.println(">>> ENERGY: Peer relayed held message - dropped");
+    #endif
+  }
+}
+
+/*
+ * Process Held-Back Relays (call from loop)
+ * Sends relays no peer has carried in time
+ */
+inline void processDeferredForwards(){
+  unsigned long now = millis();
+  
+  for(int i = 0; i < DEFERRED_FORWARD_SIZE; i++){
+    if(!deferredForwards[i].active) continue;
+    if((long)(now - deferredForwards[i].due) < 0) continue;
+    
+    deferredForwards[i].active = false;
+    
+    #if DEBUG_ENERGY
+      Serial.println(">>> ENERGY: No peer relayed in time - relaying");
+    #endif
+    
+    LED_ON();
+    irSend(deferredForwards[i].header, deferredForwards[i].message);
+    LED_OFF();
+  }
+}
+
 // ==================== PROTOCOL FUNCTIONS ====================
 
 /*
@@ -428,7 +1712,7 @@ inline void generateSOS(){
   Serial.println("╚════════════════════════════════════╝");
   
   char hopStr[3];
-  sprintf(hopStr, "%02d", myHop);
+  sprintf(hopStr, "%02X", myHop);
   
   String header = String(NODE_ID) + HQ_ID + MSG_TYPE_SOS + String(hopStr);
   
@@ -448,7 +1732,18 @@ inline void generateSOS(){
   
   LED_ON();
   
+  // Single-frame beacon first, then the full header as the reliable copy
+  #if SOS_BEACON_ENABLED
+    uint16_t origin, mask;
+    addrParse(NODE_ID, origin, mask);
+    uint8_t seq = sosBeaconSeq;
+    sosBeaconSeq = (sosBeaconSeq + 1) & 0x0F;
+    sosBeaconIsNew(origin, seq);
+    irSendSosBeacon(sosBeaconEncode(origin, myHop, seq));
+  #endif
+  
   irSend(header);  // Send header-only to all 4 directions
+  uplinkStoreAdd(header, "");  // A passing vehicle may get it before the mesh does
   
   LED_OFF();
   
@@ -457,6 +1752,33 @@ inline void generateSOS(){
   Serial.println();
 }
 
+/*
+ * ACK Cache Key
+ * Maps command ID + attempt ("07" + "1") into the dedup cache hash space
+ */
+inline uint16_t ackCacheKey(String cmdTry){
+  return 0xA000 | (uint16_t) strtol(cmdTry.c_str(), NULL, 16);
+}
+
+/*
+ * Send Delivery ACK to HQ (Type 7)
+ * Confirms a targeted message reached this lamp; routed via gradient
+ * Each attempt is ACKed once, however many paths it arrived by
+ */
+inline void sendAck(String cmdTry){
+  if(!isNew(NODE_ID, ackCacheKey(cmdTry))) return;
+  
+  char hopStr[3];
+  sprintf(hopStr, "%02X", myHop);
+  
+  String header = String(NODE_ID) + HQ_ID + MSG_TYPE_ACK + cmdTry + String(hopStr);
+  
+  Serial.print(">>> ACK: Confirming targeted command to HQ: ");
+  Serial.println(header);
+  
+  irSend(header);
+}
+
 /*
  * Process and Forward Incoming Packet
  */
@@ -472,8 +1794,18 @@ inline void forwardPacket(String header, String message,
   String dst = header.substring(4, 8);
   char type = header[8];
   
+  // Every header heard feeds the compression contexts
+  hcLearn(header);
+  
+  // ===== Type F: CTX_MISS - Neighbor lost a compression context =====
+  if(type == MSG_TYPE_CTX_MISS && header.length() == HEADER_LENGTH_CTX_MISS){
+    hcProcessMiss(header);
+    return;
+  }
+  
   // ===== Type 0: INIT - Process gradient update =====
-  if(type == MSG_TYPE_INIT && header.length() == HEADER_LENGTH_INIT){
+  if(type == MSG_TYPE_INIT &&
+     (header.length() == HEADER_LENGTH_INIT || header.length() == HEADER_LENGTH_INIT_ENERGY)){
     processInit(header);
     return;
   }
@@ -481,7 +1813,8 @@ inline void forwardPacket(String header, String message,
   // ===== Type 3: SOS - Header-only with gradient =====
   if(type == MSG_TYPE_SOS && header.length() == HEADER_LENGTH_SOS){
     String hopStr = header.substring(9, 11);
-    uint8_t msgHop = hopStr.toInt();
+    uint8_t msgHop = (uint8_t) strtol(hopStr.c_str(), NULL, 16);
+    gradientObserve(src, 0, msgHop);
     
     Serial.println();
     Serial.println("╔════════════════════════════════════╗");
@@ -492,12 +1825,12 @@ inline void forwardPacket(String header, String message,
     Serial.print("My Hop: "); Serial.println(myHop);
     
     // Gradient check: only forward if we're close enough
-    if(myHop <= msgHop + GRADIENT_TOLERANCE){
+    if(myHop <= msgHop + gradient.tolerance){
       #if DEBUG_GRADIENT
         Serial.print(">>> GRADIENT: CHECK PASSED (myHop=");
         Serial.print(myHop);
         Serial.print(" <= msgHop+K=");
-        Serial.print(msgHop + GRADIENT_TOLERANCE);
+        Serial.print(msgHop + gradient.tolerance);
         Serial.println(")");
       #endif
       
@@ -506,11 +1839,12 @@ inline void forwardPacket(String header, String message,
         uint8_t newHop = (msgHop > 0) ? (msgHop - 1) : 0;
         
         char newHopStr[3];
-        sprintf(newHopStr, "%02d", newHop);
+        sprintf(newHopStr, "%02X", newHop);
         String newHeader = src + dst + type + String(newHopStr);
         
         Serial.print("Forwarding SOS with hop=");
         Serial.println(newHop);
+        uplinkStoreAdd(newHeader, "");
         
         #if DEBUG_LED
           Serial.println(">>> LED: Brief blink for SOS forward");
@@ -525,7 +1859,7 @@ inline void forwardPacket(String header, String message,
         Serial.print(">>> GRADIENT: CHECK FAILED (myHop=");
         Serial.print(myHop);
         Serial.print(" > msgHop+K=");
-        Serial.print(msgHop + GRADIENT_TOLERANCE);
+        Serial.print(msgHop + gradient.tolerance);
         Serial.println(")");
         Serial.println(">>> GRADIENT: NOT forwarding (too far downstream)");
       #endif
@@ -546,19 +1880,121 @@ inline void forwardPacket(String header, String message,
     return;
   }
   
+  // ===== Type 9: CONGESTION - HQ backpressure, flooded =====
+  if(type == MSG_TYPE_CONGESTION && header.length() == HEADER_LENGTH_CONGESTION){
+    processCongestion(header);
+    return;
+  }
+  
+  // ===== Type 7: ACK - Header-only with gradient (like SOS) =====
+  if(type == MSG_TYPE_ACK && header.length() == HEADER_LENGTH_ACK){
+    String cmdTry = header.substring(9, 12);
+    uint8_t msgHop = (uint8_t) strtol(header.substring(12, 14).c_str(), NULL, 16);
+    gradientObserve(src, ackCacheKey(cmdTry), msgHop);
+    
+    if(myHop <= msgHop + gradient.tolerance){
+      if(isNew(src, ackCacheKey(cmdTry))){
+        uint8_t newHop = (msgHop > 0) ? (msgHop - 1) : 0;
+        
+        char newHopStr[3];
+        sprintf(newHopStr, "%02X", newHop);
+        String newHeader = src + dst + type + cmdTry + String(newHopStr);
+        
+        Serial.print("Forwarding ACK from ");
+        Serial.print(src);
+        Serial.print(" with hop=");
+        Serial.println(newHop);
+        
+        irSend(newHeader);
+      }
+    } else {
+      #if DEBUG_GRADIENT
+        Serial.println(">>> GRADIENT: CHECK FAILED - NOT forwarding ACK");
+      #endif
+    }
+    return;
+  }
+  
+  // ===== Type E: TIMESYNC - HQ clock reference, flooded =====
+  if(type == MSG_TYPE_TIMESYNC && header.length() == HEADER_LENGTH_TIMESYNC){
+    processTimeSync(header);
+    return;
+  }
+  
+  // ===== Type A: CONFIG - Runtime parameters from HQ, flooded =====
+  if(type == MSG_TYPE_CONFIG && header.length() == HEADER_LENGTH_CONFIG){
+    processConfig(header, message);
+    return;
+  }
+  
+  // ===== Type B/C/D: Firmware dissemination - one hop =====
+  if(type == MSG_TYPE_OTA_ADV && header.length() == HEADER_LENGTH_OTA_ADV){
+    processOtaAdv(header);
+    return;
+  }
+  if(type == MSG_TYPE_OTA_REQ && header.length() == HEADER_LENGTH_OTA_REQ){
+    processOtaReq(header);
+    return;
+  }
+  if(type == MSG_TYPE_OTA_DATA && header.length() == HEADER_LENGTH_OTA_DATA){
+    processOtaData(header, message);
+    return;
+  }
+  
+  // ===== Type 8: REPORT - Merge downstream coverage =====
+  if(type == MSG_TYPE_REPORT && header.length() == HEADER_LENGTH_REPORT){
+    processCoverageReport(header, message);
+    return;
+  }
+  
+  // ===== Type G: CODED - Two broadcasts, we may be missing one =====
+  if(type == MSG_TYPE_CODED && header.length() == HEADER_LENGTH_CODED){
+    String plainHeader, plainMessage;
+    if(ncDecode(header, message, plainHeader, plainMessage)){
+      forwardPacket(plainHeader, plainMessage, latestLiFiMessage, lastLiFiBroadcastTime);
+    }
+    return;
+  }
+  
+  // ===== Type I: CAPS - Neighbor framing (noted in capsNotePeer) =====
+  if(type == MSG_TYPE_CAPS){
+    return;
+  }
+  
+  // ===== Type H: CONTACT - Mobile HQ in range =====
+  if(type == MSG_TYPE_CONTACT && header.length() >= HEADER_LENGTH_CONTACT){
+    processContactBeacon(header);
+    return;
+  }
+  
+  // ===== Type 5/6: DIGEST/PULL - Neighbor anti-entropy sync =====
+  if(type == MSG_TYPE_DIGEST){
+    processDigest(header);
+    return;
+  }
+  if(type == MSG_TYPE_PULL){
+    processPull(header);
+    return;
+  }
+  
   // ===== Type 4: MESSAGE - Standard message with gradient =====
   if(type == MSG_TYPE_MESSAGE && header.length() == HEADER_LENGTH_MESSAGE){
     String hashStr = header.substring(9, 13);
     String hopStr = header.substring(13, 15);
     uint16_t receivedHash = (uint16_t) strtol(hashStr.c_str(), NULL, 16);
-    uint8_t msgHop = hopStr.toInt();
+    uint8_t msgHop = (uint8_t) strtol(hopStr.c_str(), NULL, 16);
+    
+    // Health trailer is outside the hash
+    String trailer = splitHealthTrailer(message);
     
     // Verify message integrity
     uint16_t computedHash = simpleHash(message);
     if(computedHash != receivedHash){
       Serial.println(">>> ERROR: Corrupted message (hash mismatch) - discarded");
+      healthErrors |= HEALTH_ERR_CORRUPT;
       return;
     }
+    gradientObserve(src, receivedHash, msgHop);
     
     Serial.println();
     Serial.println("╔════════════════════════════════════╗");
@@ -569,7 +2005,7 @@ inline void forwardPacket(String header, String message,
     Serial.print("My Hop: "); Serial.println(myHop);
     
     // Gradient check
-    if(myHop <= msgHop + GRADIENT_TOLERANCE){
+    if(myHop <= msgHop + gradient.tolerance){
       #if DEBUG_GRADIENT
         Serial.println(">>> GRADIENT: CHECK PASSED");
       #endif
@@ -579,19 +2015,19 @@ inline void forwardPacket(String header, String message,
         uint8_t newHop = (msgHop > 0) ? (msgHop - 1) : 0;
         
         char newHopStr[3];
-        sprintf(newHopStr, "%02d", newHop);
+        sprintf(newHopStr, "%02X", newHop);
         String newHeader = src + dst + type + hashStr + String(newHopStr);
         
         Serial.print("Forwarding message with hop=");
         Serial.println(newHop);
         
-        #if DEBUG_LED
-          Serial.println(">>> LED: Brief blink for message forward");
-        #endif
+        // Piggyback health on messages heading to HQ
+        String outMessage = (dst == HQ_ID) ? attachHealth(message, trailer) : message;
+        if(dst == HQ_ID) uplinkStoreAdd(newHeader, outMessage);
         
-        LED_ON();
-        irSend(newHeader, message);
-        LED_OFF();
+        relayOrDefer(newHeader, outMessage, src, receivedHash, msgHop);
+      } else {
+        deferredOverheard(src, receivedHash, msgHop);
       }
     } else {
       #if DEBUG_GRADIENT
@@ -613,19 +2049,26 @@ inline void forwardPacket(String header, String message,
   }
   
   // ===== Type 1/2: BROADCAST/TARGETED - No gradient, normal forwarding =====
-  if(header.length() == HEADER_LENGTH_STANDARD){
+  if(header.length() == HEADER_LENGTH_STANDARD ||
+     (type == MSG_TYPE_TARGETED && header.length() == HEADER_LENGTH_TARGETED)){
     String hashStr = header.substring(9, 13);
+    String cmdTry = header.substring(13);  // Empty for broadcasts and legacy targeted
     uint16_t receivedHash = (uint16_t) strtol(hashStr.c_str(), NULL, 16);
     
-    // Verify integrity
-    uint16_t computedHash = simpleHash(message);
+    // Verify integrity (and HQ origin, with MESH_AUTH)
+    uint16_t computedHash = packetHash(header, message);
     if(computedHash != receivedHash){
-      Serial.println(">>> ERROR: Corrupted message (hash mismatch) - discarded");
+      Serial.println(">>> ERROR: Corrupted or forged message (tag mismatch) - discarded");
+      healthErrors |= HEALTH_ERR_CORRUPT;
       return;
     }
     
+    // Broadcasts already in the store were seen before (e.g. a neighbor's repair)
+    bool alreadyStored = (type == MSG_TYPE_BROADCAST && bcastStoreHas(receivedHash));
+    
     // Forward if new (no gradient check for HQ broadcasts)
-    if(isNew(src, receivedHash)){
+    // Command ID + attempt make HQ retries distinct from the first attempt
+    if(!alreadyStored && isNew(src + cmdTry, receivedHash)){
       #if DEBUG_LED
         Serial.println(">>> LED: Brief blink for broadcast forward");
       #endif
@@ -645,13 +2088,15 @@ inline void forwardPacket(String header, String message,
       Serial.println(message);
       Serial.println("════════════════════════════════════");
       
+      bcastStoreAdd(header, message, receivedHash);
+      
       latestLiFiMessage = message;
       lastLiFiBroadcastTime = millis();
       lifiTransmit(message);
     }
     
-    // Type 2: TARGETED BROADCAST (HQ → Specific lamp)
-    else if(type == MSG_TYPE_TARGETED && dst == NODE_ID && IS_FROM_HQ(src)){
+    // Type 2: TARGETED BROADCAST (HQ → Specific lamp, street or district)
+    else if(type == MSG_TYPE_TARGETED && addrMatches(dst) && IS_FROM_HQ(src)){
       Serial.println("╔════════════════════════════════════╗");
       Serial.println("║  TARGETED BROADCAST FROM HQ        ║");
       Serial.println("╚════════════════════════════════════╝");
@@ -664,6 +2109,12 @@ inline void forwardPacket(String header, String message,
       latestLiFiMessage = message;
       lastLiFiBroadcastTime = millis();
       lifiTransmit(message);
+      
+      // Confirm delivery end-to-end (every attempt, in case an earlier ACK was lost)
+      // Group targets are best-effort: a whole street ACKing would swamp HQ
+      if(cmdTry.length() > 0 && !addrIsGroup(dst)){
+        sendAck(cmdTry);
+      }
     }
     return;
   }
@@ -1,6 +1,10 @@
 #include <Arduino.h>
 #include "config.h"
 #include "lifi.h"
+#include "ota.h"
+#include "contact.h"
+#include "caps.h"
+#include "sched.h"
 
 // ==================== GLOBAL VARIABLES ====================
 
@@ -11,18 +15,240 @@ int cacheIndex = 0;
 // Retransmission queue (defined here, declared extern in config.h)
 RetransmitEntry retransmitQueue[RETRANSMIT_QUEUE_SIZE];
 
+// Broadcast store for anti-entropy sync (defined here, declared extern in config.h)
+BroadcastStoreEntry bcastStore[BCAST_STORE_SIZE];
+int bcastStoreIndex = 0;
+unsigned long nextDigestTime = 0;
+unsigned long lastDigestReplyTime = 0;
+
+// Mobile HQ contact
+UplinkEntry uplinkStore[UPLINK_STORE_SIZE];
+int uplinkIndex = 0;
+ContactState contact;
+ContactStats contactStats = {0, 0, 0, 0};
+
+// Capability negotiation
+CapsPeer capsPeers[CAPS_PEER_SIZE];
+CapsStats capsStats = {0, 0, 0};
+unsigned long capsNextAnnounce = 0;
+unsigned long capsLegacyHeardAt = 0;
+
+// Visible-light channel
+SoftwareSerial vlcSerial;
+VlcPeer vlcPeers[VLC_PEER_SIZE];
+VlcStats vlcStats = {0, 0, 0, 0, 0, 0};
+
+// Network-coded repair
+NcNeighbor ncNeighbors[NC_NEIGHBOR_SIZE];
+NcRepair ncRepairs[NC_REPAIR_SIZE];
+NcStats ncStats = {0, 0, 0, 0};
+
+// Airtime limiter and congestion state (defined here, declared extern in config.h)
+uint16_t airtimeTokens = AIRTIME_BUCKET_SIZE;
+unsigned long lastAirtimeRefill = 0;
+uint8_t congestionLevel = 0;
+unsigned long congestionUntil = 0;
+
+// Health trailer state (defined here, declared extern in config.h)
+uint8_t healthErrors = 0;
+String lastHealthEntry = "";
+String healthRelay = "";
+
 // Gradient system state (defined here, declared extern in config.h)
 String lastInitID = "";
 uint8_t myHop = INITIAL_HOP;  // Start at max distance (uninitialized)
 
+// Adaptive gradient state (reset from params in setup)
+GradientState gradient;
+GradientWatch gradientWatch[GRADIENT_WATCH_SIZE];
+
+// Scheduler state (defined here, declared extern in config.h)
+Task tasks[SCHED_MAX_TASKS];
+uint8_t taskCount = 0;
+volatile bool schedEventPosted = false;
+uint8_t txCompleteTask = SCHED_NO_TASK;
+
+// Low-power listening and energy accounting
+bool lplAwake = true;               // Receiver starts on (irInit)
+unsigned long lplAwakeUntil = 0;
+unsigned long lplNextWake = 0;
+unsigned long lplLastTxTime = 0;
+EnergyStats energy = {0, 0, 0, 0};
+
+// Runtime parameters (loaded from EEPROM in setup)
+RuntimeParams params;
+RuntimeParams pendingParams;
+bool pendingParamsActive = false;
+unsigned long pendingParamsApplyAt = 0;
+uint16_t configFloodVersion = 0;
+unsigned long configFloodApplyAt = 0;
+
+// Message authentication
+SipState rxAuth;
+bool rxAuthActive = false;
+bool rxAuthReady = false;
+String rxAuthHeader = "";
+
+// SOS beacon
+uint32_t rxSosBeacon = 0;
+bool rxSosBeaconPending = false;
+uint8_t sosBeaconSeq = 0;
+SosBeaconSeen sosBeaconSeen[SOS_BEACON_SEEN_SIZE];
+int sosBeaconSeenIndex = 0;
+
+// Header compression
+HcContext hcContexts[HC_CONTEXT_SIZE];
+HcStats hcStats = {0, 0, 0, 0};
+int16_t hcMissPending = -1;
+unsigned long hcLastMiss = 0;
+
+// Transmit preemption
+SuspendedTx suspendedTx;
+volatile bool txPreemptRequested = false;
+
+// Mesh time sync
+TimeSyncState timeSync;
+volatile unsigned long irFrameTime = 0;
+unsigned long irSegmentTime = 0;
+unsigned long irHeaderTime = 0;
+
+// Firmware dissemination (loaded from EEPROM record in setup)
+OtaState ota;
+
+// Energy-balanced forwarding
+uint8_t peerEnergy = ENERGY_UNKNOWN;
+unsigned long peerEnergyAt = 0;
+DeferredForward deferredForwards[DEFERRED_FORWARD_SIZE];
+
+// Task IDs for interrupt-posted events
+uint8_t buttonTask = SCHED_NO_TASK;
+uint8_t irRxTask = SCHED_NO_TASK;
+
 // Button state tracking
 unsigned long lastSOSTime = 0;
-bool lastButtonState = HIGH;  // HIGH = not pressed (INPUT_PULLUP)
+unsigned long lastButtonEdge = 0;
 
 // LiFi rebroadcast tracking
 String latestLiFiMessage = "";
 unsigned long lastLiFiBroadcastTime = 0;
 
+// ==================== INTERRUPT HANDLERS ====================
+
+// SOS button falling edge (press)
+void IRAM_ATTR onSosButtonEdge(){
+  // Cut short any transmission in progress (checked per frame in irSendString)
+  if(millis() - lastSOSTime >= SOS_COOLDOWN) txPreemptRequested = true;
+  schedPostEvent(buttonTask);
+}
+
+// IRremote has a decoded frame ready
+void IRAM_ATTR onIrFrameReady(){
+  irFrameTime = millis();  // Arrival stamp for time sync
+  schedPostEvent(irRxTask);
+}
+
+// ==================== TASKS ====================
+
+// SOS button handling (event: button edge)
+void taskButton(){
+  txPreemptRequested = false;  // Handled below, whether or not an SOS results
+  unsigned long now = millis();
+  if(now - lastButtonEdge < BUTTON_DEBOUNCE) return;  // Contact bounce
+  lastButtonEdge = now;
+  
+  if(digitalRead(SOS_PIN) != LOW) return;  // Released again / noise
+  
+  #if DEBUG_BUTTON
+    Serial.println();
+    Serial.println(">>> BUTTON: SOS button pressed (falling edge detected)");
+  #endif
+  
+  unsigned long timeSinceLastSOS = now - lastSOSTime;
+  
+  if(timeSinceLastSOS >= SOS_COOLDOWN){
+    #if DEBUG_BUTTON
+      Serial.println(">>> BUTTON: Cooldown OK, generating SOS...");
+    #endif
+    generateSOS();
+    lastSOSTime = millis();
+  } else {
+    #if DEBUG_BUTTON
+      Serial.println(">>> BUTTON: Still in cooldown period!");
+      Serial.print("    Time remaining: ");
+      Serial.print((SOS_COOLDOWN - timeSinceLastSOS) / 1000);
+      Serial.println("s");
+    #endif
+  }
+}
+
+// Incoming messages (event: IR frame ready / TX complete; timer: segment
+// timeouts and the visible-light UART, which has no event)
+void taskIrReceive(){
+  String header, message;
+  if(irReceive(header, message)){
+    Serial.println();
+    Serial.println("╔════════════════════════════════════╗");
+    Serial.println("║   COMPLETE PACKET RECEIVED         ║");
+    Serial.println("╚════════════════════════════════════╝");
+    Serial.print("Header: ");
+    Serial.println(header);
+    Serial.print("Message: ");
+    Serial.println(message.length() > 0 ? message : "(none)");
+    Serial.println("Processing packet...");
+    Serial.println();
+    
+    capsBridgeLegacy(header);
+    capsNotePeer(header);
+    vlcNotePeer(header, false);
+    forwardPacket(header, message, latestLiFiMessage, lastLiFiBroadcastTime);
+  }
+  
+  if(vlcReceive(header, message)){
+    Serial.print(">>> VLC: Packet received: ");
+    Serial.println(header);
+    
+    capsNotePeer(header);
+    vlcNotePeer(header, true);
+    forwardPacket(header, message, latestLiFiMessage, lastLiFiBroadcastTime);
+  }
+}
+
+// Periodic LiFi rebroadcast for phone receivers
+void taskLiFiRebroadcast(){
+  if(latestLiFiMessage != "" && 
+     (millis() - lastLiFiBroadcastTime >= params.lifiRebroadcastInterval)){
+    
+    Serial.println(">>> LiFi: Periodic rebroadcast triggered");
+    lifiTransmit(latestLiFiMessage);
+    lastLiFiBroadcastTime = millis();
+  }
+}
+
+// Display current gradient status and task runtime
+void taskStatus(){
+  Serial.println();
+  Serial.println("╔════════════════════════════════════╗");
+  Serial.println("║      GRADIENT STATUS               ║");
+  Serial.println("╚════════════════════════════════════╝");
+  Serial.print("myHop: ");
+  Serial.println(myHop == INITIAL_HOP ? "Uninitialized (FF)" : String(myHop));
+  Serial.print("lastInitID: ");
+  Serial.println(lastInitID.length() > 0 ? lastInitID : "None");
+  #if DEBUG_SCHED
+    schedPrintStats();
+  #endif
+  printEnergyReport();
+  printTimeSync();
+  printGradient();
+  printHcStats();
+  printNetCode();
+  printVlc();
+  printContact();
+  printCaps();
+  Serial.println("════════════════════════════════════");
+  Serial.println();
+}
+
 // ==================== SETUP ====================
 
 void setup(){
@@ -34,12 +260,22 @@ void setup(){
   pinMode(SOS_PIN, INPUT_PULLUP);
   pinMode(LED_STATUS, OUTPUT);
   pinMode(LAMP_LIGHT_PIN, OUTPUT);
+  pinMode(SOLAR_SENSE_PIN, INPUT);
+  
+  // Runtime parameters (EEPROM, factory defaults on first boot)
+  loadParams();
+  gradientReset();
   
   // Note: IR TX pins initialized per-transmission in ir.h
   pinMode(IR_RX_PIN, INPUT);
   
   // Initialize IR hardware (receiver only)
   irInit();
+  vlcInit();
+  
+  // Receiver stays on for a while after boot before duty cycling starts
+  energy.rxSince = millis();
+  lplAwakeUntil = millis() + LPL_WAKE_HOLD;
   
   // Initialize cache to empty state
   for(int i = 0; i < CACHE_SIZE; i++){
@@ -52,16 +288,78 @@ void setup(){
     retransmitQueue[i].active = false;
   }
 
+  // Initialize held-back relays to empty state
+  for(int i = 0; i < DEFERRED_FORWARD_SIZE; i++){
+    deferredForwards[i].active = false;
+  }
+
+  // No compression contexts until headers are heard
+  for(int i = 0; i < HC_CONTEXT_SIZE; i++){
+    hcContexts[i].active = false;
+  }
+
+  // No vehicle met, nothing kept for one
+  for(int i = 0; i < UPLINK_STORE_SIZE; i++){
+    uplinkStore[i].active = false;
+  }
+  contact.hq = "";
+  contact.heardAt = 0;
+  contact.replyPending = false;
+
+  // No neighbors seen on either channel yet
+  for(int i = 0; i < VLC_PEER_SIZE; i++){
+    vlcPeers[i].active = false;
+  }
+  for(int i = 0; i < CAPS_PEER_SIZE; i++){
+    capsPeers[i].active = false;
+  }
+
+  // Nothing preempted yet
+  suspendedTx.active = false;
+
+  // No mesh time until the first beacon
+  timeSync.count = 0;
+  timeSync.next = 0;
+
+  // Initialize broadcast store to empty state
+  for(int i = 0; i < BCAST_STORE_SIZE; i++){
+    bcastStore[i].active = false;
+  }
+  for(int i = 0; i < NC_NEIGHBOR_SIZE; i++){
+    ncNeighbors[i].active = false;
+  }
+  for(int i = 0; i < NC_REPAIR_SIZE; i++){
+    ncRepairs[i].active = false;
+  }
+  for(int i = 0; i < SOS_BEACON_SEEN_SIZE; i++){
+    sosBeaconSeen[i].active = false;
+  }
+  
+  // First digest soon after boot so a rejoining lamp catches up quickly
+  randomSeed(ESP.getChipId() ^ micros());  // A0 is the battery divider: same supply, same reading
+  nextDigestTime = millis() + random(ANTI_ENTROPY_JITTER);
+  sosBeaconSeq = random(16);  // Unlikely to repeat a seq neighbors still have cached
+  capsNextAnnounce = millis() + random(CAPS_HOLDOFF);  // Spread boot announcements
+  
+  // Resume serving our own image if it arrived over the mesh
+  loadOtaRecord();
+
   Serial.println("\n╔════════════════════════════════════╗");
   Serial.println("║   LiFi Mesh Lamp Node V3           ║");
   Serial.println("║   (Hop-Based Gradient System)      ║");
   Serial.println("╚════════════════════════════════════╝");
   Serial.print("Node ID: "); Serial.println(NODE_ID);
+  Serial.print("Node Index: "); Serial.println(NODE_INDEX);
   Serial.print("Initial Hop: "); Serial.println(myHop);
-  Serial.print("Gradient Tolerance (K): "); Serial.println(GRADIENT_TOLERANCE);
+  Serial.print("Firmware Version: "); Serial.println(FIRMWARE_VERSION);
+  Serial.print("Params Version: "); Serial.println(params.version);
+  Serial.print("Gradient Tolerance (K): "); Serial.print(gradient.tolerance);
+  Serial.println(GRADIENT_ADAPTIVE ? " (adaptive)" : "");
   Serial.print("SOS Cooldown: "); Serial.print(SOS_COOLDOWN/1000); Serial.println("s");
-  Serial.print("Retransmit Count: "); Serial.println(RETRANSMIT_COUNT);
-  Serial.print("Retransmit Interval: "); Serial.print(RETRANSMIT_INTERVAL/1000); Serial.println("s");
+  Serial.print("Retransmit Count: "); Serial.println(params.retransmitCount);
+  Serial.print("Retransmit Interval: "); Serial.print(params.retransmitInterval/1000); Serial.println("s");
+  Serial.print("Airtime Budget: "); Serial.print(AIRTIME_BUCKET_SIZE); Serial.print(" chars, +1 per ");
+  Serial.print(AIRTIME_REFILL_INTERVAL); Serial.println("ms");
   Serial.println("4-Direction TX enabled");
   Serial.print("LED Mode: ");
   #if LED_INVERTED
@@ -71,6 +369,29 @@ void setup(){
   #endif
   Serial.println("════════════════════════════════════\n");
   
+  // Register scheduler tasks (period 0 = event-only)
+  buttonTask = schedAddTask("button", taskButton, 0);
+  irRxTask = schedAddTask("irRx", taskIrReceive, 20);  // Poll covers segment timeouts
+  schedAddTask("resume", processSuspendedTx, 250);
+  schedAddTask("hcMiss", processHcMiss, 500);
+  schedAddTask("contact", processContact, 100);
+  schedAddTask("caps", processCaps, 1000);
+  schedAddTask("retransmit", processRetransmitQueue, 500);
+  schedAddTask("deferred", processDeferredForwards, 500);
+  schedAddTask("params", processParams, 1000);
+  schedAddTask("ota", processOta, 1000);
+  schedAddTask("lifi", taskLiFiRebroadcast, 1000);
+  schedAddTask("antiEntropy", processAntiEntropy, 1000);
+  schedAddTask("coverage", processCoverageReports, 1000);
+  schedAddTask("gradient", processGradientWatch, 1000);
+  schedAddTask("status", taskStatus, 30000);
+  schedAddTask("lpl", processLowPowerListening, LPL_CHECK_INTERVAL);
+  txCompleteTask = irRxTask;  // Drain anything heard right after TX
+  
+  // Interrupt-posted events
+  attachInterrupt(digitalPinToInterrupt(SOS_PIN), onSosButtonEdge, FALLING);
+  IrReceiver.registerReceiveCompleteCallback(onIrFrameReady);  // IRremote >= 4.1
+  
   // Startup LED flash (brief, non-blocking)
   LED_ON();
   digitalWrite(LAMP_LIGHT_PIN, HIGH);
@@ -82,80 +403,6 @@ void setup(){
 // ==================== MAIN LOOP ====================
 
 void loop(){
-  // ===== TASK 1: Non-blocking SOS button handling =====
-  bool currentButtonState = digitalRead(SOS_PIN);
-  
-  // Check for falling edge (button press moment)
-  if(currentButtonState == LOW && lastButtonState == HIGH){
-    #if DEBUG_BUTTON
-      Serial.println();
-      Serial.println(">>> BUTTON: SOS button pressed (falling edge detected)");
-    #endif
-    
-    unsigned long timeSinceLastSOS = millis() - lastSOSTime;
-    
-    if(timeSinceLastSOS >= SOS_COOLDOWN){
-      #if DEBUG_BUTTON
-        Serial.println(">>> BUTTON: Cooldown OK, generating SOS...");
-      #endif
-      generateSOS();
-      lastSOSTime = millis();
-    } else {
-      #if DEBUG_BUTTON
-        Serial.println(">>> BUTTON: Still in cooldown period!");
-        Serial.print("    Time remaining: ");
-        Serial.print((SOS_COOLDOWN - timeSinceLastSOS) / 1000);
-        Serial.println("s");
-      #endif
-    }
-  }
-  
-  lastButtonState = currentButtonState;
-
-  // ===== TASK 2: Check for incoming messages =====
-  String header, message;
-  if(irReceive(header, message)){
-    Serial.println();
-    Serial.println("╔════════════════════════════════════╗");
-    Serial.println("║   COMPLETE PACKET RECEIVED         ║");
-    Serial.println("╚════════════════════════════════════╝");
-    Serial.print("Header: ");
-    Serial.println(header);
-    Serial.print("Message: ");
-    Serial.println(message.length() > 0 ? message : "(none)");
-    Serial.println("Processing packet...");
-    Serial.println();
-    
-    forwardPacket(header, message, latestLiFiMessage, lastLiFiBroadcastTime);
-  }
-
-  // ===== TASK 3: Process retransmission queue =====
-  processRetransmitQueue();
-
-  // ===== TASK 4: Periodic LiFi rebroadcast =====
-  if(latestLiFiMessage != "" && 
-     (millis() - lastLiFiBroadcastTime >= LIFI_REBROADCAST_INTERVAL)){
-    
-    Serial.println(">>> LiFi: Periodic rebroadcast triggered");
-    lifiTransmit(latestLiFiMessage);
-    lastLiFiBroadcastTime = millis();
-  }
-
-  // ===== TASK 5: Display current gradient status =====
-  static unsigned long lastStatusPrint = 0;
-  if(millis() - lastStatusPrint > 30000){  // Every 30 seconds
-    Serial.println();
-    Serial.println("╔════════════════════════════════════╗");
-    Serial.println("║      GRADIENT STATUS               ║");
-    Serial.println("╚════════════════════════════════════╝");
-    Serial.print("myHop: ");
-    Serial.println(myHop == INITIAL_HOP ? "Uninitialized (99)" : String(myHop));
-    Serial.print("lastInitID: ");
-    Serial.println(lastInitID.length() > 0 ? lastInitID : "None");
-    Serial.println("════════════════════════════════════");
-    Serial.println();
-    lastStatusPrint = millis();
-  }
-
-  delay(10);
+  // All work is done by scheduler tasks (registered in setup)
+  schedRun();
 }
@@ -0,0 +1,194 @@
+#ifndef NETCODE_H
+#define NETCODE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ==================== NETWORK-CODED REPAIR ====================
+
+/*
+ * Two-Broadcast Network Coding (Type G)
+ * A lamp that got pulls for A from X and for B from Y, where X is known
+ * to hold B and Y to hold A, sends one coded packet A + B instead of A
+ * and B: X recovers A = (A + B) - B from its store, Y recovers B.
+ *
+ * The IR link carries printable chars and uses ' ' as the delimiter, so
+ * the code is addition mod 94 over '!'..'~' instead of a raw XOR (which
+ * would need hex and double the message). The shorter message is padded
+ * with '!' (zero). Broadcasts with other chars are only sent plain.
+ *
+ * What a neighbor holds comes from its digests, and from its pulls: a
+ * pull answers our digest, so every hash we advertised and it did not
+ * pull is one it holds.
+ */
+
+#define NC_FIRST_CHAR '!'
+#define NC_SYMBOLS    94
+
+/*
+ * Store Slot of an Unexpired Broadcast (-1 if not held)
+ */
+inline int ncStoreFind(uint16_t hash){
+  for(int i = 0; i < BCAST_STORE_SIZE; i++){
+    if(bcastStore[i].active && bcastStore[i].msgHash == hash &&
+       millis() - bcastStore[i].storedTime <= ANTI_ENTROPY_MAX_AGE){
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Can Two Stored Broadcasts Be Coded Together
+ */
+inline bool ncCodable(BroadcastStoreEntry &a, BroadcastStoreEntry &b){
+  if(a.header.substring(0, 4) != b.header.substring(0, 4)) return false;  // Receiver rebuilds src from its copy
+  if(a.message.length() > 0xFF || b.message.length() > 0xFF) return false;
+
+  for(unsigned int i = 0; i < a.message.length(); i++){
+    if(a.message[i] < NC_FIRST_CHAR || a.message[i] >= NC_FIRST_CHAR + NC_SYMBOLS) return false;
+  }
+  for(unsigned int i = 0; i < b.message.length(); i++){
+    if(b.message[i] < NC_FIRST_CHAR || b.message[i] >= NC_FIRST_CHAR + NC_SYMBOLS) return false;
+  }
+  return true;
+}
+
+/*
+ * Coded Message: a + b Char by Char
+ */
+inline String ncCombine(String a, String b){
+  String coded = "";
+  unsigned int len = max(a.length(), b.length());
+  for(unsigned int i = 0; i < len; i++){
+    int va = (i < a.length()) ? a[i] - NC_FIRST_CHAR : 0;
+    int vb = (i < b.length()) ? b[i] - NC_FIRST_CHAR : 0;
+    coded += (char)(NC_FIRST_CHAR + (va + vb) % NC_SYMBOLS);
+  }
+  return coded;
+}
+
+/*
+ * Recover the Missing Message: coded - known, Cut to Its Length
+ */
+inline String ncSeparate(String coded, String known, unsigned int length){
+  String missing = "";
+  for(unsigned int i = 0; i < length && i < coded.length(); i++){
+    int vc = coded[i] - NC_FIRST_CHAR;
+    int vk = (i < known.length()) ? known[i] - NC_FIRST_CHAR : 0;
+    missing += (char)(NC_FIRST_CHAR + (vc - vk + NC_SYMBOLS) % NC_SYMBOLS);
+  }
+  return missing;
+}
+
+/*
+ * Record What a Neighbor Holds
+ * Replaces its previous entry, else a free or the stalest slot
+ */
+inline void ncNoteHeld(String id, uint16_t hashes[], int count){
+  int slot = -1;
+  for(int i = 0; i < NC_NEIGHBOR_SIZE && slot < 0; i++){
+    if(ncNeighbors[i].active && ncNeighbors[i].id == id) slot = i;
+  }
+  for(int i = 0; i < NC_NEIGHBOR_SIZE && slot < 0; i++){
+    if(!ncNeighbors[i].active) slot = i;
+  }
+  if(slot < 0){
+    slot = 0;
+    for(int i = 1; i < NC_NEIGHBOR_SIZE; i++){
+      if((long)(ncNeighbors[i].heardAt - ncNeighbors[slot].heardAt) < 0) slot = i;
+    }
+  }
+
+  NcNeighbor &n = ncNeighbors[slot];
+  n.id = id;
+  n.heldCount = min(count, BCAST_STORE_SIZE);
+  for(int i = 0; i < n.heldCount; i++) n.held[i] = hashes[i];
+  n.heardAt = millis();
+  n.active = true;
+}
+
+/*
+ * Is a Neighbor Known to Hold a Broadcast
+ */
+inline bool ncHolds(String id, uint16_t hash){
+  for(int i = 0; i < NC_NEIGHBOR_SIZE; i++){
+    NcNeighbor &n = ncNeighbors[i];
+    if(!n.active || n.id != id || millis() - n.heardAt > NC_NEIGHBOR_HOLD) continue;
+    for(int j = 0; j < n.heldCount; j++){
+      if(n.held[j] == hash) return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Hold a Pulled Broadcast for Coding
+ * Returns false if the table is full (caller replays it plain at once)
+ */
+inline bool ncQueueRepair(String dst, uint16_t hash){
+  int slot = -1;
+  for(int i = 0; i < NC_REPAIR_SIZE; i++){
+    if(!ncRepairs[i].active){
+      if(slot < 0) slot = i;
+    } else if(ncRepairs[i].dst == dst && ncRepairs[i].msgHash == hash){
+      return true;  // Pulled again before we served it
+    }
+  }
+  if(slot < 0) return false;
+
+  ncRepairs[slot].dst = dst;
+  ncRepairs[slot].msgHash = hash;
+  ncRepairs[slot].due = millis() + NC_REPAIR_HOLD;
+  ncRepairs[slot].active = true;
+  return true;
+}
+
+/*
+ * Recover a Broadcast from a Coded Packet (Type G)
+ * Works when we hold exactly one of the two; the result is the plain
+ * Type 1 packet, to be handled like a repair
+ */
+inline bool ncDecode(String header, String message, String &outHeader, String &outMessage){
+  uint16_t hashA = (uint16_t) strtol(header.substring(9, 13).c_str(), NULL, 16);
+  uint16_t hashB = (uint16_t) strtol(header.substring(13, 17).c_str(), NULL, 16);
+  unsigned int lenA = strtol(header.substring(17, 19).c_str(), NULL, 16);
+  unsigned int lenB = strtol(header.substring(19, 21).c_str(), NULL, 16);
+  if(message.length() != max(lenA, lenB)) return false;
+
+  int a = ncStoreFind(hashA);
+  int b = ncStoreFind(hashB);
+  if((a >= 0) == (b >= 0)) return false;  // Have both, or nothing to subtract
+
+  int known = (a >= 0) ? a : b;
+  String hashStr = (a >= 0) ? header.substring(13, 17) : header.substring(9, 13);
+  if(bcastStore[known].message.length() != ((a >= 0) ? lenA : lenB)) return false;
+
+  outHeader = bcastStore[known].header.substring(0, 4) + BROADCAST_ID + MSG_TYPE_BROADCAST + hashStr;
+  outMessage = ncSeparate(message, bcastStore[known].message, (a >= 0) ? lenB : lenA);
+  ncStats.decoded++;
+
+  #if DEBUG_SYNC
+    Serial.print(">>> SYNC: Decoded broadcast 0x");
+    Serial.print(hashStr);
+    Serial.println(" from coded repair");
+  #endif
+  return true;
+}
+
+/*
+ * Print Network-Coded Repair Counters
+ */
+inline void printNetCode(){
+  Serial.print("Repairs: ");
+  Serial.print(ncStats.plain);
+  Serial.print(" plain, ");
+  Serial.print(ncStats.coded);
+  Serial.print(" coded (");
+  Serial.print(ncStats.saved);
+  Serial.print(" chars saved), ");
+  Serial.print(ncStats.decoded);
+  Serial.println(" decoded");
+}
+
+#endif // NETCODE_H
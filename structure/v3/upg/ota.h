@@ -0,0 +1,458 @@
+#ifndef OTA_H
+#define OTA_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Updater.h>
+#include "config.h"
+#include "lifi.h"
+
+// ==================== FIRMWARE DISSEMINATION ====================
+
+/*
+ * Over-the-Mesh Firmware Update (Deluge-style)
+ *
+ * - Nodes holding an image advertise (Type B) version, size and pages held
+ * - A lamp hearing a newer image, or more pages of its current one, asks
+ *   that neighbor (Type C) for the next page it is missing
+ * - The neighbor answers with OTA_PAGE_PACKETS + OTA_REPAIR_PACKETS coded
+ *   packets (Type D), each the XOR of a random subset of the page's source
+ *   packets; any OTA_PAGE_PACKETS independent ones decode the page
+ * - A completed page is staged in flash and advertised at once, so
+ *   downstream lamps fetch page N from us while we fetch page N+1 upstream
+ * - The complete image is verified with CRC32, then against HQ's keyed tag
+ *   (SipHash under MESH_KEY over version, size and every image byte),
+ *   before Update installs it. Lamps relay the tag but cannot make one,
+ *   so a forged advertisement costs a download, never an install
+ */
+
+// Staging area: start of the flash filesystem partition
+extern "C" uint32_t _FS_start;
+extern "C" uint32_t _FS_end;
+
+inline uint32_t otaStagingAddress(){
+  return (uint32_t)(uintptr_t)&_FS_start - 0x40200000;
+}
+
+inline uint32_t otaStagingSize(){
+  return (uint32_t)(uintptr_t)&_FS_end - (uint32_t)(uintptr_t)&_FS_start;
+}
+
+/*
+ * Hex Encode / Decode One Packet Payload
+ */
+inline String otaToHex(const uint8_t *data){
+  char hexStr[OTA_PACKET_BYTES * 2 + 1];
+  for(int i = 0; i < OTA_PACKET_BYTES; i++){
+    sprintf(hexStr + i * 2, "%02X", data[i]);
+  }
+  return String(hexStr);
+}
+
+inline bool otaFromHex(String hexStr, uint8_t *data){
+  if(hexStr.length() != OTA_PACKET_BYTES * 2) return false;
+  for(int i = 0; i < OTA_PACKET_BYTES; i++){
+    char byteStr[3] = {hexStr[i * 2], hexStr[i * 2 + 1], 0};
+    char *end;
+    data[i] = (uint8_t) strtol(byteStr, &end, 16);
+    if(*end != 0) return false;
+  }
+  return true;
+}
+
+/*
+ * Read / Write One Staged Page
+ */
+inline void otaReadPage(uint16_t page, uint8_t *buffer){
+  ESP.flashRead(otaStagingAddress() + (uint32_t)page * OTA_PAGE_BYTES,
+                (uint32_t*)buffer, OTA_PAGE_BYTES);
+}
+
+inline void otaWritePage(uint16_t page, uint8_t *buffer){
+  uint32_t address = otaStagingAddress() + (uint32_t)page * OTA_PAGE_BYTES;
+
+  // Erase each sector when its first page arrives
+  if(address % FLASH_SECTOR_SIZE == 0){
+    ESP.flashEraseSector(address / FLASH_SECTOR_SIZE);
+  }
+  ESP.flashWrite(address, (uint32_t*)buffer, OTA_PAGE_BYTES);
+}
+
+/*
+ * CRC32 of the Staged Image
+ */
+inline uint32_t otaStagedCrc(){
+  uint32_t aligned[OTA_PAGE_BYTES / 4];
+  uint8_t *buffer = (uint8_t*)aligned;
+  uint32_t crc = 0xFFFFFFFF;
+
+  for(uint16_t page = 0; page < ota.pages; page++){
+    otaReadPage(page, buffer);
+    uint32_t bytes = min((uint32_t)OTA_PAGE_BYTES, ota.size - (uint32_t)page * OTA_PAGE_BYTES);
+    for(uint32_t i = 0; i < bytes; i++){
+      crc ^= buffer[i];
+      for(int bit = 0; bit < 8; bit++){
+        crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+      }
+    }
+    yield();
+  }
+  return ~crc;
+}
+
+/*
+ * Keyed Tag of the Staged Image
+ * What HQ (the dashboard) computes: [HQ][BROADCAST][B] + version and
+ * size as advertised + the image bytes, SipHash truncated to 32 bits
+ */
+inline uint32_t otaStagedTag(){
+  uint32_t aligned[OTA_PAGE_BYTES / 4];
+  uint8_t *buffer = (uint8_t*)aligned;
+  char fieldStr[8];
+  sprintf(fieldStr, "%02X%05lX", ota.version, (unsigned long)ota.size);
+
+  SipState s;
+  authBegin(s, String(HQ_ID) + BROADCAST_ID + MSG_TYPE_OTA_ADV);
+  for(int i = 0; i < 7; i++) sipUpdate(s, fieldStr[i]);
+
+  for(uint16_t page = 0; page < ota.pages; page++){
+    otaReadPage(page, buffer);
+    uint32_t bytes = min((uint32_t)OTA_PAGE_BYTES, ota.size - (uint32_t)page * OTA_PAGE_BYTES);
+    for(uint32_t i = 0; i < bytes; i++) sipUpdate(s, buffer[i]);
+    yield();
+  }
+  return (uint32_t)sipFinal(s);
+}
+
+/*
+ * Reset the Page Decoder
+ */
+inline void otaResetDecoder(){
+  for(int i = 0; i < OTA_PAGE_PACKETS; i++) ota.rowMask[i] = 0;
+  ota.rank = 0;
+}
+
+/*
+ * Start Receiving a New Image
+ */
+inline void otaAdopt(uint8_t version, uint32_t size, uint32_t crc, uint32_t tag){
+  ota.version = version;
+  ota.size = size;
+  ota.pages = (size + OTA_PAGE_BYTES - 1) / OTA_PAGE_BYTES;
+  ota.pagesHave = 0;
+  ota.crc = crc;
+  ota.tag = tag;
+  ota.servePage = -1;
+  ota.lastReqTime = 0;
+  ota.serveUntil = 0;
+  otaResetDecoder();
+
+  #if DEBUG_OTA
+    Serial.print(">>> OTA: New image v");
+    Serial.print(version);
+    Serial.print(" (");
+    Serial.print(size);
+    Serial.print(" bytes, ");
+    Serial.print(ota.pages);
+    Serial.println(" pages)");
+  #endif
+}
+
+/*
+ * Send Image Advertisement (Type B)
+ */
+inline void sendOtaAdv(){
+  char fieldStr[27];
+  sprintf(fieldStr, "%02X%05lX%03X%08lX%08lX", ota.version, (unsigned long)ota.size,
+          ota.pagesHave, (unsigned long)ota.crc, (unsigned long)ota.tag);
+  String header = String(NODE_ID) + BROADCAST_ID + MSG_TYPE_OTA_ADV + String(fieldStr);
+
+  if(!airtimeAllowed(header)) return;
+
+  #if DEBUG_OTA
+    Serial.print(">>> OTA: Advertising v");
+    Serial.print(ota.version);
+    Serial.print(", ");
+    Serial.print(ota.pagesHave);
+    Serial.print("/");
+    Serial.print(ota.pages);
+    Serial.println(" pages");
+  #endif
+
+  irSendRaw(header);
+}
+
+/*
+ * Request Next Missing Page (Type C)
+ */
+inline void sendOtaReq(String dst){
+  char fieldStr[6];
+  sprintf(fieldStr, "%02X%03X", ota.version, ota.pagesHave);
+  String header = String(NODE_ID) + dst + MSG_TYPE_OTA_REQ + String(fieldStr);
+
+  if(!airtimeAllowed(header)) return;
+
+  #if DEBUG_OTA
+    Serial.print(">>> OTA: Requesting page ");
+    Serial.print(ota.pagesHave);
+    Serial.print(" from ");
+    Serial.println(dst);
+  #endif
+
+  ota.lastReqTime = millis();
+  irSendRaw(header);
+}
+
+/*
+ * Send One Coded Packet of the Requested Page (Type D)
+ * The first OTA_PAGE_PACKETS are systematic (one source packet each),
+ * repair packets are random XOR combinations
+ */
+inline void sendOtaData(){
+  uint32_t aligned[OTA_PAGE_BYTES / 4];
+  uint8_t *page = (uint8_t*)aligned;
+  otaReadPage(ota.servePage, page);
+
+  uint8_t mask = (ota.serveSent < OTA_PAGE_PACKETS) ? (1 << ota.serveSent) : (uint8_t) random(1, 256);
+
+  uint8_t coded[OTA_PACKET_BYTES] = {0};
+  for(int i = 0; i < OTA_PAGE_PACKETS; i++){
+    if(!(mask & (1 << i))) continue;
+    for(int b = 0; b < OTA_PACKET_BYTES; b++){
+      coded[b] ^= page[i * OTA_PACKET_BYTES + b];
+    }
+  }
+
+  char fieldStr[8];
+  sprintf(fieldStr, "%02X%03X%02X", ota.version, ota.servePage, mask);
+  String header = String(NODE_ID) + BROADCAST_ID + MSG_TYPE_OTA_DATA + String(fieldStr);
+  String message = otaToHex(coded);
+
+  if(!airtimeAllowed(header, message)) return;  // Try again next run
+
+  irSendRaw(header, message);
+  ota.serveSent++;
+}
+
+/*
+ * Verify and Install the Complete Image
+ * Reboots into the new firmware on success
+ */
+inline void otaInstall(){
+  uint32_t crc = otaStagedCrc();
+  if(crc != ota.crc){
+    Serial.println(">>> OTA: CRC mismatch - image discarded");
+    ota.version = 0;
+    return;
+  }
+  if(otaStagedTag() != ota.tag){
+    Serial.println(">>> OTA: Image not signed by HQ - discarded");
+    ota.version = 0;
+    return;
+  }
+
+  Serial.println(">>> OTA: Image verified, installing...");
+
+  uint32_t aligned[OTA_PAGE_BYTES / 4];
+  uint8_t *buffer = (uint8_t*)aligned;
+
+  if(!Update.begin(ota.size)){
+    Serial.println(">>> OTA: Update.begin failed");
+    ota.version = 0;
+    return;
+  }
+  for(uint16_t page = 0; page < ota.pages; page++){
+    otaReadPage(page, buffer);
+    uint32_t bytes = min((uint32_t)OTA_PAGE_BYTES, ota.size - (uint32_t)page * OTA_PAGE_BYTES);
+    Update.write(buffer, bytes);
+    yield();
+  }
+  if(!Update.end(true)){
+    Serial.println(">>> OTA: Update.end failed");
+    ota.version = 0;
+    return;
+  }
+
+  // Remember the image so the new firmware keeps serving it
+  OtaRecord record = {OTA_RECORD_MAGIC, ota.version, ota.size, ota.crc, ota.tag};
+  EEPROM.put(OTA_RECORD_ADDRESS, record);
+  EEPROM.commit();
+
+  // Tell HQ (time-to-update is measured there)
+  String report = "OTA " + String(ota.version) + " OK";
+  uint16_t hash = simpleHash(report);
+  char fieldStr[7];
+  sprintf(fieldStr, "%04X%02X", hash, myHop);
+  irSendRaw(String(NODE_ID) + HQ_ID + MSG_TYPE_MESSAGE + String(fieldStr), report);
+
+  Serial.println(">>> OTA: Installed, rebooting");
+  ESP.restart();
+}
+
+/*
+ * Load Installed Image Record (call in setup, after loadParams)
+ * Resumes serving our own image to neighbors that still need it
+ */
+inline void loadOtaRecord(){
+  ota.version = 0;
+  ota.servePage = -1;
+  ota.nextAdvTime = millis() + random(OTA_ADV_JITTER);
+  otaResetDecoder();
+
+  OtaRecord record;
+  EEPROM.get(OTA_RECORD_ADDRESS, record);
+  if(record.magic != OTA_RECORD_MAGIC || record.version != FIRMWARE_VERSION) return;
+
+  otaAdopt(record.version, record.size, record.crc, record.tag);
+  ota.pagesHave = ota.pages;
+  ota.serveUntil = millis() + OTA_SERVE_WINDOW;
+}
+
+// ==================== OTA PACKET HANDLERS ====================
+
+/*
+ * Process Image Advertisement (Type B)
+ */
+inline void processOtaAdv(String header){
+  String src = header.substring(0, 4);
+  uint8_t version = strtol(header.substring(9, 11).c_str(), NULL, 16);
+  uint32_t size = strtol(header.substring(11, 16).c_str(), NULL, 16);
+  uint16_t have = strtol(header.substring(16, 19).c_str(), NULL, 16);
+  uint32_t crc = strtoul(header.substring(19, 27).c_str(), NULL, 16);
+  uint32_t tag = strtoul(header.substring(27, 35).c_str(), NULL, 16);
+
+  bool newer = (int8_t)(version - FIRMWARE_VERSION) > 0 &&
+               (ota.version == 0 || (int8_t)(version - ota.version) > 0);
+
+  if(newer){
+    uint16_t pages = (size + OTA_PAGE_BYTES - 1) / OTA_PAGE_BYTES;
+    if(size == 0 || pages > OTA_MAX_PAGES || size > otaStagingSize()){
+      Serial.println(">>> OTA: Advertised image does not fit staging area - ignored");
+      return;
+    }
+    otaAdopt(version, size, crc, tag);
+  }
+
+  if(version != ota.version) return;
+
+  if(have > ota.pagesHave){
+    // Neighbor is ahead: ask for our next page (unless a request is in flight)
+    if(ota.lastReqTime == 0 || millis() - ota.lastReqTime > OTA_REQ_TIMEOUT){
+      sendOtaReq(src);
+    }
+  } else if(have < ota.pagesHave){
+    // Neighbor is behind: advertise soon so it can fetch from us
+    unsigned long soon = millis() + random(OTA_ADV_JITTER);
+    if((long)(ota.nextAdvTime - soon) > 0) ota.nextAdvTime = soon;
+  }
+}
+
+/*
+ * Process Page Request (Type C)
+ */
+inline void processOtaReq(String header){
+  String dst = header.substring(4, 8);
+  uint8_t version = strtol(header.substring(9, 11).c_str(), NULL, 16);
+  uint16_t page = strtol(header.substring(11, 14).c_str(), NULL, 16);
+
+  if(dst != NODE_ID || version != ota.version || page >= ota.pagesHave) return;
+
+  // Serve the lowest page asked for (lagging neighbors first)
+  if(ota.servePage < 0 || page < ota.servePage){
+    ota.servePage = page;
+    ota.serveSent = 0;
+
+    #if DEBUG_OTA
+      Serial.print(">>> OTA: Serving page ");
+      Serial.println(page);
+    #endif
+  }
+}
+
+/*
+ * Process Coded Packet (Type D)
+ * Incremental GF(2) elimination: rows are kept with their pivot as lowest bit
+ */
+inline void processOtaData(String header, String message){
+  uint8_t version = strtol(header.substring(9, 11).c_str(), NULL, 16);
+  uint16_t page = strtol(header.substring(11, 14).c_str(), NULL, 16);
+  uint8_t mask = strtol(header.substring(14, 16).c_str(), NULL, 16);
+
+  if(version != ota.version || page != ota.pagesHave || ota.pagesHave >= ota.pages) return;
+
+  uint8_t data[OTA_PACKET_BYTES];
+  if(!otaFromHex(message, data)) return;
+
+  // Reduce by the rows we already hold
+  for(int i = 0; i < OTA_PAGE_PACKETS && mask; i++){
+    if(!(mask & (1 << i)) || ota.rowMask[i] == 0) continue;
+    mask ^= ota.rowMask[i];
+    for(int b = 0; b < OTA_PACKET_BYTES; b++) data[b] ^= ota.rowData[i][b];
+  }
+  if(mask == 0) return;  // Nothing new
+
+  int pivot = 0;
+  while(!(mask & (1 << pivot))) pivot++;
+  ota.rowMask[pivot] = mask;
+  memcpy(ota.rowData[pivot], data, OTA_PACKET_BYTES);
+  ota.rank++;
+
+  if(ota.rank < OTA_PAGE_PACKETS) return;
+
+  // Full rank: back-substitute so each row is a single source packet
+  for(int i = OTA_PAGE_PACKETS - 1; i >= 0; i--){
+    for(int j = i + 1; j < OTA_PAGE_PACKETS; j++){
+      if(!(ota.rowMask[i] & (1 << j))) continue;
+      ota.rowMask[i] ^= ota.rowMask[j];
+      for(int b = 0; b < OTA_PACKET_BYTES; b++) ota.rowData[i][b] ^= ota.rowData[j][b];
+    }
+  }
+
+  otaWritePage(ota.pagesHave, (uint8_t*)ota.rowData);
+  ota.pagesHave++;
+  ota.lastReqTime = 0;
+  otaResetDecoder();
+
+  #if DEBUG_OTA
+    Serial.print(">>> OTA: Page ");
+    Serial.print(ota.pagesHave - 1);
+    Serial.print(" decoded (");
+    Serial.print(ota.pagesHave);
+    Serial.print("/");
+    Serial.print(ota.pages);
+    Serial.println(")");
+  #endif
+
+  // Advertise right away so downstream lamps can pipeline behind us
+  ota.nextAdvTime = millis() + random(OTA_ADV_JITTER / 10);
+}
+
+/*
+ * Firmware Dissemination Task (call from loop)
+ * Serves one coded packet per run, advertises, and installs when complete
+ */
+inline void processOta(){
+  if(ota.version == 0) return;
+  unsigned long now = millis();
+
+  if(ota.servePage >= 0){
+    sendOtaData();
+    if(ota.serveSent >= OTA_PAGE_PACKETS + OTA_REPAIR_PACKETS) ota.servePage = -1;
+    return;
+  }
+
+  if(ota.pagesHave == ota.pages && ota.version != FIRMWARE_VERSION){
+    otaInstall();
+    return;
+  }
+
+  // Installed images are advertised only for a while after boot
+  if(ota.version == FIRMWARE_VERSION && (long)(now - ota.serveUntil) >= 0) return;
+
+  if((long)(now - ota.nextAdvTime) >= 0){
+    sendOtaAdv();
+    ota.nextAdvTime = now + OTA_ADV_INTERVAL + random(OTA_ADV_JITTER);
+  }
+}
+
+#endif // OTA_H
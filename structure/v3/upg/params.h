@@ -0,0 +1,155 @@
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "config.h"
+#include "gradient.h"
+
+// ==================== RUNTIME PARAMETERS ====================
+
+/*
+ * Runtime Protocol Parameters
+ * Timing values HQ can retune mesh-wide with a CONFIG (Type A) flood.
+ * The active block is persisted in EEPROM and survives reboots; the
+ * compile-time constants in config.h are only the factory defaults.
+ *
+ * A received block is held as pending and swapped in as a whole at its
+ * epoch, so a lamp never runs with a half-applied parameter set.
+ */
+
+/*
+ * Factory Defaults (from config.h)
+ */
+inline void paramsDefaults(RuntimeParams &p){
+  p.magic = PARAMS_MAGIC;
+  p.version = 0;
+  p.irDirectionGap = IR_DIRECTION_GAP;
+  p.retransmitInterval = RETRANSMIT_INTERVAL;
+  p.retransmitCount = RETRANSMIT_COUNT;
+  p.gradientTolerance = GRADIENT_TOLERANCE;
+  p.lifiRebroadcastInterval = LIFI_REBROADCAST_INTERVAL;
+}
+
+/*
+ * Load Parameters from EEPROM (call once in setup)
+ * Falls back to factory defaults if no valid block is stored
+ */
+inline void loadParams(){
+  EEPROM.begin(EEPROM_SIZE);
+  EEPROM.get(0, params);
+
+  if(params.magic != PARAMS_MAGIC){
+    paramsDefaults(params);
+    Serial.println(">>> PARAMS: No stored block, using defaults");
+  } else {
+    Serial.print(">>> PARAMS: Loaded version ");
+    Serial.println(params.version);
+  }
+}
+
+/*
+ * Persist Active Parameters
+ */
+inline void saveParams(){
+  EEPROM.put(0, params);
+  EEPROM.commit();
+}
+
+/*
+ * Parse CONFIG Message Body
+ * [ver(5)][gap ms(4)][interval s(3)][count(1)][tolerance(1)][lifi s(4)]
+ * Returns false if malformed or out of range
+ */
+inline bool parseParams(String message, RuntimeParams &p){
+  if(message.length() != CONFIG_MESSAGE_LENGTH) return false;
+  for(unsigned int i = 0; i < message.length(); i++){
+    if(!isDigit(message[i])) return false;
+  }
+
+  long version = message.substring(0, 5).toInt();
+  unsigned long gap = message.substring(5, 9).toInt();
+  unsigned long interval = message.substring(9, 12).toInt();
+  uint8_t count = message.substring(12, 13).toInt();
+  uint8_t tolerance = message.substring(13, 14).toInt();
+  unsigned long lifi = message.substring(14, 18).toInt();
+
+  if(version == 0 || version > 65535 || gap > CONFIG_MAX_DIRECTION_GAP || interval == 0 || lifi == 0) return false;
+  // Count 0 would never resend an airtime-deferred relay; K beyond the
+  // adaptive range would be clamped silently by gradientReset
+  if(count == 0 || tolerance > GRADIENT_K_MAX) return false;
+
+  p.magic = PARAMS_MAGIC;
+  p.version = version;
+  p.irDirectionGap = gap;
+  p.retransmitInterval = interval * 1000;
+  p.retransmitCount = count;
+  p.gradientTolerance = tolerance;
+  p.lifiRebroadcastInterval = lifi * 1000;
+  return true;
+}
+
+/*
+ * Is Version Newer
+ * No wrap: HQ numbers blocks 1-65535 and factory defaults are 0, so a new
+ * lamp, or one that was off through any number of blocks, takes the next
+ */
+inline bool paramsVersionNewer(uint16_t version, uint16_t than){
+  return version > than;
+}
+
+/*
+ * Print Parameter Block
+ */
+inline void printParams(const RuntimeParams &p){
+  Serial.print("  Version: "); Serial.println(p.version);
+  Serial.print("  Direction gap: "); Serial.print(p.irDirectionGap); Serial.println("ms");
+  Serial.print("  Retransmit: "); Serial.print(p.retransmitCount);
+  Serial.print(" x "); Serial.print(p.retransmitInterval / 1000); Serial.println("s");
+  Serial.print("  Gradient tolerance (K): "); Serial.println(p.gradientTolerance);
+  Serial.print("  LiFi rebroadcast: "); Serial.print(p.lifiRebroadcastInterval / 1000); Serial.println("s");
+}
+
+/*
+ * Restamp a CONFIG Header with the Delay Left
+ * Called by irSendRaw before each direction, retransmit and VLC frame:
+ * the delay is what remains once the header itself has gone out
+ * (headerAirtime), rounded to the second. The epoch is that of the last
+ * CONFIG relayed, whether or not this lamp applies it; an older flood,
+ * or one past its epoch, goes out as 000, to apply on arrival.
+ */
+inline String configRestamp(String header, String message, unsigned long headerAirtime){
+  unsigned long remaining = 0;
+  if(message.substring(0, 5).toInt() == configFloodVersion){
+    long left = (long)(configFloodApplyAt - millis() - headerAirtime);
+    if(left > 0) remaining = (unsigned long)left;
+  }
+
+  char delayStr[4];
+  sprintf(delayStr, "%03lu", min((remaining + 500) / 1000, 999UL));
+  return header.substring(0, header.length() - 3) + String(delayStr);
+}
+
+/*
+ * Apply Pending Parameters at Their Epoch (call from loop)
+ */
+inline void processParams(){
+  if(!pendingParamsActive) return;
+  if((long)(millis() - pendingParamsApplyAt) < 0) return;
+
+  bool newTolerance = pendingParams.gradientTolerance != params.gradientTolerance;
+  params = pendingParams;
+  pendingParamsActive = false;
+  if(newTolerance) gradientReset();  // HQ's K overrides what this lamp learned
+  saveParams();
+
+  Serial.println();
+  Serial.println("╔════════════════════════════════════╗");
+  Serial.println("║   RUNTIME PARAMETERS APPLIED       ║");
+  Serial.println("╚════════════════════════════════════╝");
+  printParams(params);
+  Serial.println("════════════════════════════════════");
+  Serial.println();
+}
+
+#endif // PARAMS_H
@@ -0,0 +1,159 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+#include <IRremote.h>
+#include "config.h"
+
+// ==================== LOW-POWER LISTENING ====================
+
+/*
+ * Duty-Cycled Receiver (LPL_ENABLED)
+ * The IR decoder runs only for a short check window every LPL_SLEEP_INTERVAL.
+ * Senders precede every packet with a wake preamble (see irSendWakePreamble)
+ * that lasts longer than the sleep interval, so a sleeping neighbor always
+ * catches at least one wake frame in its next window and stays awake for
+ * the packet that follows.
+ *
+ * Cost: every hop adds one preamble (~LPL_SLEEP_INTERVAL) of latency,
+ * SOS included. Set LPL_ENABLED 0 for an always-on receiver.
+ */
+
+/*
+ * Read Battery Level
+ * Returns 0-9 (tenths of charge) from the battery sense divider
+ */
+inline int readBatteryLevel(){
+  int raw = analogRead(BATTERY_SENSE_PIN);
+  return constrain(map(raw, BATTERY_ADC_EMPTY, BATTERY_ADC_FULL, 0, 9), 0, 9);
+}
+
+/*
+ * Coarse Energy Class (advertised to neighbors)
+ * ENERGY_DEPLETED / ENERGY_LOW / ENERGY_GOOD, raised one class while charging
+ */
+inline uint8_t energyClass(){
+  int level = readBatteryLevel();
+  uint8_t cls = level <= ENERGY_DEPLETED_LEVEL ? ENERGY_DEPLETED :
+                level <= ENERGY_LOW_LEVEL ? ENERGY_LOW : ENERGY_GOOD;
+  if(cls < ENERGY_GOOD && digitalRead(SOLAR_SENSE_PIN) == HIGH) cls++;
+  return cls;
+}
+
+/*
+ * Account Receiver On-Time up to Now
+ */
+inline void energyUpdateRx(){
+  unsigned long now = millis();
+  if(lplAwake) energy.rxMs += now - energy.rxSince;
+  energy.rxSince = now;
+}
+
+/*
+ * Keep Receiver Awake
+ * Called on every received frame (wake or data) and after our own TX,
+ * so multi-segment packets and replies are not cut off by sleep
+ */
+inline void lplExtendAwake(){
+  #if LPL_ENABLED
+    unsigned long until = millis() + LPL_WAKE_HOLD;
+    if(!lplAwake || (long)(until - lplAwakeUntil) > 0) lplAwakeUntil = until;
+  #endif
+}
+
+/*
+ * Low-Power Listening Task
+ * Switches the IR decoder between sleep and check windows
+ */
+inline void processLowPowerListening(){
+  #if LPL_ENABLED
+    unsigned long now = millis();
+
+    if(lplAwake){
+      if((long)(now - lplAwakeUntil) < 0) return;
+
+      // Window over, nothing heard: sleep until the next check window
+      energyUpdateRx();
+      IrReceiver.stop();
+      lplAwake = false;
+      lplNextWake = now + LPL_SLEEP_INTERVAL;
+    }
+    else if((long)(now - lplNextWake) >= 0){
+      // Open a check window
+      energyUpdateRx();
+      IrReceiver.start();
+      lplAwake = true;
+      lplAwakeUntil = now + LPL_LISTEN_WINDOW;
+    }
+  #endif
+}
+
+// ==================== ENERGY MODEL ====================
+
+/*
+ * Per-Node Energy Accounting
+ * Time spent in each state (CPU active, receiver on, IR TX, lamp LED)
+ * is multiplied by the modelled current draw of that state.
+ * CPU active time comes from the scheduler's per-task runtime.
+ */
+
+inline unsigned long energyCpuActiveMs(){
+  uint64_t micros = 0;
+  for(uint8_t i = 0; i < taskCount; i++){
+    micros += tasks[i].totalMicros;
+  }
+  return (unsigned long)(micros / 1000);
+}
+
+/*
+ * Charge Used Since Boot (mAh)
+ */
+inline float energyUsedMah(){
+  energyUpdateRx();
+
+  float mAms = (float)millis() * POWER_BASE_MA
+             + (float)energyCpuActiveMs() * POWER_CPU_ACTIVE_MA
+             + (float)energy.rxMs * POWER_RX_MA
+             + (float)energy.txMs * POWER_IR_TX_MA
+             + (float)energy.ledMs * POWER_LAMP_LED_MA;
+
+  return mAms / 3600000.0;
+}
+
+/*
+ * Print Energy Report
+ * Average current so far and projected autonomy without solar input
+ */
+inline void printEnergyReport(){
+  unsigned long uptime = millis();
+  if(uptime == 0) return;
+
+  float usedMah = energyUsedMah();
+  float avgMa = usedMah * 3600000.0 / uptime;
+  float fullHours = BATTERY_CAPACITY_MAH / avgMa;
+  float remainingHours = fullHours * readBatteryLevel() / 9.0;
+
+  Serial.println("Energy model:");
+  Serial.print("  Receiver: ");
+  Serial.println(LPL_ENABLED ? "duty-cycled (LPL)" : "always on");
+  Serial.print("  Duty (%) rx / tx / led / cpu: ");
+  Serial.print(100.0 * energy.rxMs / uptime, 1);
+  Serial.print(" / ");
+  Serial.print(100.0 * energy.txMs / uptime, 1);
+  Serial.print(" / ");
+  Serial.print(100.0 * energy.ledMs / uptime, 2);
+  Serial.print(" / ");
+  Serial.println(100.0 * energyCpuActiveMs() / uptime, 2);
+  Serial.print("  Used: ");
+  Serial.print(usedMah, 2);
+  Serial.print(" mAh, avg ");
+  Serial.print(avgMa, 1);
+  Serial.println(" mA");
+  Serial.print("  Autonomy (no sun): ");
+  Serial.print(fullHours, 0);
+  Serial.print("h full, ");
+  Serial.print(remainingHours, 0);
+  Serial.println("h remaining");
+}
+
+#endif // POWER_H
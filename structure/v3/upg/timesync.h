@@ -0,0 +1,169 @@
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ==================== MESH TIME SYNC ====================
+
+/*
+ * Mesh Time (HQ's millis() clock, estimated locally)
+ * Each beacon gives one (local arrival, mesh time) pair. The table of
+ * offsets (mesh - local) is fitted with a line, so the slope tracks this
+ * lamp's crystal drift against HQ and mesh time stays usable between
+ * beacons. Fit values are kept relative to the newest point so floats
+ * only ever hold small numbers.
+ */
+
+/*
+ * Is Mesh Time Known
+ */
+inline bool meshTimeValid(){
+  return timeSync.count > 0 && millis() - timeSync.lastBeacon < TIMESYNC_TIMEOUT;
+}
+
+/*
+ * Is Beacon Sequence Newer (wraps at 255)
+ */
+inline bool timeSyncSeqNewer(uint8_t seq, uint8_t than){
+  return (int8_t)(seq - than) > 0;
+}
+
+/*
+ * Mesh Time at a Local millis() Value
+ * Falls back to local time while unsynced
+ */
+inline unsigned long meshTime(unsigned long local){
+  if(timeSync.count == 0) return local;
+  float dx = (float)(long)(local - timeSync.localRef);
+  return local + timeSync.offsetRef + (long)(timeSync.intercept + timeSync.skew * dx);
+}
+
+inline unsigned long meshNow(){
+  return meshTime(millis());
+}
+
+/*
+ * Fit Offset and Drift (least squares over the table)
+ */
+inline void timeSyncFit(){
+  uint8_t n = timeSync.count;
+  float xMean = 0, yMean = 0;
+  for(uint8_t i = 0; i < n; i++){
+    xMean += (float)(long)(timeSync.localTime[i] - timeSync.localRef);
+    yMean += (float)(timeSync.offset[i] - timeSync.offsetRef);
+  }
+  xMean /= n;
+  yMean /= n;
+
+  float sxx = 0, sxy = 0;
+  for(uint8_t i = 0; i < n; i++){
+    float dx = (float)(long)(timeSync.localTime[i] - timeSync.localRef) - xMean;
+    float dy = (float)(timeSync.offset[i] - timeSync.offsetRef) - yMean;
+    sxx += dx * dx;
+    sxy += dx * dy;
+  }
+
+  // Beacons close together say little about drift; bound it
+  const float maxSkew = TIMESYNC_MAX_SKEW_PPM / 1000000.0;
+  timeSync.skew = (sxx > 0) ? constrain(sxy / sxx, -maxSkew, maxSkew) : 0;
+  timeSync.intercept = yMean - timeSync.skew * xMean;
+
+  timeSync.maxResidual = 0;
+  for(uint8_t i = 0; i < n; i++){
+    float x = (float)(long)(timeSync.localTime[i] - timeSync.localRef);
+    float y = (float)(timeSync.offset[i] - timeSync.offsetRef);
+    float residual = fabs(y - (timeSync.intercept + timeSync.skew * x));
+    if(residual > timeSync.maxResidual) timeSync.maxResidual = residual;
+  }
+}
+
+/*
+ * Add a Reference Point from a Beacon
+ * @param local - Local millis() when the beacon arrived
+ * @param mesh  - Mesh time at that moment (stamp plus airtime)
+ * @param hop   - Our distance from HQ along this beacon's path
+ */
+inline void timeSyncAddPoint(unsigned long local, unsigned long mesh, uint8_t hop){
+  // Far off the current fit: HQ's clock restarted, old points are useless
+  if(timeSync.count > 0){
+    long error = (long)(mesh - meshTime(local));
+    if((unsigned long)abs(error) > TIMESYNC_RESET_ERROR){
+      #if DEBUG_TIMESYNC
+        Serial.print(">>> TIMESYNC: Beacon ");
+        Serial.print(error);
+        Serial.println("ms off the fit - resetting table");
+      #endif
+      timeSync.count = 0;
+      timeSync.next = 0;
+    }
+  }
+
+  timeSync.localTime[timeSync.next] = local;
+  timeSync.offset[timeSync.next] = (long)(mesh - local);
+  timeSync.next = (timeSync.next + 1) % TIMESYNC_TABLE_SIZE;
+  if(timeSync.count < TIMESYNC_TABLE_SIZE) timeSync.count++;
+
+  timeSync.localRef = local;
+  timeSync.offsetRef = (long)(mesh - local);
+  timeSync.hop = hop;
+  timeSync.lastBeacon = millis();
+
+  timeSyncFit();
+}
+
+/*
+ * Error Bound on Mesh Time Right Now (ms)
+ * Spread of the fit, per-hop stamping jitter and drift since the last beacon
+ */
+inline unsigned long timeSyncErrorBound(){
+  unsigned long age = millis() - timeSync.lastBeacon;
+  return (unsigned long)timeSync.maxResidual
+       + (unsigned long)timeSync.hop * TIMESYNC_HOP_ERROR
+       + age / (1000000UL / TIMESYNC_SKEW_PPM);
+}
+
+/*
+ * Error Class for the Health Trailer
+ * n = bound within 2^(n+4) ms, 0xF = unsynced
+ */
+inline uint8_t timeSyncClass(){
+  if(!meshTimeValid()) return 0xF;
+  unsigned long bound = timeSyncErrorBound();
+  uint8_t cls = 0;
+  while(cls < 0xE && bound >= (16UL << cls)) cls++;
+  return cls;
+}
+
+/*
+ * Restamp a TIMESYNC Header with Mesh Time Now
+ * Called by irSendRaw right before each direction goes out
+ */
+inline String timeSyncRestamp(String header){
+  char timeStr[9];
+  sprintf(timeStr, "%08lX", meshNow());
+  return header.substring(0, HEADER_LENGTH_TIMESYNC - 8) + String(timeStr);
+}
+
+/*
+ * Print Mesh Time Status
+ */
+inline void printTimeSync(){
+  Serial.print("Mesh time: ");
+  if(!meshTimeValid()){
+    Serial.println("unsynced");
+    return;
+  }
+  Serial.print(meshNow());
+  Serial.print("ms +/- ");
+  Serial.print(timeSyncErrorBound());
+  Serial.print("ms (");
+  Serial.print(timeSync.count);
+  Serial.print(" beacons, hop ");
+  Serial.print(timeSync.hop);
+  Serial.print(", drift ");
+  Serial.print(timeSync.skew * 1000000.0, 1);
+  Serial.println("ppm)");
+}
+
+#endif // TIMESYNC_H
@@ -0,0 +1,216 @@
+#ifndef VLC_H
+#define VLC_H
+
+#include <Arduino.h>
+#include <SoftwareSerial.h>
+#include "config.h"
+#include "power.h"
+
+// ==================== VISIBLE-LIGHT CHANNEL ====================
+
+/*
+ * Lamp-to-Lamp Traffic over the Lamp LED
+ * One frame per packet, sent at once toward every neighbor in sight:
+ *   [header] ' ' [message] ' ' [check(4 hex)] '\n'
+ * The check is a Fletcher-16 over header + ' ' + message; UART has none
+ * of its own, and a phone LiFi pulse (lifiTransmit) on the same LED
+ * garbles whatever frame a neighbor was receiving.
+ *
+ * Channel choice (irSendRaw): SOS, INIT, TIMESYNC, CTX_MISS and CAPS stay on IR,
+ * which reaches every neighbor and whose timing they depend on. Anything
+ * else also goes out as a frame, and skips IR altogether when every
+ * neighbor heard on IR lately has also been heard on visible light. Links
+ * are taken as symmetric: a neighbor whose light we see can see ours.
+ */
+
+extern SoftwareSerial vlcSerial;  // Defined in main.ino
+
+/*
+ * Start the Visible-Light UART
+ */
+inline void vlcInit(){
+  if(!VLC_ENABLED) return;
+  vlcSerial.begin(VLC_BAUD, SWSERIAL_8N1, VLC_RX_PIN, LAMP_LIGHT_PIN, true);
+  Serial.println(">>> VLC: Visible-light channel on pin " + String(VLC_RX_PIN));
+}
+
+/*
+ * Fletcher-16 of a Frame Body
+ */
+inline uint16_t vlcChecksum(String body){
+  uint16_t a = 0, b = 0;
+  for(unsigned int i = 0; i < body.length(); i++){
+    a = (a + (uint8_t)body[i]) % 255;
+    b = (b + a) % 255;
+  }
+  return (b << 8) | a;
+}
+
+/*
+ * Can This Packet Type Use the Visible-Light Channel
+ */
+inline bool vlcCarries(char type){
+  return VLC_ENABLED && type != MSG_TYPE_SOS && type != MSG_TYPE_INIT &&
+         type != MSG_TYPE_TIMESYNC && type != MSG_TYPE_CTX_MISS && type != MSG_TYPE_CAPS;
+}
+
+/*
+ * Sender of a One-Hop Packet ("" if the src field is the origin instead)
+ */
+inline String vlcNeighborOf(String header){
+  switch(header[8]){
+    case MSG_TYPE_DIGEST:
+    case MSG_TYPE_PULL:
+    case MSG_TYPE_OTA_ADV:
+    case MSG_TYPE_OTA_REQ:
+    case MSG_TYPE_OTA_DATA:
+    case MSG_TYPE_CTX_MISS:
+    case MSG_TYPE_CODED:
+      return header.substring(0, 4);
+    default:
+      return "";
+  }
+}
+
+/*
+ * Note the Channel a Neighbor Was Heard On
+ * Its entry, else a free or the stalest slot
+ */
+inline void vlcNotePeer(String header, bool onVlc){
+  if(!VLC_ENABLED) return;
+  String id = vlcNeighborOf(header);
+  if(id.length() == 0 || id == NODE_ID) return;
+
+  int slot = -1;
+  for(int i = 0; i < VLC_PEER_SIZE && slot < 0; i++){
+    if(vlcPeers[i].active && vlcPeers[i].id == id) slot = i;
+  }
+  if(slot < 0){
+    slot = 0;
+    for(int i = 0; i < VLC_PEER_SIZE; i++){
+      if(!vlcPeers[i].active){
+        slot = i;
+        break;
+      }
+      unsigned long heard = max(vlcPeers[i].irHeardAt, vlcPeers[i].vlcHeardAt);
+      unsigned long oldest = max(vlcPeers[slot].irHeardAt, vlcPeers[slot].vlcHeardAt);
+      if((long)(heard - oldest) < 0) slot = i;
+    }
+    vlcPeers[slot].id = id;
+    vlcPeers[slot].irHeardAt = 0;
+    vlcPeers[slot].vlcHeardAt = 0;
+    vlcPeers[slot].active = true;
+  }
+
+  if(onVlc) vlcPeers[slot].vlcHeardAt = millis();
+  else vlcPeers[slot].irHeardAt = millis();
+}
+
+/*
+ * Does Visible Light Reach Every Neighbor Heard Lately
+ * (and at least one), so IR can be left out
+ */
+inline bool vlcReplacesIr(){
+  if(!VLC_ENABLED) return false;
+
+  bool anyVlc = false;
+  for(int i = 0; i < VLC_PEER_SIZE; i++){
+    VlcPeer &p = vlcPeers[i];
+    if(!p.active) continue;
+    bool onIr = p.irHeardAt != 0 && millis() - p.irHeardAt < VLC_PEER_HOLD;
+    bool onVlc = p.vlcHeardAt != 0 && millis() - p.vlcHeardAt < VLC_PEER_HOLD;
+    if(onIr && !onVlc) return false;
+    anyVlc |= onVlc;
+  }
+  return anyVlc;
+}
+
+/*
+ * Send One Frame
+ */
+inline void vlcSend(String header, String message){
+  String body = header + " " + message;
+  char check[5];
+  sprintf(check, "%04X", vlcChecksum(body));
+  String frame = body + " " + check + "\n";
+
+  vlcSerial.print(frame);
+  vlcSerial.flush();
+
+  vlcStats.sent++;
+  vlcStats.chars += frame.length();
+  energy.ledMs += frame.length() * 10000UL / VLC_BAUD;  // 10 bits per char
+}
+
+/*
+ * Receive One Frame (call from the receive task)
+ * Returns true when a complete, intact packet is ready
+ */
+inline bool vlcReceive(String &header, String &message){
+  static String buffer = "";
+  static unsigned long lastCharTime = 0;
+  if(!VLC_ENABLED) return false;
+
+  if(buffer.length() > 0 && millis() - lastCharTime > VLC_FRAME_TIMEOUT){
+    buffer = "";
+    vlcStats.errors++;
+  }
+
+  while(vlcSerial.available()){
+    char c = vlcSerial.read();
+    lastCharTime = millis();
+
+    if(c != '\n'){
+      if(c < ' ' || c > '~' || buffer.length() >= VLC_MAX_FRAME){
+        buffer = "";  // Noise, or a frame garbled past its end
+        vlcStats.errors++;
+        continue;
+      }
+      buffer += c;
+      continue;
+    }
+
+    // [header] ' ' [message] ' ' [check]
+    String frame = buffer;
+    buffer = "";
+    int first = frame.indexOf(' ');
+    int last = frame.lastIndexOf(' ');
+    if(first < 9 || last <= first || frame.length() - last != 5){
+      vlcStats.errors++;
+      continue;
+    }
+
+    String body = frame.substring(0, last);
+    if((uint16_t) strtol(frame.substring(last + 1).c_str(), NULL, 16) != vlcChecksum(body)){
+      vlcStats.errors++;
+      continue;
+    }
+
+    header = frame.substring(0, first);
+    message = frame.substring(first + 1, last);
+    irHeaderTime = millis();  // A frame's header and message arrive together
+    vlcStats.received++;
+    return true;
+  }
+  return false;
+}
+
+/*
+ * Print Visible-Light Channel Counters
+ */
+inline void printVlc(){
+  if(!VLC_ENABLED) return;
+  Serial.print("VLC: ");
+  Serial.print(vlcStats.sent);
+  Serial.print(" sent (");
+  Serial.print(vlcStats.irSkipped);
+  Serial.print(" without IR, ");
+  Serial.print(vlcStats.irCharsSaved);
+  Serial.print(" IR chars saved), ");
+  Serial.print(vlcStats.received);
+  Serial.print(" received, ");
+  Serial.print(vlcStats.errors);
+  Serial.println(" errors");
+}
+
+#endif // VLC_H